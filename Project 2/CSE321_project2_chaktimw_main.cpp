@@ -9,7 +9,8 @@
  *      Alarm code will loop until shutdown by user. 
  *
  * Modules: 
- *      1802.cpp, 1802.h, mbed.h
+ *      keyfifo.h, keypad.cpp, keypad.h, timerui.h, timerwheel.cpp, timerwheel.h, mbed.h,
+ *      1802.cpp, 1802.h, binlog.h, binlog.cpp, binlog_formats.h, serialtx.h, serialtx.cpp, format.h (from Project 3)
  *
  * Assignment: Project 2 - Midpoint
  *
@@ -34,377 +35,255 @@
 
 #include "mbed.h"
 #include "1802.h"
-#include <cctype>
-#include <cstdlib>
-#include <cstring>
-#include <ctime>
+#include "binlog.h"
+#include "format.h"
+#include "keyfifo.h"
+#include "keypad.h"
+#include "timerui.h"
+#include "timerwheel.h"
 
 // declare callback functions
-void isr_147x(void);
-void isr_2580(void);
-void isr_369y(void);
-void isr_ABCD(void);
+void key_event(char key, bool pressed);
+void countdown_done();
+
+// handle the queued key events
+void drain_keys();
+
+// main thread events: handle what is due, and wake for the countdown
+void service();
+void countdown_tick();
+void schedule_tick();
 
 // declare timer functions
 void create_timer();
 void start_timer();
+void resume_timer();
 void pause_timer();
 void end_timer();
 
 // declare keypress handler
 void handle_keypress(char input);
 
-// wait constant (1 sec = 1,000,000 us)
-#define WAIT_TIME_US 500000
+// carry out the action the state machine picked
+void run_step(TimerUI::Step step);
+
+// redraw the display lines that changed
+void update_display();
+
+// key events the queue holds until the main thread gets to them, a power of two
+#define KEY_QUEUE_SIZE 16
+
+// events the main thread's eventqueue holds: a key wake and a countdown tick
+#define EVENT_QUEUE_SIZE 4
 
-int row = 0;        // indicate which row of keypad to output to
-int timer_mode = 0; // indicates current timer mode
-char user_input [] = "000"; // stores user input to set timer
-char user_display [] = "m:ss"; // stores display format for user input
-int user_input_length = 0; // stores number of user inputs for timer
-bool prompted = false; // indicates whether prompt has be displayed yet
-unsigned int time_set = 0; // indicates time set (from user input) in seconds
-unsigned int time_passed = 0;  // indicates time passed (seconds) since timer started
+TimerUI ui; // keypad state machine and display text, see timerui.h
+uint8_t render = TIMER_RENDER_ALL; // display lines to redraw (TimerRender bits)
+unsigned int time_set = 0; // indicates time set (from user input) in ms, or left when paused
+unsigned int time_shown = 0;   // indicates seconds remaining shown on the display
 
-// create interrupts for each column wire on keypad
-InterruptIn col_A(PF_5, PullDown);
-InterruptIn col_B(PF_3, PullDown);
-InterruptIn col_C(PD_2, PullDown);
-InterruptIn col_D(PC_12, PullDown);
+// keypad rows (PC11-PC8, each with an LED) and columns, see keypad.h
+const PinName key_rows[KEYPAD_ROWS] = {PC_11, PC_10, PC_9, PC_8};
+const PinName key_cols[KEYPAD_COLS] = {PF_5, PF_3, PD_2, PC_12};
+const char key_map[KEYPAD_ROWS][KEYPAD_COLS + 1] = {"123A", "456B", "789C", "*0#D"};
+Keypad keypad(key_rows, key_cols, key_map);
+
+// countdowns run off the kernel clock, leaving the RTC alone
+TimerWheel timers;
+WheelTimer countdown;
+
+// key events from the keypad interrupts, handled by the main thread
+KeyFifo<KEY_QUEUE_SIZE> key_events;
+KeyEvent last_press = {0, true, 0}; // most recent press, to time its release
+uint32_t keys_dropped = 0;          // overflows already logged
+
+// the main thread sleeps in this queue until a key or the countdown wakes it
+EventQueue queue(EVENT_QUEUE_SIZE * EVENTS_EVENT_SIZE);
+volatile bool keys_posted = false; // service() is queued for the keys
+int tick_id = 0;                   // queued countdown_tick(), 0 if none
 
 // create LCD object (need to figure out SDA and SCL pins)
 CSE321_LCD display(16, 2, LCD_5x8DOTS, PB_9, PB_8);
 
+// key presses and timer changes are logged to a ring instead of printf;
+// a low priority thread sends them over the serial console for host/logdecode
+UnbufferedSerial console(USBTX, USBRX, 9600);
+BinLog logger;
+
 int main() {
-    // initialize the display
+    // initialize the display, which starts out showing "Timer initialized."
     display.begin();
-    display.print("Timer");             // output to display
-    display.setCursor(0, 1);            // go to next row on display
-    display.print("initialized.");      // output to display
-    display.setCursor(0, 0);            // reset cursor
-
-    // enable clock on port C
-    RCC->AHB2ENR |= 0x4;
-    // enable output for port D pins 8,9,10,11
-    GPIOC->MODER |= 0x550000;
-    GPIOC->MODER &= ~(0xAA0000);
-
-    // assign callback functions for each interrupt on button rise
-    col_A.rise(&isr_147x);
-    col_B.rise(&isr_2580);
-    col_C.rise(&isr_369y);
-    col_D.rise(&isr_ABCD);
-
-while (1) {
-    // Loop through keypad rows 0-3 (Polling loop)
-    row = row + 1;
-    row %= 4;
-    switch(row) {
-        case 0:
-            GPIOC->ODR&=~(0x700); // turn off all other pins
-            GPIOC->ODR|=  0x800;  // output to PC11            
-            break;
-        case 1:
-            GPIOC->ODR&=~(0xB00); // turn off all other pins
-            GPIOC->ODR|=  0x400;  // output to PC10
-            break;
-        case 2:
-            GPIOC->ODR&=~(0xD00); // turn off all other pins
-            GPIOC->ODR|=  0x200;  // output to PC9
-            break;
-        case 3:
-            GPIOC->ODR&=~(0xE00); // turn off all other pins
-            GPIOC->ODR |= 0x100;  // output to PC8
-            break;
+    update_display();
+
+    // start sending log entries
+    logger.start(&console);
+
+    // the keypad scans itself from its interrupts, reporting every key so
+    // a fast typist's overlapping presses all count
+    keypad.setRollover(true);
+    keypad.attach(&key_event);
+
+    // sleep until a key or the countdown needs the main thread, nothing
+    // runs in between
+    queue.dispatch_forever();
+  return 0; }
+
+// keypad event, interrupt context: queue it and wake the main thread
+void key_event(char key, bool pressed) {
+    key_events.push(key, pressed);
+    if (!keys_posted) {
+        keys_posted = true;
+        if (!queue.call(&service)) {
+            keys_posted = false;
+        }
     }
-    wait_us(400);  // delay poll to prevent incorrect key presses
-
-    // update LCD display
-    switch(timer_mode) {
-        // set timer mode
-        case 1:
-            if (!prompted) {
-                prompted = true;
-                // display prompt
-                display.clear();
-                display.print("Set timer:");    // display prompt
-                display.setCursor(0, 1);        // switch to row 2   
-                display.print("m:ss");          // display timer format
-                display.setCursor(0, 1);        // reset cursor
-            }
-            display.setCursor(0, 1);
-            display.print(user_display);
-            break;
+}
 
-        // started timer mode
-        case 2:
-            if (!prompted) {
-                prompted = true;
-                // display prompt
-                display.clear();
-                display.print("Time Remaining:");    // display prompt
-                display.setCursor(0, 1);        // switch to row 2   
-            }
-
-            // update display if a second has passed
-            if (time(NULL) > time_passed) {
-                time_passed = time(NULL);  // update time passed
-
-                // calculate time remaining (seconds)
-                unsigned int temp = time_set;
-                unsigned int time_set_minutes = temp / 100;
-                temp -= time_set_minutes * 100; 
-                unsigned int time_set_seconds = (time_set_minutes * 60) + (temp / 10) * 10 + (temp - (temp / 10)); // combine time into seconds
-                unsigned int time_remaining = time_set_seconds - time_passed;
-
-                // end timer if time remaining hits 0
-                if (time_remaining == 0) {
-                    end_timer();
-                }
-
-                // update user_display with time remaining
-                user_display[0] = '0' + time_remaining / 60;
-                time_remaining -= (time_remaining / 60 * 60);
-                user_display[2] = '0' + time_remaining / 10;
-                time_remaining -= (time_remaining / 10 * 10);
-                user_display[3] = '0' + time_remaining;
-                
-                // print user_display to display
-                display.setCursor(0, 1);
-                display.print(user_display);
-            }
-            break;
+// act on the keys pressed meanwhile and on a countdown that is up, redraw
+// what changed, then sleep until the countdown shows its next second
+void service(void) {
+    drain_keys();
+    timers.advance();
 
-        // end timer
-        case 4:
-            if (!prompted) {
-                prompted = true;
-                // display prompt
-                display.clear();
-                display.print("Times Up:");    // display prompt
-                display.setCursor(0, 1);        // switch to row 2   
-                display.print("0:00");          // display timer format
-                display.setCursor(0, 1);        // reset cursor
-            }
-            break;
+    // the countdown changes the display once a second
+    if (ui.state() == TIMER_RUNNING) {
+        unsigned int seconds = (timers.remaining(countdown) + 999) / 1000;
+        if (seconds != time_shown) {
+            time_shown = seconds;
+            render |= TIMER_RENDER_BOTTOM;
+        }
     }
+
+    // update LCD display, only if something changed
+    if (render) {
+        update_display();
+    }
+    schedule_tick();
 }
-  return 0; }
 
-void isr_147x(void) {
-    switch(row) {
-        case 0:
-            printf("found 1\n");
-            handle_keypress('1');
-            break;
-        case 1:
-            printf("found 4\n");
-            handle_keypress('4');
-            break;
-        case 2:
-            printf("found 7\n");
-            handle_keypress('7');
-            break;
-        case 3:
-            printf("found *\n");
-            handle_keypress('*');
-            break;
+void countdown_tick(void) {
+    tick_id = 0;
+    service();
+}
+
+// queue countdown_tick() for when the seconds shown change next, which is
+// also when the countdown runs out; nothing while no countdown runs
+void schedule_tick(void) {
+    if (tick_id) {
+        queue.cancel(tick_id);
+        tick_id = 0;
+    }
+    if (countdown.active()) {
+        uint32_t left = timers.remaining(countdown);
+        uint32_t wait = left ? (left - 1) % 1000 + 1 : 0;
+        tick_id = queue.call_in(std::chrono::milliseconds(wait), &countdown_tick);
     }
-    wait_us(WAIT_TIME_US);
 }
-void isr_2580(void) {
-    switch(row) {
-        case 0:
-            printf("found 2\n");
-            handle_keypress('2');
-            break;
-        case 1:
-            printf("found 5\n");
-            handle_keypress('5');
-            break;
-        case 2:
-            printf("found 8\n");
-            handle_keypress('8');
-            break;
-        case 3:
-            printf("found 0\n");
-            handle_keypress('0');
-            break;
+
+void drain_keys(void) {
+    // keys pushed from here on post service() again
+    keys_posted = false;
+
+    KeyEvent e;
+    while (key_events.pop(e)) {
+        if (e.pressed) {
+            logger.log<LOG_KEY_FOUND>(e.key);
+            handle_keypress(e.key);
+            last_press = e;
+        } else if (e.key == last_press.key) {
+            logger.log<LOG_KEY_RELEASED>(e.key, e.ms - last_press.ms);
+        }
+    }
+
+    // report events lost to a full queue
+    uint32_t dropped = key_events.overflows();
+    if (dropped != keys_dropped) {
+        keys_dropped = dropped;
+        logger.log<LOG_KEY_DROPPED>(dropped);
     }
-    wait_us(WAIT_TIME_US);
 }
-void isr_369y(void) {
-    switch(row) {
-        case 0:
-            printf("found 3\n");
-            handle_keypress('3');
-            break;
-        case 1:
-            printf("found 6\n");
-            handle_keypress('6');
-            break;
-        case 2:
-            printf("found 9\n");
-            handle_keypress('9');
-            break;
-        case 3:
-            printf("found #\n");
-            handle_keypress('#');
-            break;
+
+void update_display(void) {
+    // count the I2C traffic of this update
+    CSE321_LCD::BusStats before = display.getBusStats();
+
+    TextLine<LCD_FRAME_COLS> top, bottom;
+    ui.render(top, bottom, time_shown);
+    if (render & TIMER_RENDER_TOP) {
+        display.drawText(0, 0, top.c_str());
+    }
+    if (render & TIMER_RENDER_BOTTOM) {
+        display.drawText(0, 1, bottom.c_str());
     }
-    wait_us(WAIT_TIME_US);
+    render = 0;
+
+    // sends only the characters that differ from what the LCD shows
+    display.flush();
+    CSE321_LCD::BusStats after = display.getBusStats();
+    logger.log<LOG_LCD_TRAFFIC>(after.transactions - before.transactions, after.bytes - before.bytes);
+}
+
+void handle_keypress(char input){
+    run_step(ui.input(input));
 }
-void isr_ABCD(void) {
-    switch(row) {
-        case 0:
-            printf("found A\n");
-            handle_keypress('A');
+
+// countdown ran out, called by timers.advance() from service()
+void countdown_done(void) {
+    run_step(ui.expire());
+}
+
+void run_step(TimerUI::Step step) {
+    switch (step.action) {
+        case TIMER_NEW:
+            logger.log<LOG_TIMER_NEW>();
+            create_timer();
+            break;
+        case TIMER_START:
+            logger.log<LOG_TIMER_START>();
+            start_timer();
+            break;
+        case TIMER_RESUME:
+            logger.log<LOG_TIMER_START>();
+            resume_timer();
             break;
-        case 1:
-            printf("found B\n");
-            handle_keypress('B');
+        case TIMER_PAUSE:
+            logger.log<LOG_TIMER_PAUSE>();
+            pause_timer();
             break;
-        case 2:
-            printf("found C\n");
-            handle_keypress('C');
+        case TIMER_END:
+            end_timer();
             break;
-        case 3:
-            display.print("test");
-            // display.clear();
-            printf("found D\n");
-            handle_keypress('D');
+        default:
             break;
     }
-    wait_us(WAIT_TIME_US);
+    render |= step.render;
 }
 
 void create_timer(void) {
-    timer_mode = 1;     // set mode to create timer mode
-    prompted = false;   // main will display prompt
-    time_passed = 0;    // reset time passed for start timer mode
-
-    // reset user_input vars
-    user_display[0] = 'm';
-    user_display[2] = 's';
-    user_display[3] = 's';
-    user_input[0] = user_input[1] = user_input[2] = '0';
-    user_input_length = 0;
+    // drop a paused countdown
+    timers.stop(countdown);
+    time_set = 0;
 }
 
 void start_timer(void) {
-    timer_mode = 2;     // set mode to start timer mode
-    prompted = false;   // main will display prompt
+    // a new timer starts from the m:ss entered
+    time_set = ui.timeMs();
+    resume_timer();
+}
 
-    // initiate timer
-    set_time(time_passed);  // creates a reference point for time passed
-    time_set = strtoul(user_input,NULL,10); // convert user input to unsigned int
-    // printf("Time set = %u\n", time_set);
+void resume_timer(void) {
+    time_shown = (time_set + 999) / 1000;
+    timers.start(countdown, time_set, &countdown_done);
 }
 
 void pause_timer(void) {
-    timer_mode = 3; // set mode to pause timer mode
+    // keep the time left for resume timer
+    time_set = timers.remaining(countdown);
+    timers.stop(countdown);
 }
 
 void end_timer(void){
-    timer_mode = 4; // set mode to 4 to display "Times Up"
-    prompted = false;   // main will display message
+    time_set = 0;
 
     // turn on all LEDs
     // reset to initial configuration
 }
-
-void handle_keypress(char input){
-    switch(timer_mode){
-        // default mode
-        case 0:
-            // check key press
-            switch(input){
-                // input timer
-                case 'D':
-                    printf("setting new timer...\n");
-                    create_timer();
-                    break;
-            }
-            break;
-            
-        // set timer mode
-        case 1:
-            // check key press
-            switch(input){
-                // start timer
-                case 'A':
-                    printf("starting timer...\n");
-                    start_timer();
-                    break;
-                // input timer (resets user_input)
-                case 'D':
-                    printf("setting new timer...\n");
-                    create_timer();
-                    break;
-                // number inputs add to user_input var to set timer
-                default:
-                    if(isdigit(input) && user_input_length < 3) {
-                        // add input to user_input var but limit to 9:59
-                        user_input[user_input_length] = input;
-                        if (user_input_length == 1 && int(input) > int('5')) {
-                            user_input[user_input_length] = '5';
-                        }
-                        // increment user_input_length and update user_display
-                        switch (user_input_length) {
-                            case 0:
-                                user_display[0] = user_input[0];
-                                break;
-                            case 1:
-                                user_display[2] = user_input[1];
-                                break;
-                            case 2:
-                                user_display[3] = user_input[2];
-                                break;
-                        }
-                        user_input_length++;
-                    }
-            }
-            break;
-
-        // started timer mode (countdown mode)
-        case 2:
-            // check key press
-            switch(input){
-                // pause timer
-                case 'B':
-                    printf("pausing timer...\n");
-                    pause_timer();
-                    break;
-            }
-            break;
-
-        // paused timer mode 
-        case 3:
-            // check key press
-            switch(input){
-                // start timer
-                case 'A':
-                    printf("starting timer...\n");
-                    start_timer();
-                    break;
-                // input timer
-                case 'D':
-                    printf("setting new timer...\n");
-                    create_timer();
-                    break;
-            }
-            break;
-
-        // paused timer mode 
-        case 4:
-            // check key press
-            switch(input){
-                // input timer
-                case 'D':
-                    printf("setting new timer...\n");
-                    create_timer();
-                    break;
-            }
-            break;   
-    }
-}
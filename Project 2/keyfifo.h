@@ -0,0 +1,89 @@
+// Key event queue for the CSE321 timer
+//
+// Carries key presses and releases from the keypad interrupts to the main
+// loop, so the timer state is only ever changed by one thread. One producer
+// (the interrupts) and one consumer (the main loop), no locks.
+
+#ifndef KEYFIFO_H
+#define KEYFIFO_H
+
+#include "mbed.h"
+#include <atomic>
+
+/** One key going down or up. */
+struct KeyEvent {
+    char key;     // character from the keypad map
+    bool pressed; // true when the key went down
+    uint32_t ms;  // Kernel::Clock time of the change (ms, wraps)
+};
+
+/** Class for a single producer, single consumer ring of key events.
+ *
+ * push() only writes the head and pop() only writes the tail, each index
+ * published with release and read with acquire ordering, so an interrupt
+ * may push while a thread pops. When the ring is full new events are
+ * dropped and counted.
+ *
+ * Example:
+ * @code
+ * KeyFifo<16> keys;
+ *
+ * void isr(char key, bool pressed) { keys.push(key, pressed); }
+ *
+ * int main() {
+ *     KeyEvent e;
+ *     while (true) {
+ *         while (keys.pop(e)) { ... }
+ *         ...
+ *     }
+ * }
+ * @endcode
+ */
+template <unsigned N> class KeyFifo
+{
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "KeyFifo size must be a power of two");
+
+public:
+    KeyFifo() : _head(0), _tail(0), _overflows(0) {}
+
+    /** Queue an event stamped with the current time, producer only.
+     *
+     * @returns false if the ring was full and the event was dropped
+     */
+    bool push(char key, bool pressed) {
+        uint32_t head = _head.load(std::memory_order_relaxed);
+        if (head - _tail.load(std::memory_order_acquire) == N) {
+            _overflows.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+        KeyEvent &e = _events[head & (N - 1)];
+        e.key = key;
+        e.pressed = pressed;
+        e.ms = (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+        _head.store(head + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Take the oldest event, consumer only.
+     *
+     * @returns false if the ring was empty
+     */
+    bool pop(KeyEvent &e) {
+        uint32_t tail = _tail.load(std::memory_order_relaxed);
+        if (tail == _head.load(std::memory_order_acquire)) return false;
+        e = _events[tail & (N - 1)];
+        _tail.store(tail + 1, std::memory_order_release);
+        return true;
+    }
+
+    /** Events dropped because the ring was full. */
+    uint32_t overflows() const { return _overflows.load(std::memory_order_relaxed); }
+
+private:
+    KeyEvent _events[N];
+    std::atomic<uint32_t> _head; // next slot to fill, producer only
+    std::atomic<uint32_t> _tail; // next slot to take, consumer only
+    std::atomic<uint32_t> _overflows;
+};
+
+#endif
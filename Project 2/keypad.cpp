@@ -0,0 +1,89 @@
+// Keypad driver for the CSE321 timer, see keypad.h
+
+#include "keypad.h"
+
+Keypad::Keypad(const PinName rows[KEYPAD_ROWS], const PinName cols[KEYPAD_COLS],
+               const char keys[KEYPAD_ROWS][KEYPAD_COLS + 1])
+    : _rows{{rows[0], 1}, {rows[1], 1}, {rows[2], 1}, {rows[3], 1}},
+      _cols{{cols[0], PullDown}, {cols[1], PullDown}, {cols[2], PullDown}, {cols[3], PullDown}},
+      _keys(keys) {
+    _state = KEYPAD_IDLE;
+    _rollover = false;
+    _down = 0;
+    _last = 0;
+    for (int c = 0; c < KEYPAD_COLS; c++) {
+        _cols[c].rise(callback(this, &Keypad::edge));
+    }
+}
+
+void Keypad::attach(Callback<void(char, bool)> event) {
+    _event = event;
+}
+
+void Keypad::edge() {
+    // scanning toggles the rows, which raises columns too: only a press from
+    // idle counts
+    if (_state != KEYPAD_IDLE) return;
+    _state = KEYPAD_DEBOUNCE;
+    _timeout.attach(callback(this, &Keypad::tick), std::chrono::milliseconds(KEYPAD_DEBOUNCE_MS));
+}
+
+void Keypad::tick() {
+    uint16_t found = scan();
+    park();
+
+    // a key stays down while at most one scan misses it
+    uint16_t down = _down & (found | _last);
+    // a new key needs the debounce or two scans in a row
+    uint16_t added = found & ~_down;
+    if (_state == KEYPAD_HELD) added &= _last;
+    if (!_rollover) added = _down ? 0 : added & -added;
+    down |= added;
+    _last = found;
+    report(down);
+
+    // keep scanning while anything is down or still settling
+    if (down || (found && _state == KEYPAD_HELD)) {
+        _state = KEYPAD_HELD;
+        _timeout.attach(callback(this, &Keypad::tick), std::chrono::milliseconds(KEYPAD_POLL_MS));
+        return;
+    }
+    // everything released, or a glitch that was gone after the debounce
+    _last = 0;
+    _state = KEYPAD_IDLE;
+}
+
+void Keypad::report(uint16_t down) {
+    uint16_t changed = _down ^ down;
+    _down = down;
+    if (!changed || !_event) return;
+    // releases first, so a key taking over from another reads in order
+    for (int k = 0; k < KEYPAD_ROWS * KEYPAD_COLS; k++) {
+        if (changed & ~down & (1u << k)) _event(_keys[k / KEYPAD_COLS][k % KEYPAD_COLS], false);
+    }
+    for (int k = 0; k < KEYPAD_ROWS * KEYPAD_COLS; k++) {
+        if (changed & down & (1u << k)) _event(_keys[k / KEYPAD_COLS][k % KEYPAD_COLS], true);
+    }
+}
+
+uint16_t Keypad::scan() {
+    for (int r = 0; r < KEYPAD_ROWS; r++) {
+        _rows[r] = 0;
+    }
+    uint16_t found = 0;
+    for (int r = 0; r < KEYPAD_ROWS; r++) {
+        _rows[r] = 1;
+        wait_us(KEYPAD_SETTLE_US);
+        for (int c = 0; c < KEYPAD_COLS; c++) {
+            if (_cols[c].read()) found |= 1u << (r * KEYPAD_COLS + c);
+        }
+        _rows[r] = 0;
+    }
+    return found;
+}
+
+void Keypad::park() {
+    for (int r = 0; r < KEYPAD_ROWS; r++) {
+        _rows[r] = 1;
+    }
+}
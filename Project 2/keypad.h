@@ -0,0 +1,100 @@
+// Keypad driver for the CSE321 timer
+//
+// Scans the 4x4 matrix keypad only while a key is down. The rows idle high,
+// a rising column wakes the driver, and a low power timeout debounces and
+// scans the matrix once per tick. Nothing in interrupt context waits for
+// the keys.
+
+#ifndef KEYPAD_H
+#define KEYPAD_H
+
+#include "mbed.h"
+
+#define KEYPAD_ROWS 4
+#define KEYPAD_COLS 4
+
+// time a press must settle before the matrix is scanned (ms)
+#define KEYPAD_DEBOUNCE_MS 20
+
+// scan period while a key is down (ms)
+#define KEYPAD_POLL_MS 20
+
+// time a column needs to follow its row during a scan (us)
+#define KEYPAD_SETTLE_US 2
+
+static_assert(KEYPAD_ROWS * KEYPAD_COLS <= 16, "Keypad::down() holds 16 keys");
+
+/** Class for a matrix keypad with pull-down columns.
+ *
+ * A key counts as down once it survives the debounce (the first key) or two
+ * scans in a row (keys added while another is held), and as up once two
+ * scans in a row miss it. By default only one key is tracked and others are
+ * ignored until it is released; with rollover on every key is reported on
+ * its own, so a key pressed before the previous one is let go still counts.
+ * Without diodes in the matrix three keys on the corners of a rectangle
+ * also show the fourth.
+ *
+ * Example:
+ * @code
+ * const PinName rows[] = {PC_11, PC_10, PC_9, PC_8};
+ * const PinName cols[] = {PF_5, PF_3, PD_2, PC_12};
+ * const char keys[4][5] = {"123A", "456B", "789C", "*0#D"};
+ * Keypad keypad(rows, cols, keys);
+ *
+ * void key(char k, bool pressed) { ... }  // interrupt context
+ *
+ * int main() {
+ *     keypad.attach(key);
+ *     ...
+ * }
+ * @endcode
+ */
+class Keypad
+{
+public:
+    /** Construct the driver and park the rows high.
+     *
+     * @param rows  row pins, driven by the driver
+     * @param cols  column pins, read with pull-downs
+     * @param keys  character of the key at [row][col], must outlive the driver
+     */
+    Keypad(const PinName rows[KEYPAD_ROWS], const PinName cols[KEYPAD_COLS],
+           const char keys[KEYPAD_ROWS][KEYPAD_COLS + 1]);
+
+    /** Set the function called when a key goes down or up, in interrupt
+     *  context.
+     */
+    void attach(Callback<void(char, bool)> event);
+
+    /** Report every key down instead of only the first one. */
+    void setRollover(bool enable) { _rollover = enable; }
+
+    /** Keys currently down, bit row * KEYPAD_COLS + col. */
+    uint16_t down() const { return _down; }
+
+private:
+    enum State { KEYPAD_IDLE, KEYPAD_DEBOUNCE, KEYPAD_HELD };
+
+    /// rising column, interrupt context
+    void edge();
+    /// debounce and poll timeout, interrupt context
+    void tick();
+    /// drive one row at a time and return the keys found, see down()
+    uint16_t scan();
+    /// call the event function for each key that changed
+    void report(uint16_t down);
+    /// drive every row so any key raises its column
+    void park();
+
+    DigitalOut _rows[KEYPAD_ROWS];
+    InterruptIn _cols[KEYPAD_COLS];
+    const char (*_keys)[KEYPAD_COLS + 1];
+    LowPowerTimeout _timeout;
+    Callback<void(char, bool)> _event;
+    volatile State _state;
+    bool _rollover;
+    uint16_t _down; // keys reported down
+    uint16_t _last; // keys found by the previous scan
+};
+
+#endif
@@ -0,0 +1,202 @@
+// Keypad state machine for the CSE321 timer
+//
+// Maps each key in each state of the timer to an action and the next state
+// through one constexpr table, and says which display lines an input
+// changed. Pure logic: no mbed, no display, so it runs anywhere.
+
+#ifndef TIMERUI_H
+#define TIMERUI_H
+
+#include "format.h"
+#include <stdint.h>
+
+/** States of the timer, in the order of the old timer_mode values. */
+enum TimerState : uint8_t {
+    TIMER_IDLE,    // nothing set yet
+    TIMER_SET,     // entering m:ss
+    TIMER_RUNNING, // counting down
+    TIMER_PAUSED,  // countdown stopped, time left kept
+    TIMER_DONE,    // time is up
+    TIMER_STATES
+};
+
+/** Inputs the table tells apart. */
+enum TimerInput : uint8_t {
+    TIMER_KEY_DIGIT,
+    TIMER_KEY_A,     // start
+    TIMER_KEY_B,     // pause
+    TIMER_KEY_D,     // new timer
+    TIMER_KEY_OTHER, // C, * and #
+    TIMER_EXPIRED,   // the countdown ran out
+    TIMER_INPUTS
+};
+
+/** What the owner of the countdown has to do after an input. */
+enum TimerAction : uint8_t {
+    TIMER_NONE,
+    TIMER_NEW,    // forget the old timer, start entering m:ss
+    TIMER_DIGIT,  // a digit was entered (handled by TimerUI)
+    TIMER_START,  // start counting down from time()
+    TIMER_RESUME, // count down again from the time left
+    TIMER_PAUSE,  // stop counting down, keep the time left
+    TIMER_END     // show that time is up
+};
+
+/** Display lines an input changed. */
+enum TimerRender : uint8_t {
+    TIMER_RENDER_TOP = 1,
+    TIMER_RENDER_BOTTOM = 2,
+    TIMER_RENDER_ALL = 3
+};
+
+struct TimerTransition {
+    TimerAction action;
+    TimerState next;
+};
+
+/** The timer: [state][input] gives the action and the next state. */
+constexpr TimerTransition TIMER_TABLE[TIMER_STATES][TIMER_INPUTS] = {
+    //  digit                          A                              B                              D                          other                          expired
+    {{TIMER_NONE, TIMER_IDLE},     {TIMER_NONE, TIMER_IDLE},     {TIMER_NONE, TIMER_IDLE},     {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_IDLE},     {TIMER_NONE, TIMER_IDLE}},
+    {{TIMER_DIGIT, TIMER_SET},     {TIMER_START, TIMER_RUNNING}, {TIMER_NONE, TIMER_SET},      {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_SET},      {TIMER_NONE, TIMER_SET}},
+    {{TIMER_NONE, TIMER_RUNNING},  {TIMER_NONE, TIMER_RUNNING},  {TIMER_PAUSE, TIMER_PAUSED},  {TIMER_NONE, TIMER_RUNNING}, {TIMER_NONE, TIMER_RUNNING}, {TIMER_END, TIMER_DONE}},
+    {{TIMER_NONE, TIMER_PAUSED},   {TIMER_RESUME, TIMER_RUNNING}, {TIMER_NONE, TIMER_PAUSED},  {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_PAUSED},   {TIMER_NONE, TIMER_PAUSED}},
+    {{TIMER_NONE, TIMER_DONE},     {TIMER_NONE, TIMER_DONE},     {TIMER_NONE, TIMER_DONE},     {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_DONE},     {TIMER_NONE, TIMER_DONE}},
+};
+
+// every transition that leaves its state does something
+constexpr bool timerTableValid(int s = 0, int i = 0) {
+    return s == TIMER_STATES ? true
+         : i == TIMER_INPUTS ? timerTableValid(s + 1, 0)
+         : (TIMER_TABLE[s][i].next == s || TIMER_TABLE[s][i].action != TIMER_NONE) && timerTableValid(s, i + 1);
+}
+static_assert(timerTableValid(), "TIMER_TABLE changes state without an action");
+
+/** Class for the timer's keypad and display logic.
+ *
+ * input() runs a key through TIMER_TABLE, keeps the digits typed in
+ * TIMER_SET and returns the action for the caller to carry out, along with
+ * the display lines to redraw. render() formats those lines.
+ *
+ * Example:
+ * @code
+ * TimerUI ui;
+ *
+ * TimerUI::Step step = ui.input('D');     // TIMER_NEW, TIMER_RENDER_ALL
+ * ui.input('1'); ui.input('3'); ui.input('0');
+ * step = ui.input('A');                  // TIMER_START, ui.timeMs() is 90000
+ *
+ * TextLine<16> top, bottom;
+ * ui.render(top, bottom, 90);            // "Time Remaining:", "1:30"
+ * @endcode
+ */
+class TimerUI
+{
+public:
+    struct Step {
+        TimerAction action;
+        uint8_t render; // TimerRender bits
+    };
+
+    TimerUI() : _state(TIMER_IDLE), _length(0) {
+        _digits[0] = _digits[1] = _digits[2] = 0;
+    }
+
+    /** Which table column a key falls in. */
+    static TimerInput classify(char key) {
+        if (key >= '0' && key <= '9') return TIMER_KEY_DIGIT;
+        switch (key) {
+            case 'A': return TIMER_KEY_A;
+            case 'B': return TIMER_KEY_B;
+            case 'D': return TIMER_KEY_D;
+            default: return TIMER_KEY_OTHER;
+        }
+    }
+
+    /** Handle a key press. */
+    Step input(char key) { return apply(classify(key), key); }
+
+    /** Handle the countdown running out. */
+    Step expire() { return apply(TIMER_EXPIRED, 0); }
+
+    TimerState state() const { return _state; }
+
+    /** Time entered as m:ss (ms), digits not typed count as 0. */
+    uint32_t timeMs() const {
+        return (_digits[0] * 60 + _digits[1] * 10 + _digits[2]) * 1000u;
+    }
+
+    /** Format the display for the current state.
+     *
+     * @param secondsLeft  countdown shown while running or paused
+     */
+    template <unsigned W> void render(TextLine<W> &top, TextLine<W> &bottom, unsigned secondsLeft) const {
+        top.clear();
+        bottom.clear();
+        switch (_state) {
+            case TIMER_IDLE:
+                top.template text<0>("Timer");
+                bottom.template text<0>("initialized.");
+                break;
+            case TIMER_SET:
+                top.template text<0>("Set timer:");
+                bottom.template text<0>("m:ss");
+                if (_length > 0) bottom.template number<0, 1>(_digits[0]);
+                if (_length > 1) bottom.template number<2, 1>(_digits[1]);
+                if (_length > 2) bottom.template number<3, 1>(_digits[2]);
+                break;
+            case TIMER_RUNNING:
+            case TIMER_PAUSED:
+                top.template text<0>("Time Remaining:");
+                clock(bottom, secondsLeft);
+                break;
+            case TIMER_DONE:
+                top.template text<0>("Times Up:");
+                clock(bottom, 0);
+                break;
+            default:
+                break;
+        }
+    }
+
+private:
+    Step apply(TimerInput in, char key) {
+        const TimerTransition &t = TIMER_TABLE[_state][in];
+        Step step = {t.action, 0};
+        if (t.next != _state) step.render = TIMER_RENDER_ALL;
+
+        switch (t.action) {
+            case TIMER_NEW:
+                _length = 0;
+                _digits[0] = _digits[1] = _digits[2] = 0;
+                step.render = TIMER_RENDER_ALL;
+                break;
+            case TIMER_DIGIT:
+                // up to 9:59: three digits, tens of seconds at most 5
+                if (_length < 3) {
+                    int d = key - '0';
+                    if (_length == 1 && d > 5) d = 5;
+                    _digits[_length++] = d;
+                    step.render |= TIMER_RENDER_BOTTOM;
+                }
+                break;
+            default:
+                break;
+        }
+        _state = t.next;
+        return step;
+    }
+
+    template <unsigned W> static void clock(TextLine<W> &line, unsigned seconds) {
+        line.template number<0, 1>(seconds / 60);
+        line.template text<1>(":");
+        line.template number<2, 1>(seconds % 60 / 10);
+        line.template number<3, 1>(seconds % 10);
+    }
+
+    TimerState _state;
+    uint8_t _digits[3]; // m, s, s as typed
+    uint8_t _length;    // digits typed
+};
+
+#endif
@@ -0,0 +1,86 @@
+// Timer wheel for the CSE321 timer, see timerwheel.h
+
+#include "timerwheel.h"
+
+static_assert((TIMERWHEEL_SLOTS & (TIMERWHEEL_SLOTS - 1)) == 0, "TIMERWHEEL_SLOTS must be a power of two");
+
+TimerWheel::TimerWheel() {
+    for (int i = 0; i < TIMERWHEEL_SLOTS; i++) {
+        _slots[i] = nullptr;
+    }
+    _tick = now();
+    _count = 0;
+}
+
+uint32_t TimerWheel::now() {
+    return (uint32_t)(Kernel::Clock::now().time_since_epoch().count() / TIMERWHEEL_TICK_MS);
+}
+
+void TimerWheel::link(WheelTimer **head, WheelTimer &t) {
+    t._next = *head;
+    if (t._next) t._next->_link = &t._next;
+    t._link = head;
+    *head = &t;
+}
+
+void TimerWheel::unlink(WheelTimer &t) {
+    *t._link = t._next;
+    if (t._next) t._next->_link = t._link;
+    t._next = nullptr;
+    t._link = nullptr;
+}
+
+void TimerWheel::start(WheelTimer &t, uint32_t ms, Callback<void()> fn) {
+    stop(t);
+    // round up, and never into the tick already handled
+    uint32_t ticks = (ms + TIMERWHEEL_TICK_MS - 1) / TIMERWHEEL_TICK_MS;
+    t._expires = now() + (ticks ? ticks : 1);
+    if ((int32_t)(t._expires - _tick) <= 0) t._expires = _tick + 1;
+    t._fn = fn;
+    link(&_slots[t._expires & (TIMERWHEEL_SLOTS - 1)], t);
+    _count++;
+}
+
+void TimerWheel::stop(WheelTimer &t) {
+    if (!t.active()) return;
+    unlink(t);
+    _count--;
+}
+
+uint32_t TimerWheel::remaining(const WheelTimer &t) const {
+    if (!t.active()) return 0;
+    int32_t ticks = (int32_t)(t._expires - now());
+    return ticks > 0 ? ticks * TIMERWHEEL_TICK_MS : 0;
+}
+
+void TimerWheel::advance() {
+    uint32_t target = now();
+    uint32_t ticks = target - _tick;
+    if (!ticks) return;
+    // after a whole turn every slot has been visited once
+    if (ticks > TIMERWHEEL_SLOTS) ticks = TIMERWHEEL_SLOTS;
+
+    // move what is due to a list of its own first, so the functions may
+    // start and stop timers, including each other, while it is walked
+    WheelTimer *due = nullptr;
+    for (uint32_t i = 1; i <= ticks; i++) {
+        WheelTimer **p = &_slots[(_tick + i) & (TIMERWHEEL_SLOTS - 1)];
+        while (*p) {
+            WheelTimer &t = **p;
+            if ((int32_t)(t._expires - target) <= 0) {
+                unlink(t);
+                link(&due, t);
+            } else {
+                p = &t._next;
+            }
+        }
+    }
+    _tick = target;
+
+    while (due) {
+        WheelTimer &t = *due;
+        unlink(t);
+        _count--;
+        t._fn();
+    }
+}
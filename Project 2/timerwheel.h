@@ -0,0 +1,98 @@
+// Timer wheel for the CSE321 timer
+//
+// Runs any number of countdowns off the monotonic Kernel::Clock, so the RTC
+// keeps wall time. Starting, stopping and expiring a countdown are O(1);
+// resolution is one wheel tick.
+
+#ifndef TIMERWHEEL_H
+#define TIMERWHEEL_H
+
+#include "mbed.h"
+
+// time one slot of the wheel covers (ms)
+#define TIMERWHEEL_TICK_MS 10
+
+// slots in the wheel, a power of two; one turn is TICK_MS * SLOTS
+#define TIMERWHEEL_SLOTS 256
+
+class TimerWheel;
+
+/** One countdown, owned by the caller and run by a TimerWheel. */
+class WheelTimer
+{
+public:
+    WheelTimer() : _next(nullptr), _link(nullptr), _expires(0) {}
+
+    /** True from start() until it expires or is stopped. */
+    bool active() const { return _link != nullptr; }
+
+private:
+    friend class TimerWheel;
+
+    WheelTimer *_next;
+    WheelTimer **_link; // pointer that points at this timer, null if idle
+    uint32_t _expires;  // wheel tick it expires on
+    Callback<void()> _fn;
+};
+
+/** Class for a hashed timer wheel.
+ *
+ * Each countdown sits in the slot of the tick it expires on, a list linked
+ * through the timers themselves; a countdown longer than one turn of the
+ * wheel simply stays in its slot for the turns in between. advance() visits
+ * the slots of the ticks that passed and calls the function of every timer
+ * that is due, in the calling thread. Not interrupt safe: start, stop and
+ * advance from the same thread.
+ *
+ * Example:
+ * @code
+ * TimerWheel timers;
+ * WheelTimer alarm;
+ *
+ * void ring() { ... }
+ *
+ * int main() {
+ *     timers.start(alarm, 90000, ring);  // 1:30
+ *     while (true) {
+ *         timers.advance();
+ *         ThisThread::sleep_for(20ms);
+ *     }
+ * }
+ * @endcode
+ */
+class TimerWheel
+{
+public:
+    TimerWheel();
+
+    /** Start (or restart) a countdown.
+     *
+     * @param t   the countdown
+     * @param ms  time until fn is called, rounded up to a tick
+     * @param fn  called from advance() once the time is up
+     */
+    void start(WheelTimer &t, uint32_t ms, Callback<void()> fn);
+
+    /** Stop a countdown without calling it, if it is running. */
+    void stop(WheelTimer &t);
+
+    /** Time left on a countdown (ms), 0 if it is not running. */
+    uint32_t remaining(const WheelTimer &t) const;
+
+    /** Call every countdown that is due. */
+    void advance();
+
+    /** Countdowns running. */
+    unsigned count() const { return _count; }
+
+private:
+    static uint32_t now();
+    static void link(WheelTimer **head, WheelTimer &t);
+    static void unlink(WheelTimer &t);
+
+    WheelTimer *_slots[TIMERWHEEL_SLOTS];
+    uint32_t _tick; // last tick advance() handled
+    unsigned _count;
+};
+
+#endif
@@ -1,5 +1,6 @@
 #include "1802.h"
 #include "mbed.h"
+#include "metrics.h"
 
 // modified from https://os.mbed.com/users/Yar/code/CSE321_LCD_for_Nucleo/
 // modified from:
@@ -14,6 +15,23 @@ CSE321_LCD::CSE321_LCD(unsigned char lcd_cols, unsigned char lcd_rows,
   _rows = lcd_rows;
   _charsize = charsize;
   _backlightval = LCD_BACKLIGHT;
+  resetBusStats();
+
+  // contents are unknown until begin() clears the display
+  memset(_shown, 0, sizeof(_shown));
+  clearFrame();
+  _cursorCol = 0;
+  _cursorRow = 0;
+
+#if DEVICE_I2C_ASYNCH
+  _async = nullptr;
+  _sending = false;
+  _resync = false;
+  _retry = false;
+  _lastEvent = 0;
+  _head = 0;
+  _tail = 0;
+#endif
 }
 
 void CSE321_LCD::begin() {
@@ -21,20 +39,25 @@ void CSE321_LCD::begin() {
   // Initialize displayfunction parameter for setting up LCD display
   _displayfunction |= LCD_2LINE;
   _displayfunction |= LCD_5x10DOTS;
+  _displaycontrol |= LCD_DISPLAYON;
 
   // Wait for more than 30 ms after power rises above 4.5V per the data sheet
   thread_sleep_for(50);
 
-  // Send first function set command. Wait longer that 39 us per the data
-  // sheet
-  sendCommand(LCD_FUNCTIONSET | _displayfunction);
-  thread_sleep_for(45);
-
-  // turn the display on
-  displayON();
-
-  // clear the display
-  clear();
+  // Send function set, display on and clear as a single transaction. Every
+  // command byte takes 9 clocks on the bus (90 us at 100 kHz), which already
+  // covers the 39 us the data sheet asks for between commands.
+  char init[6];
+  init[0] = LCD_CTRL_COMMAND;
+  init[1] = LCD_FUNCTIONSET | _displayfunction;
+  init[2] = LCD_CTRL_COMMAND;
+  init[3] = LCD_DISPLAYCONTROL | _displaycontrol;
+  init[4] = LCD_CTRL_LAST_COMMAND;
+  init[5] = LCD_CLEARDISPLAY;
+  busWrite(_addr, init, 6, LCD_CLEAR_US);
+  memset(_shown, ' ', sizeof(_shown));
+  _cursorCol = 0;
+  _cursorRow = 0;
 
   // Initialize backlight
   setReg(0, 0);
@@ -45,13 +68,16 @@ void CSE321_LCD::begin() {
 }
 
 void CSE321_LCD::clear() {
-  sendCommand(LCD_CLEARDISPLAY);
-  wait_us(2000);
+  char data[2] = {LCD_CTRL_COMMAND, LCD_CLEARDISPLAY};
+  busWrite(_addr, data, 2, LCD_CLEAR_US);
+  memset(_shown, ' ', sizeof(_shown));
+  _cursorCol = 0;
+  _cursorRow = 0;
 }
 
 void CSE321_LCD::sendCommand(char value) {
-  char data[2] = {0x80, value};
-  i2c.write(_addr, data, 2);
+  char data[2] = {LCD_CTRL_COMMAND, value};
+  busWrite(_addr, data, 2);
 }
 
 // set color thing for seeed
@@ -71,11 +97,13 @@ void CSE321_LCD::setReg(char addr, char val) {
   char data[2];
   data[0] = addr;
   data[1] = val;
-  i2c.write(RGB_ADDRESS, data, 2);
+  busWrite(RGB_ADDRESS, data, 2);
 }
 
 void CSE321_LCD::setCursor(unsigned char col, unsigned char row) {
 //change the cordinate of where the next charecter will be put
+  _cursorCol = col;
+  _cursorRow = row;
   if (row == 0) {
     col = col | 0x80;
   } else {
@@ -83,18 +111,247 @@ void CSE321_LCD::setCursor(unsigned char col, unsigned char row) {
   }
 
   char data[2];
-  data[0] = 0x80;
+  data[0] = LCD_CTRL_COMMAND;
   data[1] = col;
-  i2c.write(_addr, data, 2);
+  busWrite(_addr, data, 2);
 }
 
 int CSE321_LCD::print(const char *text) { //output a string to the LCD
-  char data[2];
-  data[0] = 0x40;
-  while (*text) {
-    data[1] = *text;
-    i2c.write(_addr, data, 2);
-    text++;
+  return write(text, strlen(text));
+}
+
+int CSE321_LCD::write(const char *text, int length) {
+  // one control byte, then the whole run as display data
+  char data[LCD_MAX_RUN + 1];
+  data[0] = LCD_CTRL_DATA;
+  while (length > 0) {
+    int run = length < LCD_MAX_RUN ? length : LCD_MAX_RUN;
+    memcpy(data + 1, text, run);
+    int err = busWrite(_addr, data, run + 1);
+    if (err) {
+      return err;
+    }
+    track(text, run);
+    text += run;
+    length -= run;
+  }
+  return 0;
+}
+
+void CSE321_LCD::clearFrame() { memset(_frame, ' ', sizeof(_frame)); }
+
+void CSE321_LCD::drawText(unsigned char col, unsigned char row,
+                          const char *text) {
+  if (row >= LCD_FRAME_ROWS) {
+    return;
+  }
+  while (*text && col < LCD_FRAME_COLS) {
+    _frame[row][col++] = *text++;
+  }
+}
+
+int CSE321_LCD::flush() {
+#if DEVICE_I2C_ASYNCH
+  if (_resync) {
+    // a queued write failed, redraw everything
+    _resync = false;
+    memset(_shown, 0, sizeof(_shown));
+  }
+#endif
+
+  unsigned char rows = _rows < LCD_FRAME_ROWS ? _rows : LCD_FRAME_ROWS;
+  unsigned char cols = _cols < LCD_FRAME_COLS ? _cols : LCD_FRAME_COLS;
+
+  for (unsigned char row = 0; row < rows; row++) {
+    const char *want = _frame[row];
+    const char *have = _shown[row];
+    unsigned char col = 0;
+    while (col < cols) {
+      if (want[col] == have[col]) {
+        col++;
+        continue;
+      }
+
+      // extend the run over short stretches of unchanged characters, which
+      // are cheaper to resend than a new START/address/cursor sequence
+      unsigned char last = col;
+      for (unsigned char i = col + 1; i < cols && i - last <= LCD_FLUSH_GAP;
+           i++) {
+        if (want[i] != have[i]) {
+          last = i;
+        }
+      }
+
+      int err = writeAt(col, row, want + col, last - col + 1);
+      if (err) {
+        return err;
+      }
+      col = last + 1;
+    }
   }
   return 0;
 }
+
+int CSE321_LCD::writeAt(unsigned char col, unsigned char row, const char *text,
+                        int length) {
+  // cursor command and display data share one transaction
+  char data[LCD_FRAME_COLS + 3];
+  data[0] = LCD_CTRL_COMMAND;
+  data[1] = (row == 0 ? 0x80 : 0xc0) | col;
+  data[2] = LCD_CTRL_DATA;
+  memcpy(data + 3, text, length);
+  int err = busWrite(_addr, data, length + 3);
+  if (err) {
+    return err;
+  }
+  _cursorCol = col;
+  _cursorRow = row;
+  track(text, length);
+  return 0;
+}
+
+void CSE321_LCD::track(const char *text, int length) {
+  for (int i = 0; i < length; i++, _cursorCol++) {
+    if (_cursorRow < LCD_FRAME_ROWS && _cursorCol < LCD_FRAME_COLS) {
+      _shown[_cursorRow][_cursorCol] = text[i];
+    }
+  }
+}
+
+int CSE321_LCD::busWrite(int addr, const char *data, int length,
+                         int holdUs) {
+#if DEVICE_I2C_ASYNCH
+  if (_async) {
+    unsigned int next = (_head + 1) % LCD_QUEUE_SIZE;
+    if (next == _tail) {
+      // the ring is busy, so sendNext() sees this once it drains
+      _stats.dropped++;
+      _retry = true;
+      return -1;
+    }
+    Transfer &t = _queue[_head];
+    t.addr = addr;
+    t.length = length;
+    t.holdUs = holdUs;
+    memcpy(t.data, data, length);
+    _stats.transactions++;
+    _stats.bytes += length;
+
+    core_util_critical_section_enter();
+    _head = next;
+    bool idle = !_sending;
+    _sending = true;
+    core_util_critical_section_exit();
+    if (idle) {
+      sendNext();
+    }
+    return 0;
+  }
+#endif
+
+  int err = i2c.write(addr, data, length);
+  _stats.transactions++;
+  _stats.bytes += length;
+  if (err) {
+    _stats.errors++;
+  }
+  if (holdUs) {
+    // sleep through the command's execution time instead of spinning
+    thread_sleep_for((holdUs + 999) / 1000);
+  }
+  return err;
+}
+
+void CSE321_LCD::resetBusStats() {
+  _stats.transactions = 0;
+  _stats.bytes = 0;
+  _stats.errors = 0;
+  _stats.dropped = 0;
+}
+
+#if DEVICE_I2C_ASYNCH
+void CSE321_LCD::setAsync(EventQueue *queue, Callback<void(int)> done) {
+  if (!queue) {
+    // let the ring drain before writes block again
+    while (_sending) {
+      thread_sleep_for(1);
+    }
+  }
+  _done = done;
+  _async = queue;
+}
+
+void CSE321_LCD::sendNext() {
+  for (;;) {
+    core_util_critical_section_enter();
+    bool empty = _tail == _head;
+    if (empty) {
+      _sending = false;
+    }
+    core_util_critical_section_exit();
+    if (empty) {
+      break;
+    }
+
+    Transfer &t = _queue[_tail];
+    if (i2c.transfer(t.addr, t.data, t.length, nullptr, 0,
+                     callback(this, &CSE321_LCD::transferDone),
+                     I2C_EVENT_ALL) == 0) {
+      return;
+    }
+    // peripheral refused the transfer, drop it and move on
+    _stats.errors++;
+    _resync = true;
+    _retry = true;
+    _tail = (_tail + 1) % LCD_QUEUE_SIZE;
+  }
+  if (_retry &&
+      QueueMetrics::call_in(_async, std::chrono::milliseconds(LCD_RETRY_MS),
+                            callback(this, &CSE321_LCD::retry))) {
+    // left set if the queue is full, the next drain tries again
+    _retry = false;
+  }
+  if (_done) {
+    _done(_lastEvent);
+  }
+}
+
+void CSE321_LCD::transferDone(int event) {
+  _lastEvent = event;
+  if (!(event & I2C_EVENT_TRANSFER_COMPLETE)) {
+    _stats.errors++;
+    _resync = true;
+    _retry = true;
+  }
+  int holdUs = _queue[_tail].holdUs;
+  _tail = (_tail + 1) % LCD_QUEUE_SIZE;
+
+  // I2C::transfer() takes a mutex, so the next one starts on the queue thread
+  int id;
+  if (holdUs) {
+    id = QueueMetrics::call_in(
+        _async, std::chrono::milliseconds((holdUs + 999) / 1000),
+        callback(this, &CSE321_LCD::sendNext));
+  } else {
+    id = QueueMetrics::call(_async, callback(this, &CSE321_LCD::sendNext));
+  }
+  if (!id) {
+    // queue full, keep _sending so writes stay queued and try again later
+    _repost.attach(callback(this, &CSE321_LCD::repost),
+                   std::chrono::milliseconds(LCD_RETRY_MS));
+  }
+}
+
+void CSE321_LCD::repost() {
+  if (!QueueMetrics::call(_async, callback(this, &CSE321_LCD::sendNext))) {
+    _repost.attach(callback(this, &CSE321_LCD::repost),
+                   std::chrono::milliseconds(LCD_RETRY_MS));
+  }
+}
+
+void CSE321_LCD::retry() {
+  if (_async) {
+    flush();
+  }
+}
+#endif
@@ -62,6 +62,31 @@
 #define LCD1602 0x00
 #define LCD1802 0x02
 
+// I2C control bytes (Co = continuation, RS = register select)
+#define LCD_CTRL_COMMAND 0x80      // Co=1, RS=0: one command byte follows
+#define LCD_CTRL_LAST_COMMAND 0x00 // Co=0, RS=0: only command bytes follow
+#define LCD_CTRL_DATA 0x40         // Co=0, RS=1: only data bytes follow
+
+// longest run of characters sent in a single I2C transaction (one DDRAM line)
+#define LCD_MAX_RUN 40
+
+// size of the shadow framebuffer behind drawText() and flush()
+#define LCD_FRAME_COLS 16
+#define LCD_FRAME_ROWS 2
+
+// unchanged characters flush() resends rather than starting a new transaction
+#define LCD_FLUSH_GAP 3
+
+// transactions the asynchronous mode holds before further writes are dropped
+#define LCD_QUEUE_SIZE 8
+
+// time the controller needs to execute a clear display command
+#define LCD_CLEAR_US 2000
+
+// how long after a dropped or failed asynchronous write flush() runs again,
+// and how often a completion that found the event queue full tries again (ms)
+#define LCD_RETRY_MS 100
+
 /**
  * This is the driver for the Liquid Crystal LCD displays that use the I2C bus.
  *
@@ -101,6 +126,67 @@ public:
   void setCursor(unsigned char, unsigned char);
   int print(const char *text);
 
+  /**
+   * Write length characters starting at the cursor. Each run of up to
+   * LCD_MAX_RUN characters goes out as one I2C transaction.
+   *
+   * @returns 0 on success, otherwise the I2C error of the failed transaction
+   */
+  int write(const char *text, int length);
+
+  /**
+   * Framebuffer drawing. drawText() and clearFrame() only change the shadow
+   * framebuffer; flush() then sends the characters that differ from what the
+   * display currently shows, one transaction per changed run, so redrawing an
+   * identical frame costs no bus traffic at all.
+   */
+  void clearFrame();
+  void drawText(unsigned char col, unsigned char row, const char *text);
+
+  /**
+   * Bring the display in line with the framebuffer.
+   *
+   * @returns 0 on success, otherwise the I2C error of the failed transaction
+   */
+  int flush();
+
+  /** I2C traffic generated by this driver */
+  struct BusStats {
+    unsigned int transactions; // START/address/STOP rounds
+    unsigned int bytes;        // payload bytes, excluding the address byte
+    unsigned int errors;       // transactions that were not acknowledged
+    unsigned int dropped;      // asynchronous writes refused, queue full
+  };
+
+  /** Traffic since construction or the last resetBusStats(). */
+  const BusStats &getBusStats() const { return _stats; }
+  void resetBusStats();
+
+#if DEVICE_I2C_ASYNCH
+  /**
+   * Switch between blocking and asynchronous mode. In asynchronous mode every
+   * transaction is copied into a ring of LCD_QUEUE_SIZE entries and handed to
+   * I2C::transfer(), so callers never wait on the bus. Each completion
+   * interrupt posts the next transfer to queue, which only costs that thread
+   * the few microseconds needed to start it. A transaction that finds the
+   * ring full is dropped and counted in BusStats::dropped; flush() leaves the
+   * affected characters pending. Once the ring drains after a dropped or
+   * failed transaction, flush() is posted to queue LCD_RETRY_MS later, so the
+   * display catches up without the caller drawing again.
+   *
+   * Going back to blocking mode waits for the ring to drain, which needs
+   * queue to run: never call setAsync(nullptr) from queue's own thread.
+   *
+   * @param queue  event queue that starts transfers, nullptr to drain the
+   *               ring and go back to blocking writes
+   * @param done   called on queue whenever the ring drains, with the I2C
+   *               event of the last transfer
+   */
+  void setAsync(EventQueue *queue, Callback<void(int)> done = nullptr);
+
+  /** True while queued transactions are still being sent. */
+  bool busy() const { return _sending; }
+#endif
 
   /** Set RGB color of backlight
    *   @param r Value for the red component of the RGB backlight (Between 0 and
@@ -118,6 +204,17 @@ public:
   void setReg(char addr, char val);
 
 private:
+  // every transaction goes through here so it is counted in _stats. The
+  // controller is left alone for holdUs afterwards.
+  int busWrite(int addr, const char *data, int length, int holdUs = 0);
+
+  // record characters written at the cursor in _shown and advance it
+  void track(const char *text, int length);
+
+  // set the cursor and write a run of characters in one transaction
+  int writeAt(unsigned char col, unsigned char row, const char *text,
+              int length);
+
   unsigned char _addr;
   unsigned char _displayfunction;
   unsigned char _displaycontrol;
@@ -126,7 +223,44 @@ private:
   unsigned char _rows;
   unsigned char _charsize;
   unsigned char _backlightval;
+  BusStats _stats;
+
+  // what the next flush() should show, and what the display shows now
+  char _frame[LCD_FRAME_ROWS][LCD_FRAME_COLS];
+  char _shown[LCD_FRAME_ROWS][LCD_FRAME_COLS];
+  unsigned char _cursorCol;
+  unsigned char _cursorRow;
 
   // MBED I2C object used to transfer data to LCD
   I2C i2c;
+
+#if DEVICE_I2C_ASYNCH
+  // one queued transaction
+  struct Transfer {
+    int addr;
+    int length;
+    int holdUs;
+    char data[LCD_MAX_RUN + 1];
+  };
+
+  // start the transfer at _tail, or go idle once the ring is empty
+  void sendNext();
+  // I2C::transfer() completion, interrupt context
+  void transferDone(int event);
+  // post sendNext() again after the queue was found full, interrupt context
+  void repost();
+  // flush() again after writes were dropped or failed
+  void retry();
+
+  EventQueue *_async;
+  volatile bool _sending;
+  volatile bool _resync; // a queued write failed, _shown can not be trusted
+  volatile bool _retry;  // writes were dropped or failed, flush() once drained
+  int _lastEvent;
+  Transfer _queue[LCD_QUEUE_SIZE];
+  volatile unsigned int _head; // written by the caller
+  volatile unsigned int _tail; // written by the completion interrupt
+  Callback<void(int)> _done;
+  Timeout _repost;
+#endif
 };
@@ -4,17 +4,20 @@
  * person#: 50280143
  * 
  * Description: 
- *      A temperature and humidity alarm system that uses a DHT11 sensor with an LCD display  
+ *      A temperature and humidity alarm system that uses a DHT11 or DHT22 sensor with an LCD display  
  *      and a vibrating motor as the alarm. When the temperature or humidity near the sensor 
  *      exceeds the chosen thresholds, the alarm activates until the temperature or humidity
  *      falls back below the chosen thresholds. Alarm code will loop until shutdown by user.  
  *
  * Modules: 
- *      1802.cpp, 1802.h, mbed.h, DHT.h, DHT.cpp
+ *      1802.cpp, 1802.h, mbed.h, DHT.h, DHT.cpp, alarm.h, alarm.cpp, binlog.h, binlog.cpp, binlog_formats.h,
+ *      format.h, history.h, metrics.h, metrics.cpp, registry.h, registry.cpp, samplelog.h, samplelog.cpp, samplecodec.h,
+ *      crc32.h, serialtx.h, serialtx.cpp, console.h, console.cpp, telemetry.h, telemetry.cpp, telemetry_format.h,
+ *      cobs.h, snapshot.h, FlashIAPBlockDevice.h
  *
  * Assignment: Project 3
  *
- * Inputs: DHT11 sensor
+ * Inputs: DHT11 or DHT22 (AM2302) sensor, picked with DHT_MODEL
  *
  * Outputs: LCD display, vibration motor
  *
@@ -44,30 +47,130 @@
 
 #include "mbed.h"
 #include "1802.h"
+#include "alarm.h"
+#include "binlog.h"
+#include "console.h"
 #include "DHT.h"
+#include "FlashIAPBlockDevice.h"
+#include "format.h"
+#include "history.h"
+#include "metrics.h"
+#include "registry.h"
+#include "samplelog.h"
+#include "serialtx.h"
+#include "snapshot.h"
+#include "telemetry.h"
 #include <stdio.h>
 
-// maximum values that when exceeded will trigger alarm (vibration motor)
+// maximum values that when exceeded will trigger alarm (vibration motor),
+// the starting thresholds of the alarm rules
 #define MAX_TEMP 72
 #define MAX_HUMIDITY 60
 
-// wait constant (1 sec = 1,000,000 us)
-#define WAIT_TIME_US 1000000  
+// alarm hysteresis: the alarm turns off again this far below the threshold
+#define TEMP_BAND 10            // tenths of a degree Celsius
+#define HUMIDITY_BAND 2         // percent
+
+// shortest time the motor stays on or off (s), stops it chattering
+#define ALARM_DWELL_S 10
+
+// temperature rise that triggers the alarm on its own (tenths of a degree Celsius per minute)
+#define MAX_TEMP_RATE 30
+
+// how often the eventqueue lag is measured (ms)
+#define QUEUE_PROBE_MS 1000
+
+// flash kept for the sample log: the last 128 KB, in bank 2, so the code
+// running from bank 1 is not stalled while the log erases a page
+#define SAMPLE_LOG_ADDR 0x081E0000
+#define SAMPLE_LOG_SIZE (128 * 1024)
+
+// a reading that holds still is still logged this often (s)
+#define SAMPLE_LOG_IDLE_S 300
+
+// a slot that is not full yet is written at least this often (s), so a reset loses at most this much;
+// a steady reading then takes 24 slots a day, three weeks of the log
+#define SAMPLE_LOG_SYNC_S 3600
+
+// power-aware build: leave out what keeps the MCU awake between samples, the
+// console receiver (a UART with a receive interrupt blocks deep sleep) and
+// the eventqueue lag probe. Set to 1 here or with -DPOWER_AWARE=1.
+#ifndef POWER_AWARE
+#define POWER_AWARE 0
+#endif
+
+// telemetry build: the console carries binary packets for a collector
+// (telemetry.h) instead of text, with every sample, the alarm changes and the
+// metrics; host/telemetry reads them. Set to 1 here or with -DTELEMETRY=1.
+#ifndef TELEMETRY
+#define TELEMETRY 0
+#endif
+
+// console speed in the telemetry build
+#define TELEMETRY_BAUD 115200
+
+// how often the telemetry build sends the metrics (ms)
+#define TELEMETRY_METRICS_MS 60000
+
+// sensor model: DHT11, or DHT22 (the same as AM2302) for tenths of a degree
+// and of a percent. Set here or with -DDHT_MODEL=DHT22.
+#ifndef DHT_MODEL
+#define DHT_MODEL DHT11
+#endif
+
+// samples the history command lists when not told how many
+#define HISTORY_ROWS 10
 
 // declare callback functions
 void isr_temp(void);
 
 // declare event functions
-void updateSensor();
+void sensorReady(int index, int status);
+void publishSample();
 void updateDisplay();
 void checkAlarm();
 void changeUnit();
+void probeQueue();
+void sendMetrics();
+
+// declare console commands and the lines of their longer replies
+void alarmsCommand(int argc, char **argv);
+void setCommand(int argc, char **argv);
+void unitCommand(int argc, char **argv);
+void historyCommand(int argc, char **argv);
+void metricsCommand(int argc, char **argv);
+void resetCommand(int argc, char **argv);
+bool alarmsLine(int i);
+bool historyLine(int i);
+bool metricsLine(int i);
+
+// consumers of new samples, called in this order on the eventqueue whenever
+// a reading differs from the last one published
+void (*const subscribers[])() = {updateDisplay};
+
+// one reading from the sensor, published as a whole
+struct Reading {
+    int tempF;                  // temp from sensor in tenths of a degree Fahrenheit
+    int tempC;                  // temp from sensor in tenths of a degree Celsius
+    int humidity;               // humidity from sensor (%)
+};
 
 // declare critical variables;
 int tempUnit = 0;               // controls current unit of measurement (0=F, 1=C)
-double tempF;                   // temp from sensor in Fahrenheit
-double tempC;                   // temp from sensor in Celsius
-int humidity;                   // humidity from sensor (%)
+Snapshot<Reading> reading;      // latest reading, safe to read from any thread or interrupt
+
+// recent samples and running averages (64 samples covers the 1 minute window)
+SensorHistory<64> history;
+
+// alarm rules, thresholds can be changed while running
+AlarmEngine alarmRules;
+uint32_t alarmStates = 0;       // rules on after the last checkAlarm(), one bit each
+
+// samples and alarm changes kept in flash across resets
+FlashIAPBlockDevice flash(SAMPLE_LOG_ADDR, SAMPLE_LOG_SIZE);
+SampleLog sampleLog(&flash);
+uint32_t sampleLoggedS = 0;     // time of the last sample logged (s)
+uint32_t sampleSyncedS = 0;     // time the log was last synced (s)
 
 // Interrupt changes displayed temperature unit 
 InterruptIn button(BUTTON1);    // attached to BUTTON1 on Nucleo
@@ -75,36 +178,75 @@ InterruptIn button(BUTTON1);    // attached to BUTTON1 on Nucleo
 // create LCD object (SDA=PB_9 and SCL=PB_8)
 CSE321_LCD display(16, 2, LCD_5x8DOTS, PB_9, PB_8);
 
-// create DHT11 object
-DHT11 sensor(PC_8); 
+// create DHT sensor object
+DHT_MODEL sensor(PC_8);
+
+// Eventqueue, room for 32 events posted through QueueMetrics (see metrics.h)
+EventQueue e(32 * QUEUE_METRICS_EVENT_SIZE);
 
-// Eventqueue
-EventQueue e(32 * EVENTS_EVENT_SIZE);
+// schedules sensor reads on the eventqueue, more zones can be added here
+DHTRegistry sensors(&e);
 
-// Threads
-Thread thread1;
-Thread thread2;
-Thread thread3;
+// serial console, type help for the commands
+UnbufferedSerial console(USBTX, USBRX, 9600);
 
-// declare thread function
-void DHTsensor();
-void displayUpdater();
-void alarm();
+// everything sent on the console after startup, queued for its transmit
+// interrupt so no event waits for the line
+SerialTx consoleTx(&console);
+
+// status messages, formatted on the host by host/logdecode
+BinLog logger;
+
+#if TELEMETRY
+// packets for the collector
+Telemetry telemetry(&consoleTx);
+#endif
+
+// console commands, run on the eventqueue
+const ConsoleCommand commands[] = {
+    {"alarms", "list the alarm rules", alarmsCommand},
+    {"set", "<rule> <on> [<off>]  change a rule's thresholds, in the display unit", setCommand},
+    {"unit", "[f|c]  show or change the temperature unit", unitCommand},
+    {"history", "[n]  averages, extremes and the newest n samples", historyCommand},
+    {"metrics", "counters and run time histograms", metricsCommand},
+    {"reset", "zero the counters and histograms", resetCommand},
+};
+Console shell(&console, &consoleTx, &e, commands, sizeof(commands) / sizeof(commands[0]));
+int historyRows = 0;            // samples the history reply lists
+
+// run time of every event, and how far behind the eventqueue runs
+EventMetrics sensorMetrics("sensorReady");
+EventMetrics displayMetrics("updateDisplay");
+EventMetrics alarmMetrics("checkAlarm");
+EventMetrics unitMetrics("changeUnit");
+EventMetrics lagMetrics("queue lag");
+EventMetrics *const eventMetrics[] = {&sensorMetrics, &displayMetrics, &alarmMetrics, &unitMetrics, &lagMetrics};
+QueueMetrics queueMetrics(&e);  // every event posted to e
+uint32_t probeDue;              // us_ticker_read() time the next probeQueue() is due
 
 // watchdog timeout variable
 const uint32_t TIMEOUT_MS = 5000;
+uint32_t lastKickMs = 0;        // Kernel::Clock time of the last kick
+uint32_t worstKickMs = 0;       // longest time between two kicks (ms)
 
 // watchdog trigger (from watchdog API example)
 void trigger()
 {
+    uint32_t now = Kernel::Clock::now().time_since_epoch().count();
+    if (now - lastKickMs > worstKickMs) {
+        worstKickMs = now - lastKickMs;
+    }
+    lastKickMs = now;
     Watchdog::get_instance().kick();
 }
 
 int main() {
     printf("starting main...\n");
 
-    // initialize the display
+    // initialize the display, then let the eventqueue send updates in the
+    // background so a slow display never delays the sensor or the alarm
     display.begin();
+    display.setAsync(&e);
 
     // enable clock on port C
     RCC->AHB2ENR |= 0x4;
@@ -115,17 +257,59 @@ int main() {
     // assign callback function for BUTTON1
     button.rise(&isr_temp);
 
+#if TELEMETRY
+    // the console belongs to the packets
+    console.baud(TELEMETRY_BAUD);
+#endif
+
+    // pick up the sample log where the last run left it
+    int logError = sampleLog.start();
+    if (logError) {
+        printf("Sample log unavailable (%d).\r\n", logError);
+    }else{
+        printf("Sample log opened, boot %lu.\r\n", (unsigned long)sampleLog.boots());
+    }
+
     // wake up the watchdog (code from watchdog API example code)
     Watchdog &watchdog = Watchdog::get_instance();
     watchdog.start(TIMEOUT_MS);
     uint32_t watchdog_timeout = watchdog.get_timeout();
     printf("Watchdog initialized to %u ms.\r\n", watchdog_timeout);
-    // dog being fed in updateDisplay()
+    lastKickMs = Kernel::Clock::now().time_since_epoch().count();
+    // dog being fed in sensorReady()
+
+    // from here on the console is fed by consoleTx, printf would cut into its lines
+#if !TELEMETRY
+    // send log entries from a low priority thread (in the telemetry build
+    // they would land in between the packets)
+    logger.start(&consoleTx);
+#endif
+#if !POWER_AWARE
+    // take commands from the console; in the telemetry build it carries only
+    // packets, so commands run without echo or text replies
+    shell.start(!TELEMETRY);
+#endif
 
-    // start threads
-    thread1.start(DHTsensor);
-    thread2.start(displayUpdater);
-    thread3.start(alarm);
+    // alarm rules: too hot, too humid, or heating up too fast
+    const int maxTempC = (MAX_TEMP * 10 - 320) * 10 / 18;    // MAX_TEMP in tenths of a degree Celsius
+    alarmRules.add({ALARM_TEMPERATURE, ALARM_ABOVE, maxTempC, maxTempC - TEMP_BAND, ALARM_DWELL_S, ALARM_DWELL_S});
+    alarmRules.add({ALARM_HUMIDITY, ALARM_ABOVE, MAX_HUMIDITY, MAX_HUMIDITY - HUMIDITY_BAND, ALARM_DWELL_S, ALARM_DWELL_S});
+    alarmRules.add({ALARM_TEMPERATURE_RATE, ALARM_ABOVE, MAX_TEMP_RATE, MAX_TEMP_RATE / 3, ALARM_DWELL_S, ALARM_DWELL_S});
+
+    // start reading the sensor (every DHT_MIN_INTERVAL_MS)
+    sensors.add(&sensor);
+    sensors.start(sensorReady);
+
+#if !POWER_AWARE
+    // measure how late the eventqueue runs a periodic event
+    probeDue = us_ticker_read() + QUEUE_PROBE_MS * 1000;
+    QueueMetrics::call_every(&e, std::chrono::milliseconds(QUEUE_PROBE_MS), probeQueue);
+#endif
+
+#if TELEMETRY
+    telemetry.addBoot(sampleLog.boots());
+    QueueMetrics::call_every(&e, std::chrono::milliseconds(TELEMETRY_METRICS_MS), sendMetrics);
+#endif
 
     // start eventqueue
     e.dispatch_forever();
@@ -136,40 +320,7 @@ int main() {
 
 // button1 interrupt
 void isr_temp(void) {
-    e.call(changeUnit);
-}
-
-// DHTsensor thread function
-void DHTsensor(){
-    while(1){
-        // add event to eventqueue
-        e.call(updateSensor);
-
-        // sleep
-        ThisThread::sleep_for(1s);
-    }
-}
-
-// display thread function
-void displayUpdater(){
-    while(1){
-        // add event to eventqueue
-        e.call(updateDisplay);
-
-        // sleep
-        ThisThread::sleep_for(1s);
-    }
-}
-
-// alarm thread function
-void alarm(){
-    while(1){
-        // add event to eventqueue
-        e.call(checkAlarm);
-
-        // sleep
-        ThisThread::sleep_for(1s);
-    }
+    QueueMetrics::call(&e, changeUnit);
 }
 
 /**
@@ -186,18 +337,89 @@ void alarm(){
  *
  */
 void changeUnit(){
+    LatencyProbe probe(unitMetrics);
+
     if (tempUnit == 0) {
-        printf("Temperature unit is now Celsius.\n");
+        logger.log<LOG_UNIT_CELSIUS>();
         tempUnit = 1;
     }else{
-        printf("Temperature unit is now Fahrenheit.\n");
+        logger.log<LOG_UNIT_FAHRENHEIT>();
         tempUnit = 0;
     }
+
+    // show the reading in the new unit right away
+    if (reading.version() != 0) {
+        updateDisplay();
+    }
 }
 
 /**
  *
- * void updateSensor()
+ * void sensorReady(int index, int status)
+ *
+ * Paramters    : index of the sensor in sensors, status of the read (DHTLIB_OK or an error)
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function is called by the sensor registry after every read. It records samples from the first
+ *      DHT11 sensor in history and runs the alarm rules on it, and when the reading changed, publishes it.
+ *      Failed reads keep the previous values.
+ *
+ */
+void sensorReady(int index, int status){
+    LatencyProbe probe(sensorMetrics);
+
+    // feed the dog, a completed read shows the eventqueue is still running
+    trigger();
+
+    // the first sensor drives the display and the alarm
+    if (index != 0 || status != DHTLIB_OK) {
+        return;
+    }
+    DHTSensor &sensor = sensors.sensor(index);
+
+    // keep a timestamped copy for trends
+    uint32_t now_s = Kernel::Clock::now().time_since_epoch().count() / 1000;
+    history.add(now_s, sensor.getCelsiusTenths(), sensor.getHumidity());
+
+    // every sample, so rates and minimum on/off times are kept even when the reading holds still
+    checkAlarm();
+
+    Reading r = reading.read();
+    bool changed = reading.version() == 0 || sensor.getCelsiusTenths() != r.tempC || sensor.getHumidity() != r.humidity;
+
+    // keep changes in flash, and a steady reading now and then
+    if (changed || now_s - sampleLoggedS >= SAMPLE_LOG_IDLE_S) {
+        sampleLog.addSample(now_s, sensor.getCelsiusTenths(), sensor.getHumidity());
+        sampleLoggedS = now_s;
+    }
+    if (now_s - sampleSyncedS >= SAMPLE_LOG_SYNC_S) {
+        sampleLog.sync();
+        sampleSyncedS = now_s;
+    }
+
+#if TELEMETRY
+    // the collector gets every sample, a steady reading costs next to nothing
+    telemetry.addSample(now_s, sensor.getCelsiusTenths(), sensor.getHumidity());
+    telemetry.tick();
+#endif
+
+    // only wake the consumers when something changed
+    if (!changed) {
+        return;
+    }
+    r.tempF = sensor.getFahrenheitTenths();  // get temp from sensor
+    r.tempC = sensor.getCelsiusTenths();     // get temp from sensor
+    r.humidity = sensor.getHumidity();    // get humidity from sensor
+    reading.publish(r);
+    publishSample();
+}
+
+/**
+ *
+ * void publishSample()
  *
  * Paramters    : None
  * 
@@ -205,16 +427,14 @@ void changeUnit(){
  *
  * Description:
  *
- *      This function updates the temperature and humidity data variables with data read from the DHT11 sensor.
+ *      This function runs every subscriber on the new reading. It is called on the eventqueue, in the same
+ *      dispatch that produced the sample.
  *
  */
-void updateSensor(){
-    // read humidity sensor
-    sensor.read();                          
-    tempF = sensor.getFahrenheit();  // get temp from sensor
-    tempC = sensor.getCelsius();     // get temp from sensor
-    humidity = sensor.getHumidity();    // get humidity from sensor
-    // printf("T: %f, H: %d\r\n", tempF, humidity);
+void publishSample(){
+    for (auto subscriber : subscribers) {
+        subscriber();
+    }
 }
 
 /**
@@ -227,41 +447,46 @@ void updateSensor(){
  *
  * Description:
  *
- *      This function updates the LCD display with the temperature and humidity data variables.
+ *      This function updates the LCD display with the latest reading.
  *
  */
 void updateDisplay() {
     // printf("updating display...\n");
+    LatencyProbe probe(displayMetrics);
+
+    // count the I2C traffic of this update
+    CSE321_LCD::BusStats before = display.getBusStats();
+
+    // redraw the whole frame, flush() only sends what changed
+    display.clearFrame();
+
+    Reading r = reading.read();
 
-    // clear display
-    display.clear();                
-    
-    // print temperature based on currently selected unit of measure
-    char line1[10];
+    // print temperature based on currently selected unit of measure,
+    // in tenths of a degree straight into the line (no sprintf, no floating point)
+    TextLine<LCD_FRAME_COLS> top;
     if (tempUnit == 0) {
         // Fahrenheit
-        sprintf(line1, "%f", tempF);    // convert to char* for display on LCD
-        display.print("Temp(F):   ");
-        display.print(line1);  
-        printf("T(F): %f, H: %d\r\n", tempF, humidity);
+        top.text<0>("Temp(F):");
+        top.fixed<11, 5, 1>(r.tempF);
     }else{
         // Celsius
-        sprintf(line1, "%f", tempC);    // convert to char* for display on LCD
-        display.print("Temp(C):   ");
-        display.print(line1);
-        printf("T(C): %f, H: %d\r\n", tempC, humidity);
-    }
-    
-    // print humidity to display 
-    char line2[10];       
-    display.setCursor(0, 1);         // switch to row 2   
-    sprintf(line2, "%d", humidity);  // convert to char* for display on LCD
-    display.print("Humidity:   ");     
-    display.print(line2);
-    display.print("%");
-
-    // feed the dog
-        trigger();
+        top.text<0>("Temp(C):");
+        top.fixed<11, 5, 1>(r.tempC);
+    }
+    display.drawText(0, 0, top.c_str());
+
+    // print humidity to display
+    TextLine<LCD_FRAME_COLS> bottom;
+    bottom.text<0>("Humidity:");
+    bottom.number<12, 3>(r.humidity);
+    bottom.text<15>("%");
+    display.drawText(0, 1, bottom.c_str());
+    logger.log<LOG_READING>(tempUnit == 0 ? 'F' : 'C', tempUnit == 0 ? r.tempF : r.tempC, r.humidity);
+
+    display.flush();
+    CSE321_LCD::BusStats after = display.getBusStats();
+    logger.log<LOG_LCD_TRAFFIC>(after.transactions - before.transactions, after.bytes - before.bytes);
 }
 
 /**
@@ -274,20 +499,561 @@ void updateDisplay() {
  *
  * Description:
  *
- *      This function checks if temp or humidity thresholds have been exceeded, 
- *      and if they have been, turns on the pin associated with the vibration motor
- *      otherwise, it turns off the associated pin
+ *      This function runs the alarm rules on the newest sample in history, and if any of them is on,
+ *      turns on the pin associated with the vibration motor
+ *      otherwise, it turns off the associated pin. Rules that turned on or off are logged to flash.
  *
  */
 void checkAlarm(){
     // printf("checking alarm...\n");
+    LatencyProbe probe(alarmMetrics);
 
     // check thresholds
-    if (tempF > MAX_TEMP || humidity > MAX_HUMIDITY) {
+    if (alarmRules.update(history)) {
         // turn on pin associated with vibration motor
         GPIOC->ODR |= 0x200;  // output to PC9
     }else{
         // turn off pin associated with vibration motor
         GPIOC->ODR &= ~(0x200);  // stop output to PC9
     }
+
+    // log the rules that changed
+    for (int i = 0; i < alarmRules.count(); i++) {
+        bool on = alarmRules.active(i);
+        if (on != ((alarmStates >> i) & 1)) {
+            alarmStates ^= 1u << i;
+            sampleLog.addAlarm(history.at(0).time, i, on);
+#if TELEMETRY
+            telemetry.addAlarm(history.at(0).time, i, on);
+#endif
+        }
+    }
+}
+
+/**
+ *
+ * void probeQueue()
+ *
+ * Paramters    : None
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function runs every QUEUE_PROBE_MS on the eventqueue and records how late it ran,
+ *      which is how long other events held up the queue.
+ *
+ */
+void probeQueue(){
+    uint32_t now = us_ticker_read();
+    int32_t late = (int32_t)(now - probeDue);
+    lagMetrics.record(late > 0 ? late : 0);
+    probeDue += QUEUE_PROBE_MS * 1000;
+}
+
+/**
+ *
+ * void sendMetrics()
+ *
+ * Paramters    : None
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function sends the counters the metrics command prints as one telemetry packet, in the order of
+ *      TELEMETRY_METRIC_LIST. It runs every TELEMETRY_METRICS_MS in the telemetry build, and on the
+ *      metrics command. CPU idle time is sent as 0xFFFFFFFF when it is not available.
+ *
+ */
+void sendMetrics(){
+#if TELEMETRY
+    uint32_t values[TELEMETRY_METRIC_COUNT];
+    values[METRIC_UPTIME_MS] = Kernel::Clock::now().time_since_epoch().count();
+    values[METRIC_CPU_IDLE] = cpuIdlePercent();
+    values[METRIC_WATCHDOG_WORST_MS] = worstKickMs;
+    values[METRIC_QUEUE_POSTS] = queueMetrics.posts();
+    values[METRIC_QUEUE_FAILED] = queueMetrics.failed();
+    values[METRIC_QUEUE_HIGH_WATER] = queueMetrics.highWater();
+    values[METRIC_SENSOR_MAX_US] = sensorMetrics.max();
+    values[METRIC_ALARM_MAX_US] = alarmMetrics.max();
+    values[METRIC_LAG_MAX_US] = lagMetrics.max();
+
+    CSE321_LCD::BusStats bus = display.getBusStats();
+    values[METRIC_LCD_TRANSACTIONS] = bus.transactions;
+    values[METRIC_LCD_ERRORS] = bus.errors;
+
+    const SampleLogStats &log = sampleLog.stats();
+    values[METRIC_LOG_RECORDS] = log.records;
+    values[METRIC_LOG_BYTES] = log.bytes;
+    values[METRIC_LOG_DROPPED] = log.dropped;
+
+    values[METRIC_DHT_READS] = 0;
+    values[METRIC_DHT_ERRORS] = 0;
+    for (int i = 0; i < sensors.count(); i++) {
+        const DHTSensorStats &st = sensors.stats(i);
+        values[METRIC_DHT_READS] += st.reads;
+        values[METRIC_DHT_ERRORS] += st.timeouts + st.checksums;
+    }
+
+    values[METRIC_TELEMETRY_PACKETS] = telemetry.packets();
+    values[METRIC_TELEMETRY_DROPPED] = telemetry.dropped();
+    telemetry.sendMetrics(values);
+#endif
+}
+
+/**
+ *
+ * int toDisplay(int quantity, int value)
+ *
+ * Paramters    : AlarmQuantity of the value, the value in its units (alarm.h)
+ * 
+ * Return Value : the value in tenths of the unit shown on the console
+ *
+ * Description:
+ *
+ *      This function converts a temperature, humidity or rate to what the console shows: temperatures
+ *      in the unit currently selected, rounded to a tenth, and humidity in tenths of a percent.
+ *
+ */
+int toDisplay(int quantity, int value){
+    int f = value * 18;         // tenths of a degree Fahrenheit, times ten
+    f = (f >= 0 ? f + 5 : f - 5) / 10;
+    switch (quantity) {
+    case ALARM_TEMPERATURE:
+        return tempUnit == 0 ? f + 320 : value;
+    case ALARM_TEMPERATURE_RATE:
+        return tempUnit == 0 ? f : value;
+    case ALARM_HUMIDITY:
+        return value * 10;
+    default:
+        return value;
+    }
+}
+
+/**
+ *
+ * int fromDisplay(int quantity, int tenths)
+ *
+ * Paramters    : AlarmQuantity of the value, the value in tenths of the unit shown on the console
+ * 
+ * Return Value : the value in the units of the quantity (alarm.h)
+ *
+ * Description:
+ *
+ *      This function undoes toDisplay(), for thresholds typed on the console. Humidity is kept in whole
+ *      percents, so its tenths are dropped; setCommand() refuses them first.
+ *
+ */
+int fromDisplay(int quantity, int tenths){
+    int c = tempUnit == 0 && quantity == ALARM_TEMPERATURE ? tenths - 320 : tenths;
+    c *= 10;
+    c = (c >= 0 ? c + 9 : c - 9) / 18;
+    switch (quantity) {
+    case ALARM_TEMPERATURE:
+    case ALARM_TEMPERATURE_RATE:
+        return tempUnit == 0 ? c : tenths;
+    case ALARM_HUMIDITY:
+        return tenths / 10;
+    default:
+        return tenths;
+    }
+}
+
+// unit the console shows each AlarmQuantity in, by tempUnit
+const char *const unitNames[2][ALARM_QUANTITIES] = {
+    {"F", "%", "F/min", "%/min"},
+    {"C", "%", "C/min", "%/min"},
+};
+
+// what each AlarmQuantity is called on the console
+const char *const quantityNames[ALARM_QUANTITIES] = {"temperature", "humidity", "temperature rate", "humidity rate"};
+
+/**
+ *
+ * void formatTenths(char *text, size_t size, int value, const char *unit)
+ *
+ * Paramters    : buffer and its size, value in tenths, unit written after it
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function writes a value in tenths with one decimal and its unit, e.g. 724 as "72.4 F".
+ *
+ */
+void formatTenths(char *text, size_t size, int value, const char *unit){
+    int magnitude = value < 0 ? -value : value;
+    snprintf(text, size, "%s%d.%d %s", value < 0 ? "-" : "", magnitude / 10, magnitude % 10, unit);
+}
+
+/**
+ *
+ * bool parseTenths(const char *text, int *value)
+ *
+ * Paramters    : number typed on the console, where to store it
+ * 
+ * Return Value : true if text is a number with at most one decimal below 1000
+ *
+ * Description:
+ *
+ *      This function reads a number such as 75, -3 or 72.5 into tenths (750, -30, 725).
+ *
+ */
+bool parseTenths(const char *text, int *value){
+    char *end;
+    long whole = strtol(text, &end, 10);
+    if (end == text || whole <= -1000 || whole >= 1000) {
+        return false;
+    }
+    int tenth = 0;
+    if (*end == '.' && end[1] >= '0' && end[1] <= '9') {
+        tenth = end[1] - '0';
+        end += 2;
+    }
+    if (*end != '\0') {
+        return false;
+    }
+    *value = whole * 10 + (text[0] == '-' ? -tenth : tenth);
+    return true;
+}
+
+/**
+ *
+ * void alarmsCommand(int argc, char **argv)
+ *
+ * Paramters    : words of the command line
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function lists the alarm rules with their thresholds and state, one line each (alarmsLine()).
+ *
+ */
+void alarmsCommand(int argc, char **argv){
+    shell.stream(alarmsLine);
+}
+
+/**
+ *
+ * bool alarmsLine(int i)
+ *
+ * Paramters    : index of the rule
+ * 
+ * Return Value : false once every rule is listed
+ *
+ * Description:
+ *
+ *      This function prints alarm rule i, its thresholds in the unit currently displayed.
+ *
+ */
+bool alarmsLine(int i){
+    if (i >= alarmRules.count()) {
+        return false;
+    }
+    const AlarmRule &rule = alarmRules.rule(i);
+    char on[16], off[16];
+    formatTenths(on, sizeof(on), toDisplay(rule.quantity, rule.on), unitNames[tempUnit][rule.quantity]);
+    formatTenths(off, sizeof(off), toDisplay(rule.quantity, rule.off), unitNames[tempUnit][rule.quantity]);
+    shell.print("%d: %s %s %s, off at %s, %s", i, quantityNames[rule.quantity],
+                rule.direction == ALARM_ABOVE ? "above" : "below", on, off, alarmRules.active(i) ? "ON" : "off");
+    return true;
+}
+
+/**
+ *
+ * void setCommand(int argc, char **argv)
+ *
+ * Paramters    : words of the command line: set <rule> <on> [<off>]
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function changes the thresholds of an alarm rule, given in the unit currently displayed.
+ *      Humidity thresholds are whole percents, as the sensor reads it. Without an off threshold the
+ *      rule keeps the width of its band. The new thresholds take effect on the next sample and are logged.
+ *
+ */
+void setCommand(int argc, char **argv){
+    if (argc < 3) {
+        shell.print("usage: set <rule> <on> [<off>], rules are listed by alarms");
+        return;
+    }
+    char *end;
+    long i = strtol(argv[1], &end, 10);
+    if (end == argv[1] || *end != '\0' || i < 0 || i >= alarmRules.count()) {
+        shell.print("no rule %s, see alarms", argv[1]);
+        return;
+    }
+    int on, off;
+    if (!parseTenths(argv[2], &on) || (argc > 3 && !parseTenths(argv[3], &off))) {
+        shell.print("thresholds are numbers with at most one decimal");
+        return;
+    }
+
+    const AlarmRule &rule = alarmRules.rule(i);
+    if (rule.quantity == ALARM_HUMIDITY && (on % 10 != 0 || (argc > 3 && off % 10 != 0))) {
+        shell.print("humidity thresholds are whole percents");
+        return;
+    }
+    on = fromDisplay(rule.quantity, on);
+    off = argc > 3 ? fromDisplay(rule.quantity, off) : on - (rule.on - rule.off);
+    if (!alarmRules.setThresholds(i, on, off)) {
+        shell.print("off must not be past on");
+        return;
+    }
+    // logged in the rule's own unit, which the format names
+    switch (rule.quantity) {
+    case ALARM_TEMPERATURE:
+        logger.log<LOG_THRESHOLDS_TEMPERATURE>(i, on, off);
+        break;
+    case ALARM_HUMIDITY:
+        logger.log<LOG_THRESHOLDS_HUMIDITY>(i, on, off);
+        break;
+    case ALARM_TEMPERATURE_RATE:
+        logger.log<LOG_THRESHOLDS_TEMPERATURE_RATE>(i, on, off);
+        break;
+    default:
+        logger.log<LOG_THRESHOLDS_HUMIDITY_RATE>(i, on, off);
+        break;
+    }
+    alarmsLine(i);
+}
+
+/**
+ *
+ * void unitCommand(int argc, char **argv)
+ *
+ * Paramters    : words of the command line: unit [f|c]
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function shows the temperature unit, or changes it the way BUTTON1 does, by posting changeUnit().
+ *
+ */
+void unitCommand(int argc, char **argv){
+    int unit = tempUnit;
+    if (argc > 1) {
+        if (strcmp(argv[1], "f") == 0 || strcmp(argv[1], "F") == 0) {
+            unit = 0;
+        }else if (strcmp(argv[1], "c") == 0 || strcmp(argv[1], "C") == 0) {
+            unit = 1;
+        }else{
+            shell.print("usage: unit [f|c]");
+            return;
+        }
+    }
+    if (unit != tempUnit) {
+        QueueMetrics::call(&e, changeUnit);
+    }
+    shell.print("temperature unit: %s", unit == 0 ? "F" : "C");
+}
+
+/**
+ *
+ * void historyCommand(int argc, char **argv)
+ *
+ * Paramters    : words of the command line: history [n]
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function prints the moving averages, the extremes since boot and the newest n samples
+ *      (HISTORY_ROWS by default), one line at a time (historyLine()).
+ *
+ */
+void historyCommand(int argc, char **argv){
+    int rows = HISTORY_ROWS;
+    if (argc > 1) {
+        char *end;
+        rows = strtol(argv[1], &end, 10);
+        if (end == argv[1] || *end != '\0' || rows < 0) {
+            shell.print("usage: history [n]");
+            return;
+        }
+    }
+    historyRows = rows < (int)history.size() ? rows : history.size();
+    shell.stream(historyLine);
+}
+
+/**
+ *
+ * bool historyLine(int i)
+ *
+ * Paramters    : line of the history reply
+ * 
+ * Return Value : false after the last line
+ *
+ * Description:
+ *
+ *      This function prints line i of the history reply: the 1 minute, 10 minute and 1 hour averages,
+ *      the extremes since boot, then historyRows samples, oldest first.
+ *
+ */
+bool historyLine(int i){
+    static const HistoryWindow windows[] = {HISTORY_1MIN, HISTORY_10MIN, HISTORY_1H};
+    static const char *const windowNames[] = {"1 min", "10 min", "1 h"};
+    const char *unit = unitNames[tempUnit][ALARM_TEMPERATURE];
+    char temp[16], temp2[16], hum[16];
+
+    if (i < 3) {
+        HistoryMean m = history.mean(windows[i]);
+        formatTenths(temp, sizeof(temp), toDisplay(ALARM_TEMPERATURE, m.meanTemperature()), unit);
+        formatTenths(hum, sizeof(hum), m.meanHumidity(), "%");
+        shell.print("%-7s avg %s, %s over %lu samples", windowNames[i], temp, hum, (unsigned long)m.count);
+        return true;
+    }
+    if (i == 3) {
+        const HistoryStats &st = history.stats();
+        formatTenths(temp, sizeof(temp), toDisplay(ALARM_TEMPERATURE, st.minTemperature), unit);
+        formatTenths(temp2, sizeof(temp2), toDisplay(ALARM_TEMPERATURE, st.maxTemperature), unit);
+        shell.print("%-7s %s to %s, %u to %u %% over %lu samples", "boot", temp, temp2,
+                    st.minHumidity, st.maxHumidity, (unsigned long)st.sum.count);
+        return true;
+    }
+    int row = i - 4;
+    if (row >= historyRows) {
+        return false;
+    }
+    const DHTSample &s = history.at(historyRows - 1 - row);
+    formatTenths(temp, sizeof(temp), toDisplay(ALARM_TEMPERATURE, s.temperature), unit);
+    shell.print("%7lu s  %s  %u %%", (unsigned long)s.time, temp, s.humidity);
+    return true;
+}
+
+/**
+ *
+ * void metricsCommand(int argc, char **argv)
+ *
+ * Paramters    : words of the command line
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function prints every counter and histogram, one line at a time (metricsLine()). The
+ *      telemetry build sends them as a packet instead (sendMetrics()).
+ *
+ */
+void metricsCommand(int argc, char **argv){
+#if TELEMETRY
+    sendMetrics();
+#else
+    shell.stream(metricsLine);
+#endif
+}
+
+/**
+ *
+ * bool metricsLine(int i)
+ *
+ * Paramters    : line of the metrics reply
+ * 
+ * Return Value : false after the last line
+ *
+ * Description:
+ *
+ *      This function prints line i of the metrics reply: CPU, watchdog, eventqueue, the run time of
+ *      every event, the LCD bus, the sample log, the console and every sensor.
+ *
+ */
+bool metricsLine(int i){
+    const int eventCount = sizeof(eventMetrics) / sizeof(eventMetrics[0]);
+
+    // CPU, watchdog and eventqueue
+    if (i == 0) {
+        uint32_t now = Kernel::Clock::now().time_since_epoch().count();
+        shell.print("---- metrics at %lu ms ----", (unsigned long)now);
+        return true;
+    }
+    if (i == 1) {
+        int idle = cpuIdlePercent();
+        if (idle >= 0) {
+            shell.print("cpu idle: %d%%", idle);
+        }
+        return true;
+    }
+    if (i == 2) {
+        shell.print("watchdog: worst gap %lu ms of %lu ms", (unsigned long)worstKickMs, (unsigned long)TIMEOUT_MS);
+        return true;
+    }
+    if (i == 3) {
+        shell.print("queue: %lu posts, %lu failed, %lu events in it, high water %lu",
+                    (unsigned long)queueMetrics.posts(), (unsigned long)queueMetrics.failed(),
+                    (unsigned long)queueMetrics.pending(), (unsigned long)queueMetrics.highWater());
+        return true;
+    }
+
+    // run time of every event (us histogram: lower bucket edge:count)
+    i -= 4;
+    if (i < eventCount) {
+        char text[CONSOLE_OUT_LINE + 1];
+        eventMetrics[i]->format(text, sizeof(text));
+        shell.print("%s", text);
+        return true;
+    }
+    i -= eventCount;
+
+    // LCD bus, sample log and console
+    if (i == 0) {
+        CSE321_LCD::BusStats bus = display.getBusStats();
+        shell.print("lcd: %u transactions, %u bytes, %u errors, %u dropped",
+                    bus.transactions, bus.bytes, bus.errors, bus.dropped);
+        return true;
+    }
+    if (i == 1) {
+        const SampleLogStats &log = sampleLog.stats();
+        shell.print("flash log: boot %lu, %lu records in %lu bytes, %lu commits, %lu erases, %lu skipped, %lu dropped, %lu errors",
+                    (unsigned long)sampleLog.boots(), (unsigned long)log.records, (unsigned long)log.bytes,
+                    (unsigned long)log.commits, (unsigned long)log.erases, (unsigned long)log.skipped,
+                    (unsigned long)log.dropped, (unsigned long)log.errors);
+        return true;
+    }
+    if (i == 2) {
+        shell.print("console: %lu bytes lost on receive, %lu writes dropped, %lu log entries dropped",
+                    (unsigned long)shell.overruns(), (unsigned long)consoleTx.dropped(),
+                    (unsigned long)logger.dropped());
+        return true;
+    }
+    i -= 3;
+
+    // sensors
+    if (i < sensors.count()) {
+        const DHTSensorStats &st = sensors.stats(i);
+        shell.print("dht%d: %lu reads, %lu timeouts, %lu checksum errors, %lu skipped, age %ld ms", i,
+                    (unsigned long)st.reads, (unsigned long)st.timeouts, (unsigned long)st.checksums,
+                    (unsigned long)st.skipped, (long)sensors.age(i));
+        return true;
+    }
+    return false;
+}
+
+/**
+ *
+ * void resetCommand(int argc, char **argv)
+ *
+ * Paramters    : words of the command line
+ * 
+ * Return Value : None
+ *
+ * Description:
+ *
+ *      This function zeroes the event histograms, the eventqueue and LCD bus counters, the worst
+ *      watchdog gap and the sensor read counters. History, alarm state and the sample log are kept.
+ *
+ */
+void resetCommand(int argc, char **argv){
+    for (EventMetrics *m : eventMetrics) {
+        m->reset();
+    }
+    queueMetrics.reset();
+    worstKickMs = 0;
+    display.resetBusStats();
+    sensors.resetStats();
+    shell.print("counters reset");
 }
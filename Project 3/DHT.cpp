@@ -8,17 +8,74 @@
 
 
 #include "DHT.h"
+#include "metrics.h"
+
+// C to F conversion in tenths of a degree for the DHT11's whole degrees,
+// generated at compile time: F * 10 = C * 18 + 320. One entry for every
+// value of the byte, so any frame indexes it, though the DHT11 only reads
+// 0-50 C.
+struct FahrenheitTable {
+    int16_t tenths[256];
+};
+
+static constexpr FahrenheitTable makeFahrenheitTable() {
+    FahrenheitTable table = {};
+    for (int c = 0; c < 256; c++) {
+        table.tenths[c] = c * 18 + 320;
+    }
+    return table;
+}
+
+static constexpr FahrenheitTable fahrenheitTable = makeFahrenheitTable();
+static_assert(fahrenheitTable.tenths[0] == 320, "0 C is 32.0 F");
+static_assert(fahrenheitTable.tenths[50] == 1220, "50 C is 122.0 F");
+static_assert(fahrenheitTable.tenths[255] == 4910, "255 C is 491.0 F");
+
+// The checksum byte is the low byte of the sum of the other four.
+static bool checksumOk(const uint8_t *bits) {
+    return (uint8_t)(bits[0] + bits[1] + bits[2] + bits[3]) == bits[4];
+}
+
+int DHT11Traits::decode(const uint8_t *bits, DHTValues &values) {
+    if (!checksumOk(bits)) return DHTLIB_ERROR_CHECKSUM;
+
+    // as bits[1] and bits[3] are allways zero they are omitted in formulas.
+    values.humidity = bits[0] * 10;
+    values.celsius = bits[2] * 10;
+    values.fahrenheit = fahrenheitTable.tenths[bits[2]];
+    return DHTLIB_OK;
+}
+
+int DHT22Traits::decode(const uint8_t *bits, DHTValues &values) {
+    if (!checksumOk(bits)) return DHTLIB_ERROR_CHECKSUM;
+
+    // tenths, big endian; the temperature's top bit is its sign
+    int magnitude = (bits[2] & 0x7F) << 8 | bits[3];
+    values.humidity = bits[0] << 8 | bits[1];
+    values.celsius = bits[2] & 0x80 ? -magnitude : magnitude;
+    // F * 10 = C * 10 * 1.8 + 320, rounded to the nearest tenth
+    int f = values.celsius * 18;
+    values.fahrenheit = (f >= 0 ? f + 5 : f - 5) / 10 + 320;
+    return DHTLIB_OK;
+}
  
-DHT11::DHT11(PinName const &p) : _pin(p) {
+DHTSensor::DHTSensor() {
+    _values.celsius = 0; //default unit of Celcius 
+    _values.fahrenheit = 320;
+    _values.humidity = 0;
+}
+
+template <typename Traits> DHT<Traits>::DHT(PinName const &p) : _pin(p), _edge(p) {
     // Set creation time so we can make 
     // sure we pause at least 1 second for 
     // startup.
     _timer.start();
-    _temperature = 0; //default unit of Celcius 
-    _humidity = 0;
+    _edgeCount = 0;
+    _state = DHT_IDLE;
+    _queue = nullptr;
 }
 
-int DHT11::read() {
+template <typename Traits> int DHT<Traits>::read() {
     // can not read more frequent than every 2 seconds
   
     // BUFFER TO RECEIVE
@@ -31,13 +88,12 @@ int DHT11::read() {
     for (int i=0; i< 5; i++) bits[i] = 0;
     
     // Verify sensor settled after boot
-    while(_timer.elapsed_time().count() < 1500) {}
-    _timer.stop();
+    settle();
  
     // Notify it we are ready to read
     _pin.output();
     _pin = 0;
-    thread_sleep_for(18);
+    thread_sleep_for(Traits::START_MS);
     _pin = 1;
     wait_us(40);
     _pin.input();
@@ -67,7 +123,7 @@ int DHT11::read() {
             if (loopCnt-- == 0) return DHTLIB_ERROR_TIMEOUT;
 
         //26-30us is 0, ~70us is 1, 40 is a good sample point
-        if (t.elapsed_time().count() > 40) bits[idx] |= (1 << cnt);
+        if (t.elapsed_time().count() > Traits::ONE_HIGH_US) bits[idx] |= (1 << cnt);
         if (cnt == 0)   // next byte?
         {
             cnt = 7;    // restart at MSB
@@ -77,22 +133,149 @@ int DHT11::read() {
     }
  
     // WRITE TO RIGHT VARS
-    // as bits[1] and bits[3] are allways zero they are omitted in formulas.
-    _humidity    = bits[0];
-    _temperature = bits[2];
-    uint8_t sum = bits[0] + bits[2];  
+    return Traits::decode(bits, _values);
+}
  
-    if (bits[4] != sum) return DHTLIB_ERROR_CHECKSUM;
+template <typename Traits> int DHT<Traits>::readCapture() {
+    // Verify sensor settled after boot
+    settle();
+
+    // Notify it we are ready to read
+    _pin.output();
+    _pin = 0;
+    thread_sleep_for(Traits::START_MS);
+
+    // Capture falling edges from here on. The first one is the sensor
+    // acknowledging the start signal and is not stored.
+    _edgeCount = -1;
+    _frame.reset();
+    _frame.start();
+    _edge.fall(callback(this, &DHT::edgeFall));
+    _pin = 1;
+    wait_us(40);
+    _pin.input();
+
+    // 80us + 80us acknowledge, then at most 40 * 120us of data
+    thread_sleep_for(6);
+    _edge.fall(nullptr);
+    _frame.stop();
+
+    return decode();
+}
+
+template <typename Traits> void DHT<Traits>::settle() {
+    // sleep rather than spin, the MCU can deep sleep meanwhile
+    int settled = _timer.elapsed_time().count() / 1000;
+    if (settled < DHTLIB_SETTLE_MS) {
+        thread_sleep_for(DHTLIB_SETTLE_MS - settled);
+    }
+    _timer.stop();
+}
+
+template <typename Traits> int DHT<Traits>::start(EventQueue *queue, Callback<void(int)> done) {
+    if (_state != DHT_IDLE) return DHTLIB_ERROR_BUSY;
+    _queue = queue;
+    _done = done;
+
+    // Verify sensor settled after boot, without waiting for it
+    int settled = _timer.elapsed_time().count() / 1000;
+    if (settled < DHTLIB_SETTLE_MS) {
+        _state = DHT_SETTLING;
+        schedule(DHTLIB_SETTLE_MS - settled, &DHT::startSignal);
+    } else {
+        startSignal();
+    }
     return DHTLIB_OK;
 }
+
+template <typename Traits> void DHT<Traits>::startSignal() {
+    _timer.stop();
+
+    // Notify it we are ready to read
+    _state = DHT_START;
+    _pin.output();
+    _pin = 0;
+    schedule(Traits::START_MS, &DHT::releaseBus);
+}
+
+template <typename Traits> void DHT<Traits>::releaseBus() {
+    // Let the pull-up end the start signal and capture the answer, skipping
+    // the sensor's acknowledge edge like readCapture()
+    _state = DHT_CAPTURE;
+    _edgeCount = -1;
+    _frame.reset();
+    _frame.start();
+    _edge.fall(callback(this, &DHT::edgeFall));
+    _pin.input();
+
+    // 80us + 80us acknowledge, then at most 40 * 120us of data
+    schedule(6, &DHT::finishRead);
+}
+
+template <typename Traits> void DHT<Traits>::finishRead() {
+    _edge.fall(nullptr);
+    _frame.stop();
+    complete(decode());
+}
+
+template <typename Traits> void DHT<Traits>::schedule(int ms, void (DHT::*step)()) {
+    if (QueueMetrics::call_in(_queue, std::chrono::milliseconds(ms), callback(this, step)) == 0) {
+        // no room on the queue, give up on this read
+        _edge.fall(nullptr);
+        _frame.stop();
+        _pin.input();
+        complete(DHTLIB_ERROR_BUSY);
+    }
+}
+
+template <typename Traits> void DHT<Traits>::complete(int status) {
+    _state = DHT_IDLE;
+    if (_done) {
+        _done(status);
+    }
+}
+
+template <typename Traits> void DHT<Traits>::edgeFall() {
+    int n = _edgeCount;
+    if (n >= 0 && n < DHTLIB_EDGES) {
+        _edges[n] = _frame.elapsed_time().count();
+    }
+    _edgeCount = n + 1;
+}
+
+template <typename Traits> int DHT<Traits>::decode() {
+    if (_edgeCount < DHTLIB_EDGES) return DHTLIB_ERROR_TIMEOUT;
+
+    // one pass over the gaps between consecutive falling edges
+    uint8_t bits[5] = {0, 0, 0, 0, 0};
+    for (int i = 0; i < 40; i++) {
+        if (_edges[i + 1] - _edges[i] > Traits::ONE_GAP_US) {
+            bits[i / 8] |= 0x80 >> (i % 8);
+        }
+    }
+
+    return Traits::decode(bits, _values);
+}
  
-float DHT11::getFahrenheit() { //performs C to F conversion
-    return((_temperature * 1.8) + 32);
+float DHTSensor::getFahrenheit() { //performs C to F conversion
+    return _values.fahrenheit / 10.0f;
 }
  
-int DHT11::getCelsius() {
-    return(_temperature);
+int DHTSensor::getCelsius() {
+    return _values.celsius / 10;
 }
-int DHT11::getHumidity() {
-    return(_humidity);
-}
\ No newline at end of file
+
+int DHTSensor::getFahrenheitTenths() {
+    return _values.fahrenheit;
+}
+
+int DHTSensor::getCelsiusTenths() {
+    return _values.celsius;
+}
+
+int DHTSensor::getHumidity() {
+    return (_values.humidity + 5) / 10;
+}
+
+template class DHT<DHT11Traits>;
+template class DHT<DHT22Traits>;
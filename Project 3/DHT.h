@@ -13,38 +13,105 @@
 #define DHTLIB_OK                0
 #define DHTLIB_ERROR_CHECKSUM   -1
 #define DHTLIB_ERROR_TIMEOUT    -2
- 
-/** Class for the DHT11 sensor.
- * 
+#define DHTLIB_ERROR_BUSY       -3
+
+// time the sensor needs after power up before it answers (ms)
+#define DHTLIB_SETTLE_MS        1000
+
+// falling edges captured per frame: the start of each of the 40 bits plus
+// the end of the last one
+#define DHTLIB_EDGES            41
+
+// gap between falling edges (us) above which a bit is a 1: a bit is 50us
+// low followed by 26-28us (0) or 70us (1) high, so gaps are ~77 or ~120us
+#define DHTLIB_ONE_GAP_US       100
+
+// time high (us) above which a bit is a 1, for the polled read()
+#define DHTLIB_ONE_HIGH_US      40
+
+/** Values decoded from one frame, in tenths. */
+struct DHTValues {
+    int16_t celsius;    ///< tenths of a degree Celsius
+    int16_t fahrenheit; ///< tenths of a degree Fahrenheit
+    int16_t humidity;   ///< tenths of a percent
+};
+
+/** Traits of the DHT11: whole degrees and percent in bytes 0 and 2, with
+ *  bytes 1 and 3 always zero, and a 18ms start signal.
+ */
+struct DHT11Traits {
+    /// time the host holds the line low to start a frame (ms)
+    static constexpr int START_MS = 18;
+    /// bit thresholds, see DHTLIB_ONE_HIGH_US and DHTLIB_ONE_GAP_US
+    static constexpr int ONE_HIGH_US = DHTLIB_ONE_HIGH_US;
+    static constexpr int ONE_GAP_US = DHTLIB_ONE_GAP_US;
+    /// shortest time between two reads (ms)
+    static constexpr int MIN_INTERVAL_MS = 2000;
+
+    /** Check the frame and decode it into values.
+     *
+     * @returns
+     *   DHTLIB_OK, or DHTLIB_ERROR_CHECKSUM leaving values untouched.
+     */
+    static int decode(const uint8_t *bits, DHTValues &values);
+};
+
+/** Traits of the DHT22 (AM2302): tenths of a percent and of a degree as 16
+ *  bit big endian values, the temperature with a sign bit, and a start
+ *  signal of at least 1ms.
+ */
+struct DHT22Traits {
+    static constexpr int START_MS = 2;
+    static constexpr int ONE_HIGH_US = DHTLIB_ONE_HIGH_US;
+    static constexpr int ONE_GAP_US = DHTLIB_ONE_GAP_US;
+    static constexpr int MIN_INTERVAL_MS = 2000;
+
+    static int decode(const uint8_t *bits, DHTValues &values);
+};
+
+/** Interface of the DHT family as the sensor registry uses it: start a read
+ *  on an event queue and take the last good reading. DHT<Traits> below is
+ *  the driver, one class per model; code that reads any of them, such as
+ *  DHTRegistry, can take a DHTSensor.
+ *
  * Example:
  * @code
  * #include "mbed.h"
- * #include "DHT11.h"
+ * #include "DHT.h"
+ *
+ * EventQueue queue;
+ * DHT11 sensor(PC_8);
+ *
+ * void done(int status) {
+ *     if (status == DHTLIB_OK) printf("T: %d, H: %d\r\n", sensor.getCelsius(), sensor.getHumidity());
+ * }
  *
- * Serial pc(USBTX, USBRX);
- * DHT11 sensor(PTD7); //note this is from a different board
- * 
  * int main() {
- *     sensor.read()
- *     pc.printf("T: %f, H: %d\r\n", sensor.getFahrenheit(), sensor.getHumidity());
+ *     sensor.start(&queue, done);
+ *     queue.dispatch_forever();
  * }
  * @endcode
  */
-class DHT11
+class DHTSensor
 {
 public:
-    /** Construct the sensor object.
-     *
-     * @param pin PinName for the sensor pin.
-     */
-    DHT11(PinName const &p);
-    
-    /** Update the humidity and temp from the sensor.
+    /** Start a read without blocking. The start signal, the capture window
+     * and the decode are each scheduled on queue with call_in(), so the
+     * thread dispatching queue never sleeps or spins in the driver. done is
+     * then called on queue with the status readCapture() would return.
      *
+     * @param queue event queue that runs the read
+     * @param done  completion callback, gets 0 on success, otherwise error
      * @returns
-     *   0 on success, otherwise error.
+     *   0 if the read was started, DHTLIB_ERROR_BUSY if one is in progress.
      */
-    int read();
+    virtual int start(EventQueue *queue, Callback<void(int)> done) = 0;
+
+    /** Check for a read started with start() that has not completed. */
+    virtual bool busy() const = 0;
+
+    /** Shortest time between two reads of this sensor (ms). */
+    virtual int minIntervalMs() const = 0;
     
     /** Get the temp(f) from the saved object.
      *
@@ -59,23 +126,120 @@ public:
      *   Celsius int
      */
     int getCelsius();
+
+    /** Get the temp in tenths of a degree Fahrenheit, without floating point.
+     *
+     * @returns
+     *   Fahrenheit * 10 int
+     */
+    int getFahrenheitTenths();
+
+    /** Get the temp in tenths of a degree Celsius.
+     *
+     * @returns
+     *   Celsius * 10 int
+     */
+    int getCelsiusTenths();
     
-    /** Get the humidity from the saved object.
+    /** Get the humidity from the saved object. A DHT22 measures tenths of a
+     *  percent, but the history, the sample log and the telemetry keep whole
+     *  percents (one byte in samplecodec.h), so it is rounded here.
      *
      * @returns
      *   Humidity percent int
      */
     int getHumidity();
+
+protected:
+    DHTSensor();
+    ~DHTSensor() {}
+
+    /// last good reading, in the same units for every model
+    DHTValues _values;
+};
+
+/** Class for one model of DHT sensor, described by a traits type (DHT11Traits,
+ *  DHT22Traits). The start signal, the bit thresholds and the decode are
+ *  constants and a direct call of the traits, so the capture and read code
+ *  of each model is compiled for it; only the DHTSensor interface the
+ *  registry calls is virtual. DHT.cpp compiles the models typedef'd below.
+ */
+template <typename Traits> class DHT : public DHTSensor
+{
+public:
+    /** Construct the sensor object.
+     *
+     * @param pin   PinName for the sensor pin.
+     */
+    DHT(PinName const &p);
+    
+    /** Update the humidity and temp from the sensor.
+     *
+     * @returns
+     *   0 on success, otherwise error.
+     */
+    int read();
+
+    /** Update the humidity and temp from the sensor, timestamping falling
+     * edges from an interrupt and decoding the bits from the gaps between
+     * them afterwards. The calling thread sleeps through the ~5ms frame
+     * instead of polling the pin, so the result does not depend on what
+     * else is running.
+     *
+     * @returns
+     *   0 on success, otherwise error.
+     */
+    int readCapture();
+
+    int start(EventQueue *queue, Callback<void(int)> done) override;
+
+    bool busy() const override { return _state != DHT_IDLE; }
+
+    int minIntervalMs() const override { return Traits::MIN_INTERVAL_MS; }
  
 private:
-    /// percentage of humidity
-    int _humidity;
-    /// celsius
-    int _temperature;
     /// pin to read the sensor info on
     DigitalInOut _pin;
-    /// times startup (must settle for at least a second)
-    Timer _timer;
+    /// falling edge interrupt on the same pin, used by readCapture()
+    InterruptIn _edge;
+    /// time of each captured falling edge (us since the frame started)
+    uint32_t _edges[DHTLIB_EDGES];
+    /// number of edges captured, -1 until the sensor's response edge passed
+    volatile int _edgeCount;
+    /// timebase for _edges
+    Timer _frame;
+
+    /// progress of a read started with start()
+    enum State { DHT_IDLE, DHT_SETTLING, DHT_START, DHT_CAPTURE };
+    State _state;
+    EventQueue *_queue;
+    Callback<void(int)> _done;
+
+    /// start() steps, run on _queue
+    void startSignal();
+    void releaseBus();
+    void finishRead();
+    /// schedule the next step, completing with an error if _queue is full
+    void schedule(int ms, void (DHT::*step)());
+    void complete(int status);
+
+    /// falling edge handler, interrupt context
+    void edgeFall();
+    /// turn the captured edges into _values
+    int decode();
+    /// sleep until the sensor has settled after startup
+    void settle();
+    /// times startup (must settle for at least a second), low power so it
+    /// does not keep the MCU out of deep sleep
+    LowPowerTimer _timer;
 };
+
+typedef DHT<DHT11Traits> DHT11;
+typedef DHT<DHT22Traits> DHT22;
+typedef DHT22 AM2302;
+
+// the models are compiled once, in DHT.cpp
+extern template class DHT<DHT11Traits>;
+extern template class DHT<DHT22Traits>;
  
 #endif
\ No newline at end of file
@@ -0,0 +1,57 @@
+// Alarm rules for the CSE321 climate alarm, see alarm.h
+
+#include "alarm.h"
+
+// _since value of a rule that has not changed state yet, so no dwell applies
+static const uint32_t NEVER = UINT32_MAX;
+
+AlarmEngine::AlarmEngine() {
+    _count = 0;
+    _activeCount = 0;
+}
+
+bool AlarmEngine::validBand(const AlarmRule &rule, int on, int off) {
+    if (rule.quantity >= ALARM_QUANTITIES) return false;
+    if (on < INT16_MIN || on > INT16_MAX || off < INT16_MIN || off > INT16_MAX) return false;
+    return rule.direction == ALARM_ABOVE ? off <= on : off >= on;
+}
+
+int AlarmEngine::add(const AlarmRule &rule) {
+    if (_count == ALARM_MAX_RULES || !validBand(rule, rule.on, rule.off)) return -1;
+    _rules[_count] = rule;
+    _active[_count] = false;
+    _since[_count] = NEVER;
+    return _count++;
+}
+
+bool AlarmEngine::setThresholds(int i, int on, int off) {
+    if (i < 0 || i >= _count || !validBand(_rules[i], on, off)) return false;
+    _rules[i].on = on;
+    _rules[i].off = off;
+    return true;
+}
+
+bool AlarmEngine::evaluate(const AlarmInput &input) {
+    _activeCount = 0;
+    for (int i = 0; i < _count; i++) {
+        const AlarmRule &rule = _rules[i];
+        int value = input.value[rule.quantity];
+        uint32_t held = _since[i] == NEVER ? NEVER : input.time - _since[i];
+
+        // past the band edge for the opposite state, and held long enough
+        bool change;
+        if (_active[i]) {
+            bool clear = rule.direction == ALARM_ABOVE ? value <= rule.off : value >= rule.off;
+            change = clear && held >= rule.minOn;
+        } else {
+            bool trip = rule.direction == ALARM_ABOVE ? value > rule.on : value < rule.on;
+            change = trip && held >= rule.minOff;
+        }
+        if (change) {
+            _active[i] = !_active[i];
+            _since[i] = input.time;
+        }
+        if (_active[i]) _activeCount++;
+    }
+    return _activeCount > 0;
+}
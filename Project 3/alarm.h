@@ -0,0 +1,139 @@
+// Alarm rules for the CSE321 climate alarm
+//
+// A small table of threshold rules evaluated on every sample. Each rule has
+// a hysteresis band and minimum on/off times, so a reading that jitters
+// around a threshold can not chatter the motor. Integer arithmetic only.
+
+#ifndef ALARM_H
+#define ALARM_H
+
+#include "mbed.h"
+#include "history.h"
+
+// most rules one engine can hold
+#define ALARM_MAX_RULES 8
+
+// shortest stretch of history a rate is computed over (s); shorter spans
+// would turn one step of the DHT11's 1 degree resolution into a huge rate
+#define ALARM_RATE_MIN_SPAN_S 30
+
+/** What a rule looks at. */
+enum AlarmQuantity {
+    ALARM_TEMPERATURE,      ///< tenths of a degree Celsius
+    ALARM_HUMIDITY,         ///< percent
+    ALARM_TEMPERATURE_RATE, ///< tenths of a degree Celsius per minute
+    ALARM_HUMIDITY_RATE,    ///< tenths of a percent per minute
+    ALARM_QUANTITIES
+};
+
+/** Which side of the threshold is the alarm. */
+enum AlarmDirection {
+    ALARM_ABOVE, ///< on when the value rises past on, off once it is back to off or below
+    ALARM_BELOW, ///< on when the value falls past on, off once it is back to off or above
+};
+
+/** One rule. For ALARM_ABOVE off must not be above on, for ALARM_BELOW not below it. */
+struct AlarmRule {
+    uint8_t quantity;  ///< AlarmQuantity
+    uint8_t direction; ///< AlarmDirection
+    int16_t on;        ///< threshold that turns the rule on
+    int16_t off;       ///< threshold that turns it off again
+    uint16_t minOn;    ///< seconds the rule stays on at least
+    uint16_t minOff;   ///< seconds the rule stays off at least
+};
+
+/** Latest sample and rates, in the units of AlarmQuantity. */
+struct AlarmInput {
+    uint32_t time; ///< seconds since boot
+    int value[ALARM_QUANTITIES];
+};
+
+/** Class that turns samples into an alarm state.
+ *
+ * The alarm is on while any rule is on. update() costs O(rules) and the
+ * thresholds can be changed at any time between two updates.
+ *
+ * Example:
+ * @code
+ * AlarmEngine alarm;
+ *
+ * // on above 22.2 C, off again at 21.2 C, at least 10 s in either state
+ * alarm.add({ALARM_TEMPERATURE, ALARM_ABOVE, 222, 212, 10, 10});
+ *
+ * history.add(now_s, sensor.getCelsiusTenths(), sensor.getHumidity());
+ * motor = alarm.update(history);
+ * @endcode
+ */
+class AlarmEngine
+{
+public:
+    AlarmEngine();
+
+    /** Append a rule, initially off.
+     *
+     * @returns
+     *   index of the rule, -1 if the table is full or the rule is invalid.
+     */
+    int add(const AlarmRule &rule);
+
+    /** Change the thresholds of rule i, keeping its state.
+     *
+     * @returns
+     *   true on success, false if i or the band is invalid.
+     */
+    bool setThresholds(int i, int on, int off);
+
+    /** Number of rules. */
+    int count() const { return _count; }
+
+    /** Rule i. */
+    const AlarmRule &rule(int i) const { return _rules[i]; }
+
+    /** Whether rule i is on. */
+    bool active(int i) const { return _active[i]; }
+
+    /** Whether any rule is on. */
+    bool active() const { return _activeCount > 0; }
+
+    /** Evaluate every rule on one sample.
+     *
+     * @returns
+     *   whether any rule is on afterwards.
+     */
+    bool evaluate(const AlarmInput &input);
+
+    /** Evaluate every rule on the newest sample of history, with rates taken
+     *  over its 1 minute window.
+     */
+    template <unsigned N> bool update(const SensorHistory<N> &history) {
+        if (history.size() == 0) {
+            return active();
+        }
+        const DHTSample &now = history.at(0);
+        const DHTSample &then = history.at(history.recent() ? history.recent() - 1 : 0);
+        int span = now.time - then.time;
+
+        AlarmInput input;
+        input.time = now.time;
+        input.value[ALARM_TEMPERATURE] = now.temperature;
+        input.value[ALARM_HUMIDITY] = now.humidity;
+        input.value[ALARM_TEMPERATURE_RATE] = 0;
+        input.value[ALARM_HUMIDITY_RATE] = 0;
+        if (span >= ALARM_RATE_MIN_SPAN_S) {
+            input.value[ALARM_TEMPERATURE_RATE] = (now.temperature - then.temperature) * 60 / span;
+            input.value[ALARM_HUMIDITY_RATE] = (now.humidity - then.humidity) * 600 / span;
+        }
+        return evaluate(input);
+    }
+
+private:
+    static bool validBand(const AlarmRule &rule, int on, int off);
+
+    AlarmRule _rules[ALARM_MAX_RULES];
+    bool _active[ALARM_MAX_RULES];
+    uint32_t _since[ALARM_MAX_RULES]; // time of the last change of rule i
+    int _count;
+    int _activeCount;
+};
+
+#endif
@@ -0,0 +1,114 @@
+// Deferred binary log for the CSE321 projects, see binlog.h
+
+#include "binlog.h"
+
+BinLog::BinLog() : _head(0), _tail(0), _dropped(0), _ready(0, 1), _out(nullptr), _tx(nullptr),
+                   _thread(osPriorityLow, BINLOG_STACK_SIZE, nullptr, "binlog") {
+    // slot i is free for position i
+    for (uint32_t i = 0; i < BINLOG_SLOTS; i++) {
+        _slots[i].seq.store(i, std::memory_order_relaxed);
+    }
+}
+
+void BinLog::start(UnbufferedSerial *out) {
+    _out = out;
+    begin();
+}
+
+void BinLog::start(SerialTx *out) {
+    _tx = out;
+    begin();
+}
+
+void BinLog::begin() {
+    // enable the DWT cycle counter
+    CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+    DWT->CYCCNT = 0;
+    DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+    _thread.start(callback(this, &BinLog::drain));
+}
+
+// Bounded ring after Vyukov: a slot whose seq equals the position being
+// claimed is free, seq == position + 1 means it holds a finished entry, and
+// the drain thread hands it back with seq == position + BINLOG_SLOTS.
+void BinLog::write(int id, int argc, const int32_t *args) {
+    uint32_t pos = _head.load(std::memory_order_relaxed);
+    Slot *slot;
+    for (;;) {
+        slot = &_slots[pos % BINLOG_SLOTS];
+        int32_t diff = (int32_t)(slot->seq.load(std::memory_order_acquire) - pos);
+        if (diff == 0) {
+            if (_head.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                break;
+            }
+        } else if (diff < 0) {
+            // the drain thread has not sent this slot yet: full
+            _dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        } else {
+            pos = _head.load(std::memory_order_relaxed);
+        }
+    }
+
+    slot->cycles = DWT->CYCCNT;
+    slot->id = id;
+    slot->argc = argc;
+    for (int i = 0; i < argc; i++) {
+        slot->args[i] = args[i];
+    }
+    slot->seq.store(pos + 1, std::memory_order_release);
+
+    // wake the drain thread only when the ring was empty, it sends
+    // everything that arrives while it runs
+    if (pos == _tail) {
+        _ready.release();
+    }
+}
+
+// Send the oldest finished entry, false if there is none.
+bool BinLog::send() {
+    Slot &slot = _slots[_tail % BINLOG_SLOTS];
+    if (slot.seq.load(std::memory_order_acquire) != _tail + 1) {
+        return false;
+    }
+
+    uint8_t frame[7 + 4 * BINLOG_MAX_ARGS + 1];
+    int n = 0;
+    frame[n++] = BINLOG_SYNC;
+    frame[n++] = slot.id;
+    frame[n++] = slot.argc;
+    for (int b = 0; b < 32; b += 8) {
+        frame[n++] = slot.cycles >> b;
+    }
+    for (int i = 0; i < slot.argc; i++) {
+        for (int b = 0; b < 32; b += 8) {
+            frame[n++] = (uint32_t)slot.args[i] >> b;
+        }
+    }
+    slot.seq.store(_tail + BINLOG_SLOTS, std::memory_order_release);
+    _tail++;
+
+    uint8_t sum = 0;
+    for (int i = 1; i < n; i++) {
+        sum += frame[i];
+    }
+    frame[n++] = -sum;
+    if (_tx) {
+        while (_tx->space() < (size_t)n) {
+            thread_sleep_for(BINLOG_RETRY_MS);
+        }
+        _tx->write(frame, n);
+    } else {
+        _out->write(frame, n);
+    }
+    return true;
+}
+
+void BinLog::drain() {
+    while (true) {
+        while (send()) {
+        }
+        _ready.acquire();
+    }
+}
@@ -0,0 +1,126 @@
+// Deferred binary log for the CSE321 projects
+//
+// Records a format id, its raw arguments and a DWT cycle stamp into a ring,
+// and leaves the formatting to a low priority thread and the host. Safe to
+// call from interrupts: no locks, no printf, a few tens of cycles per entry.
+
+#ifndef BINLOG_H
+#define BINLOG_H
+
+#include "mbed.h"
+#include "binlog_formats.h"
+#include "serialtx.h"
+#include <atomic>
+
+// entries the ring holds, a power of two
+#define BINLOG_SLOTS 32
+
+// most arguments one entry carries
+#define BINLOG_MAX_ARGS 3
+
+// first byte of every frame on the UART, see BinLog
+#define BINLOG_SYNC 0xA5
+
+// stack of the drain thread (bytes)
+#define BINLOG_STACK_SIZE 1024
+
+// how long the drain thread waits for room in a SerialTx (ms)
+#define BINLOG_RETRY_MS 10
+
+/** Ids of the formats in binlog_formats.h. */
+enum BinLogFormat {
+#define BINLOG_ID(id, argc, format) id,
+    BINLOG_FORMATS(BINLOG_ID)
+#undef BINLOG_ID
+    BINLOG_FORMAT_COUNT
+};
+
+/** Argument count of every format, checked when a call is compiled. */
+constexpr uint8_t binlogArgc[] = {
+#define BINLOG_ARGC(id, argc, format) argc,
+    BINLOG_FORMATS(BINLOG_ARGC)
+#undef BINLOG_ARGC
+};
+
+/** Class for a deferred binary log.
+ *
+ * log() claims a slot with a compare-and-swap and fills it in, so any
+ * thread or interrupt may log, even one that interrupted another log().
+ * When the ring is full new entries are dropped and counted.
+ *
+ * The drain thread sends each entry as one frame:
+ *
+ *     BINLOG_SYNC, id, argc, cycles (4 bytes), argc * 4 byte arguments, check
+ *
+ * with multi-byte fields little endian and check the two's complement of the
+ * sum of the bytes after BINLOG_SYNC. Frames share the UART with ordinary
+ * printf text; host/logdecode turns them back into text and passes the rest
+ * through. When something else queues text on the UART from its transmit
+ * interrupt, start the log on that SerialTx instead, so frames and text take
+ * turns; the drain thread then waits for room rather than dropping a frame.
+ * The cycle counter pauses while the core sleeps, so the stamps time bursts
+ * of activity rather than wall time.
+ *
+ * Example:
+ * @code
+ * UnbufferedSerial console(USBTX, USBRX, 9600);
+ * BinLog logger;
+ *
+ * void isr() { logger.log<LOG_KEY_FOUND>('1'); }
+ *
+ * int main() {
+ *     logger.start(&console);
+ *     ...
+ * }
+ * @endcode
+ */
+class BinLog
+{
+public:
+    BinLog();
+
+    /** Start the cycle counter and the low priority thread that drains the ring.
+     *
+     * @param out  where frames are written
+     */
+    void start(UnbufferedSerial *out);
+
+    /** Start, queueing frames on a SerialTx shared with other output. */
+    void start(SerialTx *out);
+
+    /** Log format ID with its arguments, which must match its argument count. */
+    template <BinLogFormat ID, typename... A> void log(A... args) {
+        static_assert(sizeof...(A) == binlogArgc[ID], "argument count does not match binlog_formats.h");
+        static_assert(sizeof...(A) <= BINLOG_MAX_ARGS, "too many arguments for BINLOG_MAX_ARGS");
+        const int32_t values[] = {(int32_t)args..., 0};
+        write(ID, sizeof...(A), values);
+    }
+
+    /** Entries lost because the ring was full. */
+    uint32_t dropped() const { return _dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Slot {
+        std::atomic<uint32_t> seq; // position this slot is ready for, see write()
+        uint32_t cycles;
+        uint8_t id;
+        uint8_t argc;
+        int32_t args[BINLOG_MAX_ARGS];
+    };
+
+    void write(int id, int argc, const int32_t *args);
+    void begin();
+    bool send();
+    void drain();
+
+    Slot _slots[BINLOG_SLOTS];
+    std::atomic<uint32_t> _head; // next position to claim
+    uint32_t _tail;              // next position to send, drain thread only
+    std::atomic<uint32_t> _dropped;
+    Semaphore _ready;
+    UnbufferedSerial *_out;
+    SerialTx *_tx;               // used instead of _out when set
+    Thread _thread;
+};
+
+#endif
@@ -0,0 +1,42 @@
+// Format table of the CSE321 binary log
+//
+// Shared by Project 2, Project 3 and the host decoder (host/logdecode.cpp):
+// the firmware only ever sees the ids and argument counts, the strings are
+// used by the decoder alone. Append new entries at the end so logs from
+// older firmware still decode.
+//
+// X(id, argument count, format)
+//
+// Formats take %d, %u, %x and %c like printf, plus %t for a number in
+// tenths, printed with one decimal (e.g. 724 as 72.4).
+
+#ifndef BINLOG_FORMATS_H
+#define BINLOG_FORMATS_H
+
+#define BINLOG_FORMATS(X)                                                   \
+    /* Project 2 keypad timer */                                            \
+    X(LOG_KEY_FOUND,        1, "found %c")                                  \
+    X(LOG_TIMER_NEW,        0, "setting new timer...")                      \
+    X(LOG_TIMER_START,      0, "starting timer...")                         \
+    X(LOG_TIMER_PAUSE,      0, "pausing timer...")                          \
+    /* Project 3 climate alarm */                                           \
+    X(LOG_UNIT_CELSIUS,     0, "Temperature unit is now Celsius.")          \
+    X(LOG_UNIT_FAHRENHEIT,  0, "Temperature unit is now Fahrenheit.")       \
+    X(LOG_READING,          3, "T(%c): %t, H: %d")                          \
+    X(LOG_LCD_TRAFFIC,      2, "LCD: %u transactions, %u bytes")            \
+    /* Project 2 key queue */                                               \
+    X(LOG_KEY_RELEASED,     2, "released %c after %u ms")                   \
+    X(LOG_KEY_DROPPED,      1, "keypad: %u events dropped")                 \
+    /* Project 3 console, older firmware: units left out */                 \
+    X(LOG_THRESHOLDS,       3, "alarm rule %d: on at %d, off at %d")        \
+    /* Project 3 console, one entry per quantity, in its unit */            \
+    X(LOG_THRESHOLDS_HUMIDITY, 3,                                           \
+      "alarm rule %d: on at %d %%, off at %d %%")                           \
+    X(LOG_THRESHOLDS_TEMPERATURE_RATE, 3,                                   \
+      "alarm rule %d: on at %t C/min, off at %t C/min")                     \
+    X(LOG_THRESHOLDS_HUMIDITY_RATE, 3,                                      \
+      "alarm rule %d: on at %t %%/min, off at %t %%/min")                   \
+    X(LOG_THRESHOLDS_TEMPERATURE, 3,                                        \
+      "alarm rule %d: on at %t C, off at %t C")
+
+#endif
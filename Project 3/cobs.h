@@ -0,0 +1,61 @@
+// COBS framing for the CSE321 climate alarm
+//
+// Consistent Overhead Byte Stuffing: rewrites a packet so it holds no zero
+// bytes, at a cost of one byte per 254, which leaves 0x00 free to mark where
+// packets start and end on the wire. Shared by the firmware and the host
+// tools; no mbed, no allocation.
+
+#ifndef COBS_H
+#define COBS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** Most bytes cobsEncode() writes for length bytes in. */
+constexpr size_t cobsMaxLength(size_t length) { return length + length / 254 + 1; }
+
+/** Encode length bytes into out, which holds cobsMaxLength(length).
+ *
+ * @returns bytes written, none of them zero
+ */
+inline size_t cobsEncode(const uint8_t *in, size_t length, uint8_t *out) {
+    size_t code = 0; // where the length of the current block goes
+    size_t n = 1;
+    uint8_t run = 1;
+    for (size_t i = 0; i < length; i++) {
+        if (in[i]) {
+            out[n++] = in[i];
+            run++;
+        }
+        if (!in[i] || run == 0xFF) {
+            out[code] = run;
+            code = n++;
+            run = 1;
+        }
+    }
+    out[code] = run;
+    return n;
+}
+
+/** Decode length bytes (one packet, without its delimiters) into out, which
+ *  holds length bytes.
+ *
+ * @returns bytes written, or -1 if in is not COBS
+ */
+inline int cobsDecode(const uint8_t *in, size_t length, uint8_t *out) {
+    size_t n = 0;
+    size_t i = 0;
+    while (i < length) {
+        uint8_t run = in[i++];
+        if (!run || i + run - 1 > length) return -1;
+        for (uint8_t j = 1; j < run; j++) {
+            if (!in[i]) return -1;
+            out[n++] = in[i++];
+        }
+        // a short block stands for a zero, except at the very end
+        if (run != 0xFF && i < length) out[n++] = 0;
+    }
+    return (int)n;
+}
+
+#endif
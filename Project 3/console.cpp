@@ -0,0 +1,197 @@
+// Serial command console for the CSE321 climate alarm, see console.h
+
+#include "console.h"
+#include "metrics.h"
+#include <stdarg.h>
+#include <string.h>
+
+static_assert((CONSOLE_RX_SIZE & (CONSOLE_RX_SIZE - 1)) == 0, "CONSOLE_RX_SIZE must be a power of two");
+
+Console::Console(UnbufferedSerial *serial, SerialTx *out, EventQueue *queue,
+                 const ConsoleCommand *commands, int count)
+    : _serial(serial), _out(out), _queue(queue), _commands(commands), _count(count),
+      _rxHead(0), _rxTail(0), _posted(false), _overruns(0), _text(true), _length(0), _overlong(false),
+      _cr(false), _stream(nullptr), _streamLine(0) {}
+
+void Console::start(bool text) {
+    _text = text;
+    _serial->attach(callback(this, &Console::rxIrq), SerialBase::RxIrq);
+}
+
+// Byte received: queue it, and post one poll() for everything that arrives
+// before it runs.
+void Console::rxIrq() {
+    char c;
+    while (_serial->readable() && _serial->read(&c, 1) == 1) {
+        uint32_t head = _rxHead.load(std::memory_order_relaxed);
+        if (head - _rxTail.load(std::memory_order_acquire) == CONSOLE_RX_SIZE) {
+            _overruns++;
+            continue;
+        }
+        _rx[head & (CONSOLE_RX_SIZE - 1)] = c;
+        _rxHead.store(head + 1, std::memory_order_release);
+    }
+    if (!_posted.exchange(true)) {
+        if (QueueMetrics::call(_queue, callback(this, &Console::poll)) == 0) {
+            // queue full, the next byte tries again
+            _posted = false;
+        }
+    }
+}
+
+void Console::poll() {
+    // cleared first: a byte that arrives from here on posts another poll
+    _posted = false;
+
+    uint32_t tail = _rxTail.load(std::memory_order_relaxed);
+    while (tail != _rxHead.load(std::memory_order_acquire)) {
+        char c = _rx[tail & (CONSOLE_RX_SIZE - 1)];
+        _rxTail.store(++tail, std::memory_order_release);
+
+        if (c == '\r' || c == '\n') {
+            // CR LF from a terminal ends one line, not two
+            if (c == '\n' && _cr) {
+                _cr = false;
+                continue;
+            }
+            _cr = c == '\r';
+            if (_text) {
+                _out->write("\r\n", 2);
+            }
+            if (_length || _overlong) {
+                execute();
+            }
+            _length = 0;
+            _overlong = false;
+            continue;
+        }
+        _cr = false;
+
+        if (c == '\b' || c == 0x7F) {
+            if (_length) {
+                _length--;
+                if (_text) {
+                    _out->write("\b \b", 3);
+                }
+            }
+        } else if (c >= ' ' && c < 0x7F) {
+            if (_length < CONSOLE_LINE - 1) {
+                _line[_length++] = c;
+                if (_text) {
+                    _out->write(&c, 1);
+                }
+            } else {
+                _overlong = true;
+            }
+        }
+    }
+}
+
+// Split the line into words in place and run its command.
+void Console::execute() {
+    if (_overlong) {
+        print("line too long, at most %d characters", CONSOLE_LINE - 1);
+        return;
+    }
+    _line[_length] = '\0';
+
+    char *argv[CONSOLE_MAX_ARGS];
+    int argc = 0;
+    char *p = _line;
+    while (true) {
+        while (*p == ' ') {
+            p++;
+        }
+        if (*p == '\0') {
+            break;
+        }
+        if (argc == CONSOLE_MAX_ARGS) {
+            print("too many arguments");
+            return;
+        }
+        argv[argc++] = p;
+        while (*p != '\0' && *p != ' ') {
+            p++;
+        }
+        if (*p != '\0') {
+            *p++ = '\0';
+        }
+    }
+    if (argc == 0) {
+        return;
+    }
+
+    if (strcmp(argv[0], "help") == 0) {
+        stream(callback(this, &Console::helpLine));
+        return;
+    }
+    for (int i = 0; i < _count; i++) {
+        if (strcmp(argv[0], _commands[i].name) == 0) {
+            _commands[i].run(argc, argv);
+            return;
+        }
+    }
+    print("unknown command %s, try help", argv[0]);
+}
+
+bool Console::print(const char *format, ...) {
+    if (!_text) {
+        return false;
+    }
+    char text[CONSOLE_OUT_LINE + 2];
+    va_list args;
+    va_start(args, format);
+    int n = vsnprintf(text, CONSOLE_OUT_LINE + 1, format, args);
+    va_end(args);
+    if (n < 0) {
+        n = 0;
+    } else if (n > CONSOLE_OUT_LINE) {
+        n = CONSOLE_OUT_LINE;
+    }
+    text[n++] = '\r';
+    text[n++] = '\n';
+    return _out->write(text, n);
+}
+
+bool Console::stream(Callback<bool(int)> line) {
+    if (!_text) {
+        return false;
+    }
+    if (_stream) {
+        print("busy, try again");
+        return false;
+    }
+    _stream = line;
+    _streamLine = 0;
+    pump();
+    return true;
+}
+
+// Send lines of the reply while a whole one fits, then come back later.
+void Console::pump() {
+    while (_stream) {
+        if (_out->space() < CONSOLE_OUT_LINE + 2) {
+            if (QueueMetrics::call_in(_queue, std::chrono::milliseconds(CONSOLE_RETRY_MS),
+                                      callback(this, &Console::pump)) == 0) {
+                // queue full, give the reply up rather than wedge the console
+                _stream = nullptr;
+            }
+            return;
+        }
+        if (!_stream(_streamLine++)) {
+            _stream = nullptr;
+        }
+    }
+}
+
+bool Console::helpLine(int i) {
+    if (i < _count) {
+        print("%-10s %s", _commands[i].name, _commands[i].usage);
+        return true;
+    }
+    if (i == _count) {
+        print("%-10s %s", "help", "list the commands");
+        return true;
+    }
+    return false;
+}
@@ -0,0 +1,123 @@
+// Serial command console for the CSE321 climate alarm
+//
+// Takes command lines on the console UART without ever holding up the
+// sensor or the alarm: the receive interrupt only queues bytes, the
+// eventqueue assembles them into a fixed line buffer and runs the command,
+// and replies are queued on a SerialTx, long ones paced to the room it has.
+
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include "mbed.h"
+#include "serialtx.h"
+#include <atomic>
+
+// received bytes waiting for the eventqueue, a power of two
+#define CONSOLE_RX_SIZE 64
+
+// longest command line, the terminator included; longer lines are refused
+#define CONSOLE_LINE 48
+
+// most words in one command, its name included
+#define CONSOLE_MAX_ARGS 4
+
+// longest line print() sends, without its CR LF
+#define CONSOLE_OUT_LINE 160
+
+// how long a paced reply waits for the SerialTx to drain (ms)
+#define CONSOLE_RETRY_MS 20
+
+/** One entry of the command table given to Console. */
+struct ConsoleCommand {
+    const char *name;
+    const char *usage;                  ///< arguments and what it does, for help
+    void (*run)(int argc, char **argv); ///< argv[0] is the name
+};
+
+/** Class for a line console on an UnbufferedSerial.
+ *
+ * The receive interrupt moves bytes into a ring and posts one poll to the
+ * eventqueue, which echoes them, edits the line (backspace works) and on
+ * CR or LF splits it into words and runs the matching command. Bytes that
+ * arrive while the ring is full are lost and counted. Commands run on the
+ * eventqueue like any other event, so they must not block either: short
+ * replies go through print(), which drops a line the SerialTx has no room
+ * for, and long ones through stream(), which asks for one line at a time
+ * whenever there is room for it. help is built in.
+ *
+ * Example:
+ * @code
+ * void ping(int argc, char **argv) { shell.print("pong"); }
+ *
+ * const ConsoleCommand commands[] = {{"ping", "answer pong", ping}};
+ * SerialTx consoleTx(&console);
+ * Console shell(&console, &consoleTx, &e, commands, 1);
+ *
+ * int main() {
+ *     shell.start();
+ *     e.dispatch_forever();
+ * }
+ * @endcode
+ */
+class Console
+{
+public:
+    Console(UnbufferedSerial *serial, SerialTx *out, EventQueue *queue,
+            const ConsoleCommand *commands, int count);
+
+    /** Attach the receive interrupt.
+     *
+     * @param text false to run commands without echo or replies, for a UART
+     *             that carries something else (print() and stream() then
+     *             send nothing and return false)
+     */
+    void start(bool text = true);
+
+    /** Queue one formatted line and its CR LF, cut at CONSOLE_OUT_LINE.
+     *
+     * @returns false if the SerialTx had no room for it
+     */
+    bool print(const char *format, ...);
+
+    /** Send a long reply: line(0), line(1), ... are called on the eventqueue
+     *  whenever the SerialTx has room for a whole line, each printing at most
+     *  one, until one returns false.
+     *
+     * @returns false, and says so on the console, if another reply is still
+     *          being sent
+     */
+    bool stream(Callback<bool(int)> line);
+
+    /** Received bytes lost because the ring was full. */
+    uint32_t overruns() const { return _overruns; }
+
+private:
+    void rxIrq();
+    void poll();
+    void execute();
+    void pump();
+    bool helpLine(int i);
+
+    UnbufferedSerial *_serial;
+    SerialTx *_out;
+    EventQueue *_queue;
+    const ConsoleCommand *_commands;
+    int _count;
+
+    uint8_t _rx[CONSOLE_RX_SIZE];
+    std::atomic<uint32_t> _rxHead; // next byte to store, interrupt only
+    std::atomic<uint32_t> _rxTail; // next byte to take, eventqueue only
+    std::atomic<bool> _posted;     // a poll() is waiting on the eventqueue
+    uint32_t _overruns;
+    bool _text;                    // echo and replies go out
+
+    char _line[CONSOLE_LINE];
+    size_t _length;
+    bool _overlong;                // the line outgrew _line, refuse it at its end
+    bool _cr;                      // the last byte was a CR, an LF right after it is part of it
+
+    Callback<bool(int)> _stream;   // reply being sent, null if none
+    int _streamLine;               // its next line
+};
+
+#endif
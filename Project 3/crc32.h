@@ -0,0 +1,25 @@
+// CRC-32 for the CSE321 climate alarm
+//
+// IEEE 802.3 (reflected, as zlib computes it), bit by bit. Shared by the
+// firmware and the host tools; no mbed, no tables.
+
+#ifndef CRC32_H
+#define CRC32_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/** CRC-32 of length bytes, continuing from crc (0 to start). */
+inline uint32_t crc32(const void *data, size_t length, uint32_t crc = 0) {
+    const uint8_t *p = (const uint8_t *)data;
+    crc = ~crc;
+    while (length--) {
+        crc ^= *p++;
+        for (int b = 0; b < 8; b++) {
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+        }
+    }
+    return ~crc;
+}
+
+#endif
@@ -0,0 +1,106 @@
+// Bounded text formatting for the CSE321 LCD
+//
+// Writes fixed-width text, integer and fixed-point fields straight into a
+// line buffer. Nothing allocates, nothing uses printf, and every field
+// position is checked against the line width at compile time.
+
+#ifndef FORMAT_H
+#define FORMAT_H
+
+#include <stdint.h>
+#include <string.h>
+
+/** One line of W characters, space padded and always NUL terminated.
+ *
+ * Fields are placed by template arguments, so a field that would not fit on
+ * the line is a compile error rather than an overflow. Numbers are right
+ * aligned in their field; a value too wide for its field shows as '#'s.
+ *
+ * Example:
+ * @code
+ * TextLine<16> top;
+ *
+ * top.text<0>("Temp(F):");
+ * top.fixed<11, 5, 1>(724);   // "Temp(F):    72.4"
+ * display.drawText(0, 0, top.c_str());
+ * @endcode
+ */
+template <unsigned W> class TextLine {
+public:
+    TextLine() { clear(); }
+
+    /** Blank the whole line. */
+    void clear() {
+        memset(_text, ' ', W);
+        _text[W] = '\0';
+    }
+
+    /** Copy a string literal to column COL. */
+    template <unsigned COL, unsigned LEN> void text(const char (&s)[LEN]) {
+        static_assert(LEN >= 1 && COL + LEN - 1 <= W, "text runs past the end of the line");
+        memcpy(_text + COL, s, LEN - 1);
+    }
+
+    /** Right align value in WIDTH columns starting at column COL. */
+    template <unsigned COL, unsigned WIDTH> void number(int value) {
+        static_assert(WIDTH > 0 && COL + WIDTH <= W, "field runs past the end of the line");
+        put(_text + COL, WIDTH, value, 0);
+    }
+
+    /** Right align value / 10^DECIMALS with DECIMALS digits after the point,
+     *  e.g. fixed<0, 5, 1>(-35) gives " -3.5".
+     */
+    template <unsigned COL, unsigned WIDTH, unsigned DECIMALS> void fixed(int value) {
+        static_assert(COL + WIDTH <= W, "field runs past the end of the line");
+        static_assert(DECIMALS > 0 && DECIMALS + 2 <= WIDTH, "field too narrow for its decimals");
+        put(_text + COL, WIDTH, value, DECIMALS);
+    }
+
+    /** The line, exactly W characters long. */
+    const char *c_str() const { return _text; }
+
+    /** The line from column COL on, without leading spaces. */
+    template <unsigned COL> const char *from() const {
+        static_assert(COL < W, "column past the end of the line");
+        const char *p = _text + COL;
+        while (*p == ' ') {
+            p++;
+        }
+        return p;
+    }
+
+    static constexpr unsigned width() { return W; }
+
+private:
+    // Write digits from the right end of the field towards the left, then
+    // the sign, and fill the rest with spaces (or '#' if it did not fit).
+    static void put(char *field, unsigned width, int value, unsigned decimals) {
+        uint32_t magnitude = value < 0 ? 0u - (uint32_t)value : (uint32_t)value;
+        int i = width - 1;
+        unsigned digits = 0;
+        do {
+            if (digits == decimals && decimals != 0) {
+                field[i--] = '.';
+            }
+            field[i--] = '0' + magnitude % 10;
+            magnitude /= 10;
+            digits++;
+        } while (i >= 0 && (magnitude != 0 || digits <= decimals));
+
+        bool fits = magnitude == 0 && digits > decimals && (value >= 0 || i >= 0);
+        if (!fits) {
+            memset(field, '#', width);
+            return;
+        }
+        if (value < 0) {
+            field[i--] = '-';
+        }
+        while (i >= 0) {
+            field[i--] = ' ';
+        }
+    }
+
+    char _text[W + 1];
+};
+
+#endif
@@ -0,0 +1,206 @@
+// Sensor history for the CSE321 climate alarm
+//
+// Fixed-capacity record of timestamped DHT11 samples with running statistics.
+// Nothing here allocates; the storage is part of the object.
+
+#ifndef HISTORY_H
+#define HISTORY_H
+
+#include "mbed.h"
+
+/** One sensor reading as kept by SensorHistory. */
+struct DHTSample {
+    uint32_t time;       ///< seconds since boot
+    int16_t temperature; ///< tenths of a degree Celsius
+    uint8_t humidity;    ///< percent
+};
+
+/** Sums over a set of samples, enough for a mean. */
+struct HistoryMean {
+    uint32_t count;
+    int32_t temperature; ///< sum, tenths of a degree Celsius
+    uint32_t humidity;   ///< sum, percent
+
+    void add(const DHTSample &s) {
+        count++;
+        temperature += s.temperature;
+        humidity += s.humidity;
+    }
+    void remove(const DHTSample &s) {
+        count--;
+        temperature -= s.temperature;
+        humidity -= s.humidity;
+    }
+    void add(const HistoryMean &m) {
+        count += m.count;
+        temperature += m.temperature;
+        humidity += m.humidity;
+    }
+    void remove(const HistoryMean &m) {
+        count -= m.count;
+        temperature -= m.temperature;
+        humidity -= m.humidity;
+    }
+
+    /** Mean temperature in tenths of a degree Celsius, 0 without samples. */
+    int meanTemperature() const { return count ? temperature / (int32_t)count : 0; }
+    /** Mean humidity in tenths of a percent, 0 without samples. */
+    int meanHumidity() const { return count ? humidity * 10 / count : 0; }
+};
+
+/** Count, extremes and mean of every sample since the last reset(). */
+struct HistoryStats {
+    HistoryMean sum;
+    int16_t minTemperature;
+    int16_t maxTemperature;
+    uint8_t minHumidity;
+    uint8_t maxHumidity;
+};
+
+/** Moving average windows kept by SensorHistory. */
+enum HistoryWindow {
+    HISTORY_1MIN,
+    HISTORY_10MIN,
+    HISTORY_1H,
+};
+
+/** Ring buffer of the last N samples plus running statistics.
+ *
+ * add() and every query are O(1). The 1 minute average is exact over the
+ * samples still in the ring (N must cover a minute of samples for that).
+ * The 10 minute and 1 hour averages are kept per calendar minute: they cover
+ * the current minute plus the 9 or 59 minutes before it, so they need no
+ * more than 60 small buckets regardless of the sample rate.
+ *
+ * Example:
+ * @code
+ * SensorHistory<64> history;
+ *
+ * history.add(now_s, sensor.getCelsius() * 10, sensor.getHumidity());
+ * int avg = history.mean(HISTORY_10MIN).meanTemperature();
+ * const DHTSample &last = history.at(0);
+ * @endcode
+ */
+template <unsigned N> class SensorHistory {
+public:
+    SensorHistory() { reset(); }
+
+    /** Drop every sample and statistic. */
+    void reset() {
+        _head = 0;
+        _count = 0;
+        _recent = 0;
+        _minute = 0;
+        memset(&_stats, 0, sizeof(_stats));
+        memset(&_lastMinute, 0, sizeof(_lastMinute));
+        memset(&_closed10, 0, sizeof(_closed10));
+        memset(&_closed60, 0, sizeof(_closed60));
+        memset(_minutes, 0, sizeof(_minutes));
+    }
+
+    /** Record a sample. Times must not go backwards.
+     *
+     * @param time         seconds since boot
+     * @param temperature  tenths of a degree Celsius
+     * @param humidity     percent
+     */
+    void add(uint32_t time, int temperature, int humidity) {
+        DHTSample s;
+        s.time = time;
+        s.temperature = temperature;
+        s.humidity = humidity;
+
+        // the oldest sample is about to be overwritten
+        if (_count == N) {
+            if (_recent == N) {
+                _lastMinute.remove(_samples[_head]);
+                _recent--;
+            }
+        } else {
+            _count++;
+        }
+        _samples[_head] = s;
+        _head = (_head + 1) % N;
+
+        // exact 1 minute window over the newest _recent samples
+        _lastMinute.add(s);
+        _recent++;
+        while (_recent > 0 && at(_recent - 1).time + 60 <= time) {
+            _lastMinute.remove(at(_recent - 1));
+            _recent--;
+        }
+
+        // per-minute buckets for the longer windows
+        advanceTo(time / 60);
+        _minutes[_minute % 60].add(s);
+
+        // lifetime statistics
+        if (_stats.sum.count == 0) {
+            _stats.minTemperature = _stats.maxTemperature = s.temperature;
+            _stats.minHumidity = _stats.maxHumidity = s.humidity;
+        }
+        if (s.temperature < _stats.minTemperature) _stats.minTemperature = s.temperature;
+        if (s.temperature > _stats.maxTemperature) _stats.maxTemperature = s.temperature;
+        if (s.humidity < _stats.minHumidity) _stats.minHumidity = s.humidity;
+        if (s.humidity > _stats.maxHumidity) _stats.maxHumidity = s.humidity;
+        _stats.sum.add(s);
+    }
+
+    /** Number of samples in the ring. */
+    unsigned size() const { return _count; }
+    static unsigned capacity() { return N; }
+
+    /** Number of the newest samples that fall inside the 1 minute window. */
+    unsigned recent() const { return _recent; }
+
+    /** Sample i, 0 being the newest. i must be less than size(). */
+    const DHTSample &at(unsigned i) const { return _samples[(_head + N - 1 - i) % N]; }
+
+    /** Lifetime count, extremes and mean. */
+    const HistoryStats &stats() const { return _stats; }
+
+    /** Sums for a moving average window, see meanTemperature()/meanHumidity(). */
+    HistoryMean mean(HistoryWindow window) const {
+        if (window == HISTORY_1MIN) return _lastMinute;
+        HistoryMean m = window == HISTORY_10MIN ? _closed10 : _closed60;
+        m.add(_minutes[_minute % 60]);
+        return m;
+    }
+
+private:
+    // Move the current minute forward, folding finished minutes into the
+    // window sums and dropping the ones that fell out. After 60 idle minutes
+    // every bucket is empty, which bounds the loop.
+    void advanceTo(uint32_t minute) {
+        if (_stats.sum.count == 0) {
+            _minute = minute;
+            return;
+        }
+        for (int steps = 0; _minute < minute && steps < 60; steps++) {
+            const HistoryMean &done = _minutes[_minute % 60];
+            _closed10.add(done);
+            _closed60.add(done);
+            _closed10.remove(_minutes[(_minute + 60 - 9) % 60]);
+            _minute++;
+            HistoryMean &next = _minutes[_minute % 60];
+            _closed60.remove(next);
+            memset(&next, 0, sizeof(next));
+        }
+        _minute = minute;
+    }
+
+    DHTSample _samples[N];
+    unsigned _head;  // next slot to write
+    unsigned _count; // samples in the ring
+    unsigned _recent; // newest samples inside the 1 minute window
+    HistoryMean _lastMinute;
+
+    uint32_t _minute;         // current minute since boot
+    HistoryMean _minutes[60]; // one bucket per minute, indexed minute % 60
+    HistoryMean _closed10;    // the 9 minutes before the current one
+    HistoryMean _closed60;    // the 59 minutes before the current one
+
+    HistoryStats _stats;
+};
+
+#endif
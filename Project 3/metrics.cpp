@@ -0,0 +1,51 @@
+// Runtime metrics for the CSE321 climate alarm, see metrics.h
+
+#include "metrics.h"
+
+EventMetrics::EventMetrics(const char *name) : _name(name) {
+    reset();
+}
+
+void EventMetrics::record(uint32_t us) {
+    // index of the highest set bit, 0 for 0 and 1
+    int bucket = 0;
+    for (uint32_t v = us >> 1; v && bucket < METRICS_BUCKETS - 1; v >>= 1) {
+        bucket++;
+    }
+
+    CriticalSectionLock lock;
+    _count++;
+    _total += us;
+    if (us > _max) _max = us;
+    _buckets[bucket]++;
+}
+
+void EventMetrics::reset() {
+    CriticalSectionLock lock;
+    _count = 0;
+    _max = 0;
+    _total = 0;
+    memset(_buckets, 0, sizeof(_buckets));
+}
+
+void EventMetrics::format(char *text, size_t size) const {
+    size_t n = snprintf(text, size, "%-14s n=%lu avg=%luus max=%luus |", _name, (unsigned long)_count,
+                        (unsigned long)mean(), (unsigned long)_max);
+    for (int i = 0; i < METRICS_BUCKETS && n < size; i++) {
+        if (_buckets[i]) {
+            // lower edge of the bucket
+            n += snprintf(text + n, size - n, " %lu:%lu", i ? 1ul << i : 0ul, (unsigned long)_buckets[i]);
+        }
+    }
+}
+
+int cpuIdlePercent() {
+#if MBED_CPU_STATS_ENABLED
+    mbed_stats_cpu_t stats;
+    mbed_stats_cpu_get(&stats);
+    if (stats.uptime == 0) return 0;
+    return (int)(stats.idle_time * 100 / stats.uptime);
+#else
+    return -1;
+#endif
+}
@@ -0,0 +1,199 @@
+// Runtime metrics for the CSE321 climate alarm
+//
+// Counters and log2 latency histograms that cost a few instructions to
+// update, for printing over the serial console when asked.
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include "mbed.h"
+
+// histogram buckets: bucket i counts latencies of [2^i, 2^(i+1)) us,
+// bucket 0 also counts 0 and the last one everything longer
+#define METRICS_BUCKETS 20
+
+// bytes an event posted through QueueMetrics::call() or call_in() takes in
+// the queue over the callback alone: the run() it is wrapped in and the
+// QueueMetrics pointer stored beside it
+#define QUEUE_METRICS_EVENT_COST (sizeof(void (*)()) + sizeof(void *))
+
+// room one such event takes in an EventQueue, to size a counted queue with
+#define QUEUE_METRICS_EVENT_SIZE (EVENTS_EVENT_SIZE + QUEUE_METRICS_EVENT_COST)
+
+/** Count, total, worst case and log2 histogram of one event's run time. */
+class EventMetrics
+{
+public:
+    /** @param name label used by format(), must outlive the object */
+    EventMetrics(const char *name);
+
+    /** Record one run that took us microseconds. Safe from an interrupt. */
+    void record(uint32_t us);
+
+    /** Zero every counter. */
+    void reset();
+
+    /** Write one line into text, cut to fit size: name, count, mean, max and
+     *  the non-empty buckets. */
+    void format(char *text, size_t size) const;
+
+    const char *name() const { return _name; }
+    uint32_t count() const { return _count; }
+    uint32_t max() const { return _max; }
+    uint32_t mean() const { return _count ? _total / _count : 0; }
+
+private:
+    const char *_name;
+    uint32_t _count;
+    uint32_t _max;
+    uint64_t _total;
+    uint32_t _buckets[METRICS_BUCKETS];
+};
+
+/** Times the enclosing scope into an EventMetrics.
+ *
+ * Example:
+ * @code
+ * void updateDisplay() {
+ *     LatencyProbe probe(displayMetrics);
+ *     ...
+ * }
+ * @endcode
+ */
+class LatencyProbe
+{
+public:
+    LatencyProbe(EventMetrics &metrics) : _metrics(metrics), _start(us_ticker_read()) {}
+    ~LatencyProbe() { _metrics.record(us_ticker_read() - _start); }
+
+private:
+    EventMetrics &_metrics;
+    uint32_t _start;
+};
+
+/** Depth of an EventQueue, counted at every post.
+ *
+ * mbed's EventQueue does not report how full it is, so every post to a
+ * counted queue goes through QueueMetrics::call(), call_in() or call_every()
+ * instead of the queue's own, and cancels through cancel(). They work on any
+ * queue; the counting happens for the one queue a QueueMetrics was made for.
+ * An event is counted from its post until it starts to run, a periodic one
+ * until it is cancelled, so the high water mark is the most events the
+ * queue has had to hold at once. A post that returns 0 did not fit.
+ *
+ * Counting a run wraps the callback, so every event costs
+ * QUEUE_METRICS_EVENT_COST more bytes of the queue; size the queue in
+ * QUEUE_METRICS_EVENT_SIZE so it still holds as many events.
+ *
+ * Example:
+ * @code
+ * EventQueue e(32 * QUEUE_METRICS_EVENT_SIZE);
+ * QueueMetrics queueMetrics(&e);
+ *
+ * void isr() { QueueMetrics::call(&e, redraw); }
+ * @endcode
+ */
+class QueueMetrics
+{
+public:
+    QueueMetrics(EventQueue *queue) : _queue(queue), _pending(0) {
+        reset();
+        _next = first();
+        first() = this;
+    }
+
+    /** Post f like queue->call(). Safe from an interrupt. */
+    static int call(EventQueue *queue, Callback<void()> f) {
+        QueueMetrics *m = of(queue);
+        int id = queue->call(&QueueMetrics::run, m, f);
+        if (m) m->posted(id);
+        return id;
+    }
+
+    /** Post f like queue->call_in(). Safe from an interrupt. */
+    static int call_in(EventQueue *queue, std::chrono::milliseconds delay, Callback<void()> f) {
+        QueueMetrics *m = of(queue);
+        int id = queue->call_in(delay, &QueueMetrics::run, m, f);
+        if (m) m->posted(id);
+        return id;
+    }
+
+    /** Post f like queue->call_every(), counted until it is cancelled. */
+    static int call_every(EventQueue *queue, std::chrono::milliseconds period, Callback<void()> f) {
+        QueueMetrics *m = of(queue);
+        int id = queue->call_every(period, f);
+        if (m) m->posted(id);
+        return id;
+    }
+
+    /** Cancel like queue->cancel(), for an event posted through the above. */
+    static bool cancel(EventQueue *queue, int id) {
+        if (!queue->cancel(id)) {
+            return false;
+        }
+        if (QueueMetrics *m = of(queue)) m->ran();
+        return true;
+    }
+
+    /** Zero the counters; events still in the queue stay counted. */
+    void reset() {
+        CriticalSectionLock lock;
+        _posts = 0;
+        _failed = 0;
+        _highWater = _pending;
+    }
+
+    uint32_t posts() const { return _posts; }
+    uint32_t failed() const { return _failed; }
+    uint32_t pending() const { return _pending; }
+    uint32_t highWater() const { return _highWater; }
+
+private:
+    void posted(int id) {
+        CriticalSectionLock lock;
+        if (id == 0) {
+            _failed++;
+            return;
+        }
+        _posts++;
+        if (++_pending > _highWater) _highWater = _pending;
+    }
+
+    void ran() {
+        CriticalSectionLock lock;
+        if (_pending) _pending--;
+    }
+
+    static void run(QueueMetrics *m, Callback<void()> f) {
+        if (m) m->ran();
+        f();
+    }
+
+    // the QueueMetrics made for queue, null if none
+    static QueueMetrics *of(EventQueue *queue) {
+        for (QueueMetrics *m = first(); m; m = m->_next) {
+            if (m->_queue == queue) return m;
+        }
+        return nullptr;
+    }
+
+    // head of the list of every QueueMetrics, here so the header needs no .cpp
+    static QueueMetrics *&first() {
+        static QueueMetrics *head = nullptr;
+        return head;
+    }
+
+    EventQueue *_queue;
+    QueueMetrics *_next;
+    uint32_t _posts;
+    uint32_t _failed;
+    uint32_t _pending;
+    uint32_t _highWater;
+};
+
+/** Percentage of the time since boot the CPU spent idle, -1 if the
+ *  platform does not collect CPU statistics (platform.cpu-stats-enabled).
+ */
+int cpuIdlePercent();
+
+#endif
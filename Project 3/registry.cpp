@@ -0,0 +1,88 @@
+// Sensor registry for the CSE321 climate alarm, see registry.h
+
+#include "registry.h"
+#include "metrics.h"
+
+DHTRegistry::DHTRegistry(EventQueue *queue) : _queue(queue) {
+    _count = 0;
+    _interval = DHT_MIN_INTERVAL_MS;
+    _next = 0;
+    _reading = -1;
+    _event = 0;
+    memset(_stats, 0, sizeof(_stats));
+}
+
+int DHTRegistry::add(DHTSensor *sensor) {
+    if (_count == DHT_MAX_SENSORS) return -1;
+    _sensors[_count] = sensor;
+    if (sensor->minIntervalMs() > _interval) _interval = sensor->minIntervalMs();
+    int index = _count++;
+    if (_event) reschedule();
+    return index;
+}
+
+void DHTRegistry::start(Callback<void(int, int)> ready) {
+    _ready = ready;
+    reschedule();
+}
+
+void DHTRegistry::stop() {
+    if (_event) QueueMetrics::cancel(_queue, _event);
+    _event = 0;
+}
+
+int32_t DHTRegistry::age(int i) const {
+    if (!_stats[i].valid) return -1;
+    uint32_t now = Kernel::Clock::now().time_since_epoch().count();
+    return now - _stats[i].lastGood;
+}
+
+void DHTRegistry::resetStats() {
+    for (int i = 0; i < _count; i++) {
+        _stats[i].reads = 0;
+        _stats[i].timeouts = 0;
+        _stats[i].checksums = 0;
+        _stats[i].skipped = 0;
+    }
+}
+
+void DHTRegistry::reschedule() {
+    stop();
+    if (_count == 0) return;
+    // one read per tick, so every sensor comes around once per interval
+    std::chrono::milliseconds period(_interval / _count);
+    _event = QueueMetrics::call_every(_queue, period, callback(this, &DHTRegistry::tick));
+}
+
+void DHTRegistry::tick() {
+    int index = _next;
+    _next = (_next + 1) % _count;
+
+    // keep to one frame at a time, the next turn comes soon enough
+    if (_reading >= 0) {
+        _stats[index].skipped++;
+        return;
+    }
+    _reading = index;
+    if (_sensors[index]->start(_queue, callback(this, &DHTRegistry::done)) != DHTLIB_OK) {
+        _reading = -1;
+        _stats[index].skipped++;
+    }
+}
+
+void DHTRegistry::done(int status) {
+    int index = _reading;
+    _reading = -1;
+
+    DHTSensorStats &st = _stats[index];
+    st.reads++;
+    if (status == DHTLIB_OK) {
+        st.lastGood = Kernel::Clock::now().time_since_epoch().count();
+        st.valid = true;
+    } else if (status == DHTLIB_ERROR_TIMEOUT) {
+        st.timeouts++;
+    } else if (status == DHTLIB_ERROR_CHECKSUM) {
+        st.checksums++;
+    }
+    if (_ready) _ready(index, status);
+}
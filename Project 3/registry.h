@@ -0,0 +1,118 @@
+// Sensor registry for the CSE321 climate alarm
+//
+// Reads any number of DHT sensors, of any model, from one EventQueue, one at
+// a time, using the non-blocking DHTSensor::start(). No thread or stack per
+// sensor.
+
+#ifndef REGISTRY_H
+#define REGISTRY_H
+
+#include "mbed.h"
+#include "DHT.h"
+
+// most sensors one registry can hold
+#define DHT_MAX_SENSORS 8
+
+// shortest time between two reads of the same sensor (ms); a sensor whose
+// model needs longer (DHTSensor::minIntervalMs()) slows the round down to it
+#define DHT_MIN_INTERVAL_MS 2000
+
+/** Read counters and freshness for one registered sensor. */
+struct DHTSensorStats {
+    uint32_t reads;     ///< reads completed, successful or not
+    uint32_t timeouts;  ///< DHTLIB_ERROR_TIMEOUT results
+    uint32_t checksums; ///< DHTLIB_ERROR_CHECKSUM results
+    uint32_t skipped;   ///< turns missed because a read was still running
+    uint32_t lastGood;  ///< Kernel::Clock time (ms) of the last good read
+    bool valid;         ///< at least one good read so far
+};
+
+/** Class that schedules reads of several DHT sensors.
+ *
+ * Reads are staggered evenly: with n sensors the registry starts one read
+ * every interval / n, round robin, so each sensor is read exactly once per
+ * interval and at most one frame is on the air at a time. The interval is
+ * DHT_MIN_INTERVAL_MS, or the longest minimum interval of the models
+ * registered.
+ *
+ * Every sensor captures its frame with an InterruptIn, so on the STM32 each
+ * one needs a different pin number (PC_8 and PB_8 share EXTI line 8).
+ *
+ * Example:
+ * @code
+ * EventQueue queue;
+ * DHT11 zone1(PC_8);
+ * DHT22 zone2(PC_6);
+ * DHTRegistry sensors(&queue);
+ *
+ * void ready(int index, int status) { ... sensors.sensor(index).getCelsius() ... }
+ *
+ * int main() {
+ *     sensors.add(&zone1);
+ *     sensors.add(&zone2);
+ *     sensors.start(ready);
+ *     queue.dispatch_forever();
+ * }
+ * @endcode
+ */
+class DHTRegistry
+{
+public:
+    /** Construct the registry.
+     *
+     * @param queue event queue that runs the reads and the callback
+     */
+    DHTRegistry(EventQueue *queue);
+
+    /** Register a sensor. The schedule adapts if reads are running.
+     *
+     * @returns
+     *   index of the sensor, -1 if DHT_MAX_SENSORS are registered.
+     */
+    int add(DHTSensor *sensor);
+
+    /** Start the schedule.
+     *
+     * @param ready called on the queue after every read with the sensor
+     *              index and the DHTLIB status
+     */
+    void start(Callback<void(int, int)> ready);
+
+    /** Stop starting new reads. */
+    void stop();
+
+    /** Number of registered sensors. */
+    int count() const { return _count; }
+
+    /** Registered sensor i. */
+    DHTSensor &sensor(int i) { return *_sensors[i]; }
+
+    /** Counters for sensor i. */
+    const DHTSensorStats &stats(int i) const { return _stats[i]; }
+
+    /** Zero the read counters of every sensor, keeping their age. */
+    void resetStats();
+
+    /** Age of the last good reading of sensor i in ms, -1 if never read. */
+    int32_t age(int i) const;
+
+private:
+    /// restart call_every() with the period for the current count
+    void reschedule();
+    /// start the next sensor's read, run on the queue
+    void tick();
+    /// completion of the read of sensor _reading
+    void done(int status);
+
+    EventQueue *_queue;
+    DHTSensor *_sensors[DHT_MAX_SENSORS];
+    DHTSensorStats _stats[DHT_MAX_SENSORS];
+    int _count;
+    int _interval; // ms between two reads of the same sensor
+    int _next;
+    int _reading; // sensor being read, -1 if none
+    int _event;
+    Callback<void(int, int)> _ready;
+};
+
+#endif
@@ -0,0 +1,360 @@
+// Delta encoding of samples for the CSE321 climate alarm
+//
+// Packs sample log records (samples, alarm changes, boots) into a byte
+// stream of a few bytes per sample: every record is stored as its change
+// from the one before, repeated changes collapse into runs, and a keyframe
+// with the full time stamp and reading opens every buffer, so each one
+// decodes on its own. The stream has no version of its own: the sample log
+// slot header and the telemetry packet that carry it have, and their
+// readers refuse versions they do not know. Pure logic: no mbed, shared
+// with the host tools.
+
+#ifndef SAMPLECODEC_H
+#define SAMPLECODEC_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// longest token: a sample carrying three 5 byte varints
+#define SAMPLECODEC_MAX_TOKEN 16
+
+// first byte of every token
+#define SAMPLECODEC_SAMPLE 0x00   // | flags below, then the varints they ask for
+#define SAMPLECODEC_RUN 0x10      // | repeats - 1 (0-15), the last sample's changes again
+#define SAMPLECODEC_ALARM 0x20    // | 0x10 when on | rule (0-15), then varint seconds since the last record
+#define SAMPLECODEC_BOOT 0x40     // then varint boot count; time and reading start over from 0
+#define SAMPLECODEC_KEYFRAME 0x7E // then time (4 bytes), temperature (2), humidity (1), little endian
+
+// SAMPLECODEC_SAMPLE flags; a change without its flag is 0, a missing gap is the last sample's gap
+#define SAMPLECODEC_GAP 0x01  // varint seconds since the last record
+#define SAMPLECODEC_TEMP 0x02 // zigzag varint change in temperature
+#define SAMPLECODEC_HUM 0x04  // zigzag varint change in humidity
+
+// bytes of a keyframe token
+#define SAMPLECODEC_KEYFRAME_SIZE 8
+
+/** What a record holds. */
+enum SampleLogType : uint8_t {
+    SAMPLELOG_BOOT = 1,   ///< firmware started, time is the boot count
+    SAMPLELOG_SAMPLE = 2, ///< a = humidity (%), b = temperature (tenths of a degree Celsius)
+    SAMPLELOG_ALARM = 3,  ///< a = alarm rule, b = 1 when it turned on, 0 when off
+};
+
+/** One record, 8 bytes unencoded. */
+struct SampleRecord {
+    uint32_t time; ///< seconds since boot (boot count for SAMPLELOG_BOOT)
+    uint8_t type;  ///< SampleLogType
+    uint8_t a;
+    int16_t b;
+};
+
+/** Class for the encoding side of the sample stream.
+ *
+ * begin() points the encoder at a buffer and opens it with a keyframe of
+ * the last record's time and the last reading; add() appends one record as
+ * the smallest token that describes it. A record that does not fit leaves
+ * the buffer as it was, so the caller can close it, begin() the next one
+ * and add the record there. The encoder keeps its state from one buffer to
+ * the next.
+ *
+ * Example:
+ * @code
+ * uint8_t slot[240];
+ * SampleEncoder encoder;
+ *
+ * encoder.begin(slot, sizeof(slot));
+ * SampleRecord r = {120, SAMPLELOG_SAMPLE, 41, 224};
+ * if (!encoder.add(r)) {
+ *     write(slot, encoder.length());
+ *     encoder.begin(slot, sizeof(slot));
+ *     encoder.add(r);
+ * }
+ * @endcode
+ */
+class SampleEncoder
+{
+public:
+    SampleEncoder() : _out(nullptr), _size(0), _length(0), _records(0), _run(-1), _time(0), _temp(0), _hum(0) {
+        _gap = _dTemp = _dHum = 0;
+    }
+
+    /** Start a new buffer with a keyframe.
+     *
+     * @returns false if the keyframe does not fit, and nothing fits then
+     */
+    bool begin(uint8_t *out, size_t size) {
+        _out = out;
+        _size = size >= SAMPLECODEC_KEYFRAME_SIZE ? size : 0;
+        _length = 0;
+        _records = 0;
+        _run = -1;
+        _gap = _dTemp = _dHum = 0;
+        if (!_size) return false;
+
+        uint8_t *p = _out;
+        *p++ = SAMPLECODEC_KEYFRAME;
+        for (int i = 0; i < 4; i++) *p++ = _time >> (8 * i);
+        *p++ = (uint16_t)_temp;
+        *p++ = (uint16_t)_temp >> 8;
+        *p++ = _hum;
+        _length = SAMPLECODEC_KEYFRAME_SIZE;
+        return true;
+    }
+
+    /** Append a record.
+     *
+     * @returns false if it does not fit, the buffer is left unchanged
+     */
+    bool add(const SampleRecord &r) {
+        uint8_t token[SAMPLECODEC_MAX_TOKEN];
+        size_t n = 0;
+        if (r.type == SAMPLELOG_SAMPLE) {
+            uint32_t gap = r.time - _time;
+            int32_t dTemp = r.b - _temp;
+            int32_t dHum = r.a - _hum;
+            if (_run >= 0 && gap == _gap && dTemp == _dTemp && dHum == _dHum) {
+                // the same changes as the sample before: grow the run, or start one
+                if ((_out[_run] & 0xF0) == SAMPLECODEC_RUN && (_out[_run] & 0x0F) < 15) {
+                    _out[_run]++;
+                    sample(r);
+                    _records++;
+                    return true;
+                }
+                token[n++] = SAMPLECODEC_RUN;
+            } else {
+                token[n++] = SAMPLECODEC_SAMPLE;
+                if (gap != _gap) {
+                    token[0] |= SAMPLECODEC_GAP;
+                    n += varint(token + n, gap);
+                }
+                if (dTemp) {
+                    token[0] |= SAMPLECODEC_TEMP;
+                    n += varint(token + n, zigzag(dTemp));
+                }
+                if (dHum) {
+                    token[0] |= SAMPLECODEC_HUM;
+                    n += varint(token + n, zigzag(dHum));
+                }
+            }
+            if (!append(token, n)) return false;
+            _run = _length - n;
+            _gap = gap;
+            _dTemp = dTemp;
+            _dHum = dHum;
+            sample(r);
+        } else if (r.type == SAMPLELOG_ALARM) {
+            token[n++] = SAMPLECODEC_ALARM | (r.b ? 0x10 : 0) | (r.a & 0x0F);
+            n += varint(token + n, r.time - _time);
+            if (!append(token, n)) return false;
+            _run = -1;
+            _time = r.time;
+        } else if (r.type == SAMPLELOG_BOOT) {
+            token[n++] = SAMPLECODEC_BOOT;
+            n += varint(token + n, r.time);
+            if (!append(token, n)) return false;
+            _run = -1;
+            _time = 0;
+            _temp = 0;
+            _hum = 0;
+            _gap = _dTemp = _dHum = 0;
+        } else {
+            return true; // nothing to keep
+        }
+        _records++;
+        return true;
+    }
+
+    /** Bytes written to the buffer, keyframe included. */
+    size_t length() const { return _length; }
+
+    /** Records added to the buffer since begin(). */
+    uint32_t records() const { return _records; }
+
+private:
+    static uint32_t zigzag(int32_t v) { return ((uint32_t)v << 1) ^ (uint32_t)(v >> 31); }
+
+    static size_t varint(uint8_t *p, uint32_t v) {
+        size_t n = 0;
+        while (v >= 0x80) {
+            p[n++] = (v & 0x7F) | 0x80;
+            v >>= 7;
+        }
+        p[n++] = v;
+        return n;
+    }
+
+    bool append(const uint8_t *token, size_t n) {
+        if (_length + n > _size) return false;
+        for (size_t i = 0; i < n; i++) _out[_length + i] = token[i];
+        _length += n;
+        return true;
+    }
+
+    void sample(const SampleRecord &r) {
+        _time = r.time;
+        _temp = r.b;
+        _hum = r.a;
+    }
+
+    uint8_t *_out;
+    size_t _size;
+    size_t _length;
+    uint32_t _records;
+    int _run;        // offset of the last token if it is a sample or a run, else -1
+    uint32_t _time;  // of the last record
+    int16_t _temp;   // of the last sample
+    uint8_t _hum;
+    uint32_t _gap;   // changes of the last sample, what a run repeats
+    int32_t _dTemp;
+    int32_t _dHum;
+};
+
+/** Class for the decoding side of the sample stream.
+ *
+ * feed() takes the stream a byte at a time, or in pieces of any size, and
+ * calls emit(const SampleRecord &) for every record as soon as its token is
+ * complete; a run emits one record per repeat. Until the first keyframe or
+ * boot token the decoder has nothing to apply changes to and skips what it
+ * gets. An invalid token is counted and drops the decoder back to waiting
+ * for a keyframe. Decode each buffer the encoder filled with a reset()
+ * decoder: the keyframe at its start is all it needs.
+ *
+ * Example:
+ * @code
+ * SampleDecoder decoder;
+ * decoder.feed(slot, length, [](const SampleRecord &r) {
+ *     printf("%u %u %d\n", r.time, r.a, r.b);
+ * });
+ * @endcode
+ */
+class SampleDecoder
+{
+public:
+    SampleDecoder() : _errors(0) { reset(); }
+
+    /** Forget the state and wait for the next keyframe or boot. */
+    void reset() {
+        _length = 0;
+        _synced = false;
+        _time = 0;
+        _temp = 0;
+        _hum = 0;
+        _gap = _dTemp = _dHum = 0;
+    }
+
+    /** Decode one more byte of the stream. */
+    template <typename F> void feed(uint8_t byte, F &&emit) {
+        _token[_length++] = byte;
+        int n = tokenLength(_token, _length);
+        if (n == 0 && _length < SAMPLECODEC_MAX_TOKEN) return; // token not complete yet
+        if (n > 0) {
+            apply(emit);
+        } else {
+            _errors++;
+            _synced = false;
+        }
+        _length = 0;
+    }
+
+    /** Decode length more bytes of the stream. */
+    template <typename F> void feed(const uint8_t *data, size_t length, F &&emit) {
+        while (length--) feed(*data++, emit);
+    }
+
+    /** Invalid tokens seen. */
+    uint32_t errors() const { return _errors; }
+
+    /** Bytes token at p takes, 0 if more than n are needed, -1 if it is not a token. */
+    static int tokenLength(const uint8_t *p, size_t n) {
+        uint8_t t = p[0];
+        int varints;
+        if (t == SAMPLECODEC_KEYFRAME) {
+            return n >= SAMPLECODEC_KEYFRAME_SIZE ? SAMPLECODEC_KEYFRAME_SIZE : 0;
+        } else if (t <= (SAMPLECODEC_GAP | SAMPLECODEC_TEMP | SAMPLECODEC_HUM)) {
+            varints = !!(t & SAMPLECODEC_GAP) + !!(t & SAMPLECODEC_TEMP) + !!(t & SAMPLECODEC_HUM);
+        } else if ((t & 0xF0) == SAMPLECODEC_RUN) {
+            varints = 0;
+        } else if ((t & 0xE0) == SAMPLECODEC_ALARM || t == SAMPLECODEC_BOOT) {
+            varints = 1;
+        } else {
+            return -1;
+        }
+        size_t pos = 1;
+        while (varints--) {
+            // at most 5 bytes for 32 bits
+            size_t i = 0;
+            while (pos + i < n && i < 5 && (p[pos + i] & 0x80)) i++;
+            if (i == 5) return -1;
+            if (pos + i == n) return 0;
+            pos += i + 1;
+        }
+        return (int)pos;
+    }
+
+private:
+    static uint32_t varint(const uint8_t *&p) {
+        uint32_t v = 0;
+        for (int shift = 0;; shift += 7) {
+            v |= (uint32_t)(*p & 0x7F) << shift;
+            if (!(*p++ & 0x80)) return v;
+        }
+    }
+
+    static int32_t unzigzag(uint32_t v) { return (int32_t)(v >> 1) ^ -(int32_t)(v & 1); }
+
+    template <typename F> void apply(F &emit) {
+        const uint8_t *p = _token + 1;
+        uint8_t t = _token[0];
+        if (t == SAMPLECODEC_KEYFRAME) {
+            _time = p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+            _temp = (int16_t)(p[4] | p[5] << 8);
+            _hum = p[6];
+            _gap = _dTemp = _dHum = 0;
+            _synced = true;
+        } else if (t == SAMPLECODEC_BOOT) {
+            SampleRecord r = {varint(p), SAMPLELOG_BOOT, 0, 0};
+            _time = 0;
+            _temp = 0;
+            _hum = 0;
+            _gap = _dTemp = _dHum = 0;
+            _synced = true;
+            emit(r);
+        } else if (!_synced) {
+            // a change, but nothing to apply it to yet
+        } else if ((t & 0xF0) == SAMPLECODEC_RUN) {
+            for (int i = 0; i <= (t & 0x0F); i++) {
+                sample(emit);
+            }
+        } else if ((t & 0xE0) == SAMPLECODEC_ALARM) {
+            _time += varint(p);
+            SampleRecord r = {_time, SAMPLELOG_ALARM, (uint8_t)(t & 0x0F), (int16_t)((t & 0x10) != 0)};
+            emit(r);
+        } else {
+            if (t & SAMPLECODEC_GAP) _gap = varint(p);
+            _dTemp = t & SAMPLECODEC_TEMP ? unzigzag(varint(p)) : 0;
+            _dHum = t & SAMPLECODEC_HUM ? unzigzag(varint(p)) : 0;
+            sample(emit);
+        }
+    }
+
+    template <typename F> void sample(F &emit) {
+        _time += _gap;
+        _temp += _dTemp;
+        _hum += _dHum;
+        SampleRecord r = {_time, SAMPLELOG_SAMPLE, _hum, _temp};
+        emit(r);
+    }
+
+    uint8_t _token[SAMPLECODEC_MAX_TOKEN];
+    size_t _length;  // bytes of _token received
+    bool _synced;    // a keyframe or boot was seen
+    uint32_t _errors;
+    uint32_t _time;
+    int16_t _temp;
+    uint8_t _hum;
+    uint32_t _gap;
+    int32_t _dTemp;
+    int32_t _dHum;
+};
+
+#endif
@@ -0,0 +1,234 @@
+// Persistent sample log for the CSE321 climate alarm, see samplelog.h
+
+#include "samplelog.h"
+#include "crc32.h"
+
+// bytes of records a slot header says follow
+static size_t slotLength(const SampleLogHeader &header) {
+    return header.version == 1 ? header.length * sizeof(SampleRecord) : header.length;
+}
+
+// a slot is checked once per boot and once per commit, a bitwise CRC will do
+static uint32_t slotCheck(const SampleLogHeader &header, const uint8_t *data) {
+    SampleLogHeader h = header;
+    h.check = 0;
+    uint32_t crc = crc32(&h, sizeof(h));
+    return crc32(data, slotLength(header), crc);
+}
+
+SampleLog::SampleLog(BlockDevice *bd)
+    : _bd(bd), _slots(0), _perErase(1), _next(0), _seq(1), _boots(0), _outRecords(0), _busy(false), _ready(0, 1),
+      _thread(osPriorityLow, SAMPLELOG_STACK_SIZE, nullptr, "samplelog") {
+    memset(&_fill, 0, sizeof(_fill));
+    memset(&_stats, 0, sizeof(_stats));
+}
+
+int SampleLog::start() {
+    int err = _bd->init();
+    if (err) {
+        return err;
+    }
+    bd_size_t erase = _bd->get_erase_size();
+    // erased slots are told apart by their erase value
+    if (SAMPLELOG_SLOT_SIZE % _bd->get_program_size() || erase % SAMPLELOG_SLOT_SIZE ||
+        _bd->size() < 2 * erase || _bd->get_erase_value() < 0) {
+        return BD_ERROR_DEVICE_ERROR;
+    }
+    _slots = _bd->size() / SAMPLELOG_SLOT_SIZE;
+    _perErase = erase / SAMPLELOG_SLOT_SIZE;
+
+    // the newest valid slot is where the log left off
+    bool found = false;
+    uint32_t newest = 0;
+    for (uint32_t i = 0; i < _slots; i++) {
+        if (readSlot(i, _out) && (!found || (int32_t)(_out.header.seq - _seq) >= 0)) {
+            found = true;
+            newest = i;
+            _seq = _out.header.seq + 1;
+            _boots = _out.header.boot;
+        }
+    }
+    _next = found ? (newest + 1) % _slots : 0;
+    _boots++;
+
+    _thread.start(callback(this, &SampleLog::writer));
+
+    _encoder.begin(_fill.data, sizeof(_fill.data));
+    SampleRecord boot = {_boots, SAMPLELOG_BOOT, 0, 0};
+    add(boot);
+    return 0;
+}
+
+void SampleLog::addSample(uint32_t time, int temperature, int humidity) {
+    SampleRecord r = {time, SAMPLELOG_SAMPLE, (uint8_t)humidity, (int16_t)temperature};
+    add(r);
+}
+
+void SampleLog::addAlarm(uint32_t time, int rule, bool on) {
+    SampleRecord r = {time, SAMPLELOG_ALARM, (uint8_t)rule, on};
+    add(r);
+}
+
+void SampleLog::add(const SampleRecord &r) {
+    _lock.lock();
+    // a record that does not fit goes first in the next slot
+    if (!_encoder.add(r)) {
+        handOver();
+        _encoder.add(r);
+    }
+    _lock.unlock();
+}
+
+void SampleLog::sync() {
+    _lock.lock();
+    if (_encoder.records()) {
+        handOver();
+    }
+    _lock.unlock();
+}
+
+// Pass _fill to the writer and start the next slot, with _lock held. If the
+// writer is still busy with the previous slot the records are lost rather
+// than waited for.
+void SampleLog::handOver() {
+    if (_busy) {
+        _stats.dropped += _encoder.records();
+    } else {
+        _fill.header.length = _encoder.length();
+        _out = _fill;
+        _outRecords = _encoder.records();
+        _busy = true;
+        _ready.release();
+    }
+    _encoder.begin(_fill.data, sizeof(_fill.data));
+}
+
+bool SampleLog::readSlot(uint32_t index, Slot &slot) {
+    if (_bd->read(&slot, (bd_addr_t)index * SAMPLELOG_SLOT_SIZE, sizeof(slot))) {
+        _stats.errors++;
+        return false;
+    }
+    const SampleLogHeader &h = slot.header;
+    return h.magic == SAMPLELOG_MAGIC && (h.version == 1 || h.version == SAMPLELOG_VERSION) &&
+           slotLength(h) <= SAMPLELOG_SLOT_DATA && h.check == slotCheck(h, slot.data);
+}
+
+// Whether slots index .. index + slots - 1 are still erased.
+bool SampleLog::erased(uint32_t index, uint32_t slots) {
+    int value = _bd->get_erase_value();
+    uint8_t buffer[SAMPLELOG_SLOT_SIZE];
+    for (uint32_t i = index; i < index + slots; i++) {
+        if (_bd->read(buffer, (bd_addr_t)i * SAMPLELOG_SLOT_SIZE, sizeof(buffer))) {
+            _stats.errors++;
+            return false;
+        }
+        for (uint32_t j = 0; j < sizeof(buffer); j++) {
+            if (buffer[j] != value) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+bool SampleLog::eraseBlockOf(uint32_t index) {
+    uint32_t first = index - index % _perErase;
+    if (_bd->erase((bd_addr_t)first * SAMPLELOG_SLOT_SIZE, _bd->get_erase_size())) {
+        _stats.errors++;
+        return false;
+    }
+    _stats.erases++;
+    return true;
+}
+
+// Program slot at _next, erasing or passing over whatever is in the way.
+bool SampleLog::commit(Slot &slot) {
+    for (uint32_t tries = 0; tries < _slots; tries++) {
+        uint32_t index = _next;
+        _next = (_next + 1) % _slots;
+
+        if (!erased(index, 1)) {
+            // the start of a block is erased here; anywhere else something
+            // (a write cut short by a reset) is in the way, use the next slot
+            if (index % _perErase != 0) {
+                _stats.skipped++;
+                continue;
+            }
+            if (!eraseBlockOf(index)) {
+                continue;
+            }
+        }
+
+        slot.header.magic = SAMPLELOG_MAGIC;
+        slot.header.seq = _seq;
+        slot.header.boot = _boots;
+        slot.header.version = SAMPLELOG_VERSION;
+        slot.header.check = slotCheck(slot.header, slot.data);
+        // program whole program units, the unused bytes stay as they are
+        bd_size_t unit = _bd->get_program_size();
+        bd_size_t length = sizeof(SampleLogHeader) + slot.header.length;
+        length = (length + unit - 1) / unit * unit;
+        if (_bd->program(&slot, (bd_addr_t)index * SAMPLELOG_SLOT_SIZE, length)) {
+            _stats.errors++;
+            _stats.skipped++;
+            continue;
+        }
+        _seq++;
+        _stats.commits++;
+        _stats.bytes += slot.header.length;
+
+        // entering a block: clear the next one now, while nothing waits for it
+        if (index % _perErase == 0) {
+            uint32_t ahead = (index - index % _perErase + _perErase) % _slots;
+            if (!erased(ahead, _perErase)) {
+                eraseBlockOf(ahead);
+            }
+        }
+        return true;
+    }
+    return false;
+}
+
+void SampleLog::writer() {
+    while (true) {
+        _ready.acquire();
+
+        _device.lock();
+        if (commit(_out)) {
+            _stats.records += _outRecords;
+        }
+        _device.unlock();
+
+        _lock.lock();
+        _busy = false;
+        _lock.unlock();
+    }
+}
+
+uint32_t SampleLog::replay(Callback<void(const SampleRecord &)> fn) {
+    uint32_t records = 0;
+    Slot slot;
+    _device.lock();
+    // from the oldest position to the newest; erased and torn slots fail the check
+    for (uint32_t i = 0; i < _slots; i++) {
+        if (!readSlot((_next + i) % _slots, slot)) {
+            continue;
+        }
+        if (slot.header.version == 1) {
+            const SampleRecord *r = (const SampleRecord *)slot.data;
+            for (int j = 0; j < slot.header.length; j++) {
+                fn(r[j]);
+                records++;
+            }
+            continue;
+        }
+        // every slot opens with a keyframe, so decodes on its own
+        SampleDecoder decoder;
+        decoder.feed(slot.data, slot.header.length, [&](const SampleRecord &r) {
+            fn(r);
+            records++;
+        });
+    }
+    _device.unlock();
+    return records;
+}
@@ -0,0 +1,150 @@
+// Persistent sample log for the CSE321 climate alarm
+//
+// Keeps samples and alarm changes in flash across resets, as a circular log
+// of self-checking slots on any mbed BlockDevice. Records are delta encoded
+// (samplecodec.h) into RAM and committed a slot at a time by a low priority
+// thread, so the event queue never waits for a program or an erase.
+
+#ifndef SAMPLELOG_H
+#define SAMPLELOG_H
+
+#include "mbed.h"
+#include "BlockDevice.h"
+#include "samplecodec.h"
+
+// bytes per slot, the unit that is committed at once; a multiple of the
+// program size and a divisor of the erase size of the device
+#define SAMPLELOG_SLOT_SIZE 256
+
+// bytes of records one slot holds
+#define SAMPLELOG_SLOT_DATA (SAMPLELOG_SLOT_SIZE - sizeof(SampleLogHeader))
+
+// first word of every committed slot
+#define SAMPLELOG_MAGIC 0x474F4C53 // "SLOG"
+
+// slot layout version: 1 held plain SampleRecords, 2 holds a samplecodec.h
+// stream opening with a keyframe; slots of both are read
+#define SAMPLELOG_VERSION 2
+
+// stack of the writer thread (bytes)
+#define SAMPLELOG_STACK_SIZE 1024
+
+/** Start of every slot. The check covers the rest of the header and the records. */
+struct SampleLogHeader {
+    uint32_t magic;  ///< SAMPLELOG_MAGIC
+    uint32_t seq;    ///< slot sequence number, one higher for every slot committed
+    uint16_t boot;   ///< boot count when the slot was committed
+    uint8_t version; ///< SAMPLELOG_VERSION
+    uint8_t length;  ///< bytes of records that follow (records, in version 1)
+    uint32_t check;  ///< CRC-32 of the slot with this field as 0
+};
+
+static_assert(sizeof(SampleRecord) == 8 && sizeof(SampleLogHeader) == 16, "slot layout changed, bump SAMPLELOG_VERSION");
+static_assert(SAMPLELOG_SLOT_DATA <= 255, "slot length does not fit SampleLogHeader::length");
+
+/** Counters kept by SampleLog. */
+struct SampleLogStats {
+    uint32_t commits; ///< slots written
+    uint32_t records; ///< records in them
+    uint32_t bytes;   ///< bytes of records in them, keyframes included
+    uint32_t erases;  ///< erase blocks erased
+    uint32_t skipped; ///< slots found unusable (torn writes) and passed over
+    uint32_t dropped; ///< records lost because the writer fell behind
+    uint32_t errors;  ///< block device errors
+};
+
+/** Class for an append-only log of samples in flash.
+ *
+ * The device is a ring of SAMPLELOG_SLOT_SIZE slots. A slot is only ever
+ * programmed once, whole, with a CRC over its contents: a slot cut short by
+ * a reset fails the check and is ignored, so a commit either happened or
+ * did not. start() finds the slot with the highest sequence number and
+ * carries on after it. The log fills the device from start to end and then
+ * erases its oldest erase block to go on, so every block sees the same
+ * number of erases. The block after the one being written is erased ahead
+ * of time, which keeps the erase off the path of a commit.
+ *
+ * add() only encodes the record into RAM. Every slot opens with a keyframe
+ * and decodes on its own. A full slot is handed to the writer thread; the
+ * most a reset can lose is the slot being filled.
+ *
+ * Example:
+ * @code
+ * FlashIAPBlockDevice flash(0x081E0000, 128 * 1024);
+ * SampleLog samples(&flash);
+ *
+ * int main() {
+ *     samples.start();
+ *     samples.addSample(now_s, 224, 41);
+ *     ...
+ *     samples.replay(print_record);
+ * }
+ * @endcode
+ */
+class SampleLog
+{
+public:
+    SampleLog(BlockDevice *bd);
+
+    /** Open the device, find the end of the log, log a boot record and
+     *  start the writer thread.
+     *
+     * @returns 0 on success, otherwise the block device error
+     */
+    int start();
+
+    /** Queue a sample for the log. Thread context, never blocks on flash. */
+    void addSample(uint32_t time, int temperature, int humidity);
+
+    /** Queue an alarm rule change for the log. */
+    void addAlarm(uint32_t time, int rule, bool on);
+
+    /** Hand the records queued so far to the writer even if the slot is not full. */
+    void sync();
+
+    /** Call fn for every committed record, oldest first. Reads the device
+     *  from the calling thread, and waits for a commit in progress.
+     *
+     * @returns number of records
+     */
+    uint32_t replay(Callback<void(const SampleRecord &)> fn);
+
+    /** Times the firmware started with this log, including this time. */
+    uint32_t boots() const { return _boots; }
+
+    const SampleLogStats &stats() const { return _stats; }
+
+private:
+    struct Slot {
+        SampleLogHeader header;
+        uint8_t data[SAMPLELOG_SLOT_DATA];
+    };
+
+    void add(const SampleRecord &r);
+    void handOver();
+    bool readSlot(uint32_t index, Slot &slot);
+    bool erased(uint32_t index, uint32_t slots);
+    bool eraseBlockOf(uint32_t index);
+    bool commit(Slot &slot);
+    void writer();
+
+    BlockDevice *_bd;
+    uint32_t _slots;      // slots on the device
+    uint32_t _perErase;   // slots per erase block
+    uint32_t _next;       // slot the next commit goes to
+    uint32_t _seq;        // sequence number of the next commit
+    uint32_t _boots;
+    Mutex _device;        // the block device, _next and _seq
+
+    Slot _fill;           // being filled by add()
+    SampleEncoder _encoder; // into _fill.data
+    Slot _out;            // being written by the writer thread
+    uint32_t _outRecords; // records in _out
+    bool _busy;           // _out is waiting for or being written
+    Mutex _lock;          // _fill, _encoder, _busy and handing _fill over
+    Semaphore _ready;
+    Thread _thread;
+    SampleLogStats _stats;
+};
+
+#endif
@@ -0,0 +1,48 @@
+// Interrupt driven serial output for the CSE321 climate alarm, see serialtx.h
+
+#include "serialtx.h"
+
+static_assert((SERIALTX_SIZE & (SERIALTX_SIZE - 1)) == 0, "SERIALTX_SIZE must be a power of two");
+
+SerialTx::SerialTx(UnbufferedSerial *out) : _out(out), _head(0), _tail(0), _active(false), _dropped(0) {}
+
+size_t SerialTx::space() const {
+    return SERIALTX_SIZE - (_head.load(std::memory_order_relaxed) - _tail.load(std::memory_order_acquire));
+}
+
+bool SerialTx::write(const void *data, size_t length) {
+    // masked from the room check to the attach: another writer could take the
+    // room or split the bytes, and the interrupt may be detaching itself
+    core_util_critical_section_enter();
+    if (length > space()) {
+        _dropped++;
+        core_util_critical_section_exit();
+        return false;
+    }
+    const uint8_t *p = (const uint8_t *)data;
+    uint32_t head = _head.load(std::memory_order_relaxed);
+    for (size_t i = 0; i < length; i++) {
+        _ring[(head + i) & (SERIALTX_SIZE - 1)] = p[i];
+    }
+    _head.store(head + length, std::memory_order_release);
+
+    if (!_active) {
+        _active = true;
+        _out->attach(callback(this, &SerialTx::txIrq), SerialBase::TxIrq);
+    }
+    core_util_critical_section_exit();
+    return true;
+}
+
+// Transmit data register empty: hand the UART the next byte, or stop
+// asking for this interrupt when there is none.
+void SerialTx::txIrq() {
+    uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail == _head.load(std::memory_order_acquire)) {
+        _active = false;
+        _out->attach(nullptr, SerialBase::TxIrq);
+        return;
+    }
+    _out->write(&_ring[tail & (SERIALTX_SIZE - 1)], 1);
+    _tail.store(tail + 1, std::memory_order_release);
+}
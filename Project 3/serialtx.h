@@ -0,0 +1,66 @@
+// Interrupt driven serial output for the CSE321 climate alarm
+//
+// Queues bytes in a ring and feeds the UART from its transmit interrupt, so
+// a writer never waits for the line: a write either fits in the ring and
+// returns at once, or is refused whole and counted. Writes from several
+// threads land whole, one after the other.
+
+#ifndef SERIALTX_H
+#define SERIALTX_H
+
+#include "mbed.h"
+#include <atomic>
+
+// bytes the ring holds, a power of two
+#define SERIALTX_SIZE 512
+
+/** Class for a transmit ring in front of an UnbufferedSerial.
+ *
+ * Any thread may write; a write is copied in with interrupts masked, so
+ * keep each one to a line or a packet. The transmit interrupt reads. It is
+ * only attached while there is something to send, and detaches itself once
+ * the ring runs dry, so an idle line costs no interrupts. Nothing else may
+ * write to the same UART while bytes are queued, or the two would
+ * interleave.
+ *
+ * Example:
+ * @code
+ * UnbufferedSerial console(USBTX, USBRX, 115200);
+ * SerialTx out(&console);
+ *
+ * void send(const uint8_t *packet, size_t length) {
+ *     if (!out.write(packet, length)) {
+ *         // no room, out.dropped() counted it
+ *     }
+ * }
+ * @endcode
+ */
+class SerialTx
+{
+public:
+    SerialTx(UnbufferedSerial *out);
+
+    /** Queue length bytes, all of them or none.
+     *
+     * @returns false if the ring had no room for them
+     */
+    bool write(const void *data, size_t length);
+
+    /** Bytes that can be queued right now. */
+    size_t space() const;
+
+    /** Writes refused because the ring was full. */
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    void txIrq();
+
+    UnbufferedSerial *_out;
+    uint8_t _ring[SERIALTX_SIZE];
+    std::atomic<uint32_t> _head; // next byte to queue, writers only
+    std::atomic<uint32_t> _tail; // next byte to send, interrupt only
+    bool _active;                // transmit interrupt attached
+    uint32_t _dropped;
+};
+
+#endif
@@ -0,0 +1,74 @@
+// Torn-read-free snapshot for the CSE321 climate alarm
+//
+// Lets one writer publish a small struct that any thread or interrupt can
+// read, without locks and without ever blocking the writer.
+
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include <atomic>
+#include <stdint.h>
+
+/** Class that publishes a value from one writer to many readers.
+ *
+ * A sequence-counted double buffer (a "latched" seqlock): publish() writes
+ * the two copies one after the other, bumping the sequence before each, and
+ * readers pick the copy the writer is not touching. A reader that interrupts
+ * the writer halfway therefore still gets the previous value at once instead
+ * of spinning, which matters on a single core where the writer can not finish
+ * until the reader returns. A reader only retries if the writer ran during
+ * the copy, and the writer never waits for anyone.
+ *
+ * Only one context may call publish().
+ *
+ * Example:
+ * @code
+ * Snapshot<Reading> reading;
+ *
+ * reading.publish(r);         // writer
+ * Reading r = reading.read(); // any reader
+ * @endcode
+ */
+template <typename T> class Snapshot
+{
+public:
+    Snapshot() : _seq(0) {
+        _copy[0] = _copy[1] = T();
+    }
+
+    /** Make value the current snapshot. Never blocks. */
+    void publish(const T &value) {
+        uint32_t seq = _seq.load(std::memory_order_relaxed);
+
+        // odd: readers use _copy[1] while _copy[0] changes
+        _seq.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        _copy[0] = value;
+
+        // even: readers use _copy[0] while _copy[1] changes
+        _seq.store(seq + 2, std::memory_order_release);
+        std::atomic_thread_fence(std::memory_order_release);
+        _copy[1] = value;
+    }
+
+    /** Consistent copy of the latest snapshot. */
+    T read() const {
+        for (;;) {
+            uint32_t seq = _seq.load(std::memory_order_acquire);
+            T value = _copy[seq & 1];
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (_seq.load(std::memory_order_relaxed) == seq) {
+                return value;
+            }
+        }
+    }
+
+    /** Number of publish() calls so far, 0 until the first one. */
+    uint32_t version() const { return _seq.load(std::memory_order_acquire) / 2; }
+
+private:
+    std::atomic<uint32_t> _seq;
+    T _copy[2];
+};
+
+#endif
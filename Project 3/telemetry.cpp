@@ -0,0 +1,93 @@
+// Binary telemetry for the CSE321 climate alarm, see telemetry.h
+
+#include "telemetry.h"
+#include "cobs.h"
+#include "crc32.h"
+
+static uint32_t nowMs() {
+    return Kernel::Clock::now().time_since_epoch().count();
+}
+
+Telemetry::Telemetry(SerialTx *out) : _out(out), _firstMs(0), _seq(0), _packets(0), _dropped(0) {
+    _encoder.begin(_records, sizeof(_records));
+}
+
+void Telemetry::addBoot(uint32_t boots) {
+    SampleRecord r = {boots, SAMPLELOG_BOOT, 0, 0};
+    add(r);
+}
+
+void Telemetry::addSample(uint32_t time, int temperature, int humidity) {
+    SampleRecord r = {time, SAMPLELOG_SAMPLE, (uint8_t)humidity, (int16_t)temperature};
+    add(r);
+}
+
+void Telemetry::addAlarm(uint32_t time, int rule, bool on) {
+    SampleRecord r = {time, SAMPLELOG_ALARM, (uint8_t)rule, on};
+    add(r);
+    flush();
+}
+
+void Telemetry::add(const SampleRecord &r) {
+    // a record that does not fit goes first in the next packet
+    if (!_encoder.add(r)) {
+        flush();
+        _encoder.add(r);
+    }
+    if (_encoder.records() == 1) {
+        _firstMs = nowMs();
+    }
+}
+
+void Telemetry::flush() {
+    if (_encoder.records()) {
+        send(TELEMETRY_RECORDS, _records, _encoder.length());
+    }
+    _encoder.begin(_records, sizeof(_records));
+}
+
+void Telemetry::tick() {
+    if (_encoder.records() && nowMs() - _firstMs >= TELEMETRY_FLUSH_MS) {
+        flush();
+    }
+}
+
+void Telemetry::sendMetrics(const uint32_t *values) {
+    static_assert(TELEMETRY_METRIC_COUNT * 4 <= TELEMETRY_PAYLOAD, "metrics do not fit in one packet");
+    uint8_t payload[TELEMETRY_METRIC_COUNT * 4];
+    for (int i = 0; i < TELEMETRY_METRIC_COUNT; i++) {
+        for (int b = 0; b < 4; b++) {
+            payload[4 * i + b] = values[i] >> (8 * b);
+        }
+    }
+    send(TELEMETRY_METRICS, payload, sizeof(payload));
+}
+
+// Wrap a payload in the header and check, frame it and queue it whole.
+void Telemetry::send(uint8_t type, const uint8_t *payload, size_t length) {
+    uint8_t packet[TELEMETRY_MAX_PACKET];
+    size_t n = 0;
+    packet[n++] = TELEMETRY_VERSION;
+    packet[n++] = type;
+    packet[n++] = _seq;
+    packet[n++] = _seq >> 8;
+    memcpy(packet + n, payload, length);
+    n += length;
+    uint32_t check = crc32(packet, n);
+    for (int b = 0; b < 4; b++) {
+        packet[n++] = check >> (8 * b);
+    }
+    _seq++;
+
+    // a delimiter on both sides keeps anything else on the line out of the packet
+    uint8_t frame[cobsMaxLength(TELEMETRY_MAX_PACKET) + 2];
+    size_t f = 0;
+    frame[f++] = 0;
+    f += cobsEncode(packet, n, frame + f);
+    frame[f++] = 0;
+    if (_out->write(frame, f)) {
+        _packets++;
+    } else {
+        _dropped++;
+    }
+}
@@ -0,0 +1,80 @@
+// Binary telemetry for the CSE321 climate alarm
+//
+// Batches samples, alarm changes and metrics into CRC checked, COBS framed
+// packets (telemetry_format.h) and queues them on a SerialTx, for a
+// collector that would rather parse bytes than text.
+
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include "mbed.h"
+#include "samplecodec.h"
+#include "serialtx.h"
+#include "telemetry_format.h"
+
+// records wait at most this long for their packet to fill (ms); a packet
+// costs 19 bytes on top of its records, so the longer the cheaper
+#define TELEMETRY_FLUSH_MS 30000
+
+// payload bytes of one packet
+#define TELEMETRY_PAYLOAD (TELEMETRY_MAX_PACKET - TELEMETRY_HEADER_SIZE - TELEMETRY_CHECK_SIZE)
+
+/** Class for the telemetry stream.
+ *
+ * Records are delta encoded (samplecodec.h) into the payload of the next
+ * TELEMETRY_RECORDS packet, which goes out when it is full, when flush() is
+ * called, or from tick() once its first record is TELEMETRY_FLUSH_MS old.
+ * An alarm change does not wait: it goes out with the batch at once.
+ * Every packet opens with a keyframe, so each decodes on its own. A packet
+ * the SerialTx has no room for is dropped whole and counted. Not thread
+ * safe: call everything from one thread, the eventqueue in Project 3.
+ *
+ * Example:
+ * @code
+ * SerialTx out(&console);
+ * Telemetry telemetry(&out);
+ *
+ * void sampled() {
+ *     telemetry.addSample(now_s, tempC, humidity);
+ *     telemetry.tick();
+ * }
+ * @endcode
+ */
+class Telemetry
+{
+public:
+    Telemetry(SerialTx *out);
+
+    void addBoot(uint32_t boots);
+    void addSample(uint32_t time, int temperature, int humidity);
+    void addAlarm(uint32_t time, int rule, bool on);
+
+    /** Send the records batched so far. */
+    void flush();
+
+    /** Send the batch if its first record has waited TELEMETRY_FLUSH_MS. */
+    void tick();
+
+    /** Send a TELEMETRY_METRICS packet of TELEMETRY_METRIC_COUNT values. */
+    void sendMetrics(const uint32_t *values);
+
+    /** Packets queued on the SerialTx. */
+    uint32_t packets() const { return _packets; }
+
+    /** Packets lost because the SerialTx was full. */
+    uint32_t dropped() const { return _dropped; }
+
+private:
+    void add(const SampleRecord &r);
+    void send(uint8_t type, const uint8_t *payload, size_t length);
+
+    SerialTx *_out;
+    SampleEncoder _encoder;
+    uint8_t _records[TELEMETRY_PAYLOAD]; // payload being filled by _encoder
+    uint32_t _firstMs;                   // Kernel::Clock time of its first record
+    uint16_t _seq;
+    uint32_t _packets;
+    uint32_t _dropped;
+};
+
+#endif
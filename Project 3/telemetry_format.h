@@ -0,0 +1,66 @@
+// Packet format of the CSE321 telemetry stream
+//
+// Shared by Project 3 and the host reader (host/telemetry.cpp). On the wire
+// every packet is COBS encoded (cobs.h) and has a 0x00 before and after it,
+// so a reader that starts mid-stream, or sees text in between, loses at
+// most one packet. Decoded, a packet is
+//
+//     version, type, seq (2 bytes), payload, CRC-32 (4 bytes)
+//
+// with multi-byte fields little endian, seq one higher for every packet
+// sent so a reader can count the lost ones, and the CRC-32 (crc32.h) over
+// everything before it.
+//
+// TELEMETRY_RECORDS carries a samplecodec.h stream that opens with a
+// keyframe. TELEMETRY_METRICS carries one 4 byte value per entry of
+// TELEMETRY_METRIC_LIST, in order; append new entries at the end so older
+// readers still parse the ones they know.
+//
+// X(id, name)
+
+#ifndef TELEMETRY_FORMAT_H
+#define TELEMETRY_FORMAT_H
+
+// packet layout version
+#define TELEMETRY_VERSION 1
+
+// packet types
+#define TELEMETRY_RECORDS 1
+#define TELEMETRY_METRICS 2
+
+// bytes before the payload and after it
+#define TELEMETRY_HEADER_SIZE 4
+#define TELEMETRY_CHECK_SIZE 4
+
+// longest packet before framing (bytes)
+#define TELEMETRY_MAX_PACKET 128
+
+#define TELEMETRY_METRIC_LIST(X)                       \
+    X(METRIC_UPTIME_MS,          "uptime_ms")          \
+    X(METRIC_CPU_IDLE,           "cpu_idle_pct")       \
+    X(METRIC_WATCHDOG_WORST_MS,  "watchdog_worst_ms")  \
+    X(METRIC_QUEUE_POSTS,        "queue_posts")        \
+    X(METRIC_QUEUE_FAILED,       "queue_failed")       \
+    X(METRIC_QUEUE_HIGH_WATER,   "queue_high_water")   \
+    X(METRIC_SENSOR_MAX_US,      "sensor_max_us")      \
+    X(METRIC_ALARM_MAX_US,       "alarm_max_us")       \
+    X(METRIC_LAG_MAX_US,         "lag_max_us")         \
+    X(METRIC_LCD_TRANSACTIONS,   "lcd_transactions")   \
+    X(METRIC_LCD_ERRORS,         "lcd_errors")         \
+    X(METRIC_LOG_RECORDS,        "log_records")        \
+    X(METRIC_LOG_BYTES,          "log_bytes")          \
+    X(METRIC_LOG_DROPPED,        "log_dropped")        \
+    X(METRIC_DHT_READS,          "dht_reads")          \
+    X(METRIC_DHT_ERRORS,         "dht_errors")         \
+    X(METRIC_TELEMETRY_PACKETS,  "telemetry_packets")  \
+    X(METRIC_TELEMETRY_DROPPED,  "telemetry_dropped")
+
+/** Index of every value in a TELEMETRY_METRICS packet. */
+enum TelemetryMetric {
+#define TELEMETRY_METRIC_ID(id, name) id,
+    TELEMETRY_METRIC_LIST(TELEMETRY_METRIC_ID)
+#undef TELEMETRY_METRIC_ID
+    TELEMETRY_METRIC_COUNT
+};
+
+#endif
@@ -0,0 +1,60 @@
+// Host stand-in for mbed's BlockDevice.h
+//
+// The storage interface the firmware programs against. FileBlockDevice.h has
+// an implementation backed by a file.
+
+#ifndef HOST_BLOCKDEVICE_H
+#define HOST_BLOCKDEVICE_H
+
+#include <cstdint>
+
+typedef uint64_t bd_addr_t;
+typedef uint64_t bd_size_t;
+
+enum {
+  BD_ERROR_OK = 0,
+  BD_ERROR_DEVICE_ERROR = -4001,
+};
+
+namespace mbed {
+
+class BlockDevice {
+public:
+  virtual ~BlockDevice() {}
+
+  virtual int init() = 0;
+  virtual int deinit() = 0;
+  virtual int sync() { return 0; }
+  virtual int read(void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int program(const void *buffer, bd_addr_t addr, bd_size_t size) = 0;
+  virtual int erase(bd_addr_t addr, bd_size_t size) { return 0; }
+
+  virtual bd_size_t get_read_size() const = 0;
+  virtual bd_size_t get_program_size() const = 0;
+  virtual bd_size_t get_erase_size() const { return get_program_size(); }
+  virtual bd_size_t get_erase_size(bd_addr_t addr) const {
+    return get_erase_size();
+  }
+  virtual int get_erase_value() const { return -1; }
+  virtual bd_size_t size() const = 0;
+  virtual const char *get_type() const = 0;
+
+  bool is_valid_read(bd_addr_t addr, bd_size_t size) const {
+    return addr % get_read_size() == 0 && size % get_read_size() == 0 &&
+           addr + size <= this->size();
+  }
+  bool is_valid_program(bd_addr_t addr, bd_size_t size) const {
+    return addr % get_program_size() == 0 && size % get_program_size() == 0 &&
+           addr + size <= this->size();
+  }
+  bool is_valid_erase(bd_addr_t addr, bd_size_t size) const {
+    return addr % get_erase_size() == 0 && size % get_erase_size() == 0 &&
+           addr + size <= this->size();
+  }
+};
+
+} // namespace mbed
+
+using mbed::BlockDevice;
+
+#endif
@@ -0,0 +1,79 @@
+// Flash-like block device backed by a file, see FileBlockDevice.h
+
+#include "FileBlockDevice.h"
+
+#include <vector>
+
+FileBlockDevice::FileBlockDevice(const char *path, bd_size_t size,
+                                 bd_size_t program, bd_size_t erase)
+    : _path(path), _size(size), _program(program), _erase(erase),
+      _file(nullptr) {}
+
+FileBlockDevice::~FileBlockDevice() { deinit(); }
+
+int FileBlockDevice::init() {
+  if (_file)
+    return BD_ERROR_OK;
+  if (!_path) {
+    _file = tmpfile();
+  } else {
+    _file = fopen(_path, "r+b");
+    if (!_file)
+      _file = fopen(_path, "w+b");
+  }
+  if (!_file)
+    return BD_ERROR_DEVICE_ERROR;
+
+  // a new or short file reads as erased flash
+  fseek(_file, 0, SEEK_END);
+  long have = ftell(_file);
+  if (have < 0)
+    return BD_ERROR_DEVICE_ERROR;
+  for (bd_size_t i = have; i < _size; i++)
+    fputc(0xFF, _file);
+  fflush(_file);
+  return BD_ERROR_OK;
+}
+
+int FileBlockDevice::deinit() {
+  if (_file)
+    fclose(_file);
+  _file = nullptr;
+  return BD_ERROR_OK;
+}
+
+int FileBlockDevice::read(void *buffer, bd_addr_t addr, bd_size_t size) {
+  if (!_file || !is_valid_read(addr, size))
+    return BD_ERROR_DEVICE_ERROR;
+  if (fseek(_file, addr, SEEK_SET) || fread(buffer, 1, size, _file) != size)
+    return BD_ERROR_DEVICE_ERROR;
+  return BD_ERROR_OK;
+}
+
+int FileBlockDevice::program(const void *buffer, bd_addr_t addr,
+                             bd_size_t size) {
+  if (!_file || !is_valid_program(addr, size))
+    return BD_ERROR_DEVICE_ERROR;
+  std::vector<unsigned char> cells(size);
+  if (read(cells.data(), addr, size))
+    return BD_ERROR_DEVICE_ERROR;
+  const unsigned char *p = (const unsigned char *)buffer;
+  for (bd_size_t i = 0; i < size; i++)
+    cells[i] &= p[i];
+  if (fseek(_file, addr, SEEK_SET) ||
+      fwrite(cells.data(), 1, size, _file) != size)
+    return BD_ERROR_DEVICE_ERROR;
+  fflush(_file);
+  return BD_ERROR_OK;
+}
+
+int FileBlockDevice::erase(bd_addr_t addr, bd_size_t size) {
+  if (!_file || !is_valid_erase(addr, size))
+    return BD_ERROR_DEVICE_ERROR;
+  std::vector<unsigned char> erased(size, 0xFF);
+  if (fseek(_file, addr, SEEK_SET) ||
+      fwrite(erased.data(), 1, size, _file) != size)
+    return BD_ERROR_DEVICE_ERROR;
+  fflush(_file);
+  return BD_ERROR_OK;
+}
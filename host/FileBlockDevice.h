@@ -0,0 +1,48 @@
+// Flash-like block device backed by a file, for host builds and tools
+//
+// Behaves like NOR flash: erased bytes read 0xFF and programming can only
+// clear bits, so code that would corrupt real flash by programming over
+// data shows the same corruption here.
+
+#ifndef HOST_FILEBLOCKDEVICE_H
+#define HOST_FILEBLOCKDEVICE_H
+
+#include "BlockDevice.h"
+
+#include <cstdio>
+
+class FileBlockDevice : public mbed::BlockDevice {
+public:
+  /**
+   * @param path     backing file, created erased if missing; null for a
+   *                 temporary one that starts erased every run
+   * @param size     device size in bytes
+   * @param program  program unit in bytes
+   * @param erase    erase unit in bytes
+   */
+  FileBlockDevice(const char *path, bd_size_t size, bd_size_t program = 8,
+                  bd_size_t erase = 4096);
+  ~FileBlockDevice() override;
+
+  int init() override;
+  int deinit() override;
+  int read(void *buffer, bd_addr_t addr, bd_size_t size) override;
+  int program(const void *buffer, bd_addr_t addr, bd_size_t size) override;
+  int erase(bd_addr_t addr, bd_size_t size) override;
+
+  bd_size_t get_read_size() const override { return 1; }
+  bd_size_t get_program_size() const override { return _program; }
+  bd_size_t get_erase_size() const override { return _erase; }
+  int get_erase_value() const override { return 0xFF; }
+  bd_size_t size() const override { return _size; }
+  const char *get_type() const override { return "FILE"; }
+
+private:
+  const char *_path;
+  bd_size_t _size;
+  bd_size_t _program;
+  bd_size_t _erase;
+  FILE *_file;
+};
+
+#endif
@@ -0,0 +1,39 @@
+// Host stand-in for mbed's FlashIAPBlockDevice.h
+//
+// The internal flash of the NUCLEO-L4R5ZI (dual bank: 8 byte program unit,
+// 4 KB pages) as a FileBlockDevice. The backing file is SIM_FLASH, so a log
+// survives from one run to the next like it survives a reset; without it
+// every run starts with erased flash. Programming and erasing take their
+// datasheet time.
+
+#ifndef HOST_FLASHIAPBLOCKDEVICE_H
+#define HOST_FLASHIAPBLOCKDEVICE_H
+
+#include "FileBlockDevice.h"
+#include "sim.h"
+
+#include <cstdlib>
+
+// STM32L4R5 typical times: one 64 bit double word, one page
+#define SIM_FLASH_PROGRAM_US 82
+#define SIM_FLASH_ERASE_US 22000
+
+class FlashIAPBlockDevice : public FileBlockDevice {
+public:
+  FlashIAPBlockDevice(uint32_t address, uint32_t size)
+      : FileBlockDevice(getenv("SIM_FLASH"), size, 8, 4096) {}
+
+  int program(const void *buffer, bd_addr_t addr, bd_size_t size) override {
+    sim::busy_us(size / 8 * SIM_FLASH_PROGRAM_US);
+    return FileBlockDevice::program(buffer, addr, size);
+  }
+
+  int erase(bd_addr_t addr, bd_size_t size) override {
+    sim::busy_us(size / 4096 * SIM_FLASH_ERASE_US);
+    return FileBlockDevice::erase(addr, size);
+  }
+
+  const char *get_type() const override { return "FLASHIAP"; }
+};
+
+#endif
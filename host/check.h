@@ -0,0 +1,36 @@
+// Checks for the host tests (make test)
+//
+// CHECK(condition) reports the file, line and condition when it fails and
+// counts it, without stopping the test. A test's main() ends with
+// return check_summary("name"), which prints one line and returns nonzero
+// when anything failed.
+
+#ifndef HOST_CHECK_H
+#define HOST_CHECK_H
+
+#include <cstdio>
+
+namespace {
+
+int check_count = 0;
+int check_failures = 0;
+
+bool check_at(bool ok, const char *condition, const char *file, int line) {
+  check_count++;
+  if (!ok) {
+    check_failures++;
+    printf("%s:%d: failed: %s\n", file, line, condition);
+  }
+  return ok;
+}
+
+int check_summary(const char *name) {
+  printf("%s: %d checks, %d failed\n", name, check_count, check_failures);
+  return check_failures ? 1 : 0;
+}
+
+} // namespace
+
+#define CHECK(condition) check_at((condition), #condition, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,151 @@
+// Decoder for the CSE321 binary log
+//
+// Reads a serial capture (or a simulator run) on stdin and writes it to
+// stdout with every BinLog frame turned back into text, prefixed with its
+// time stamp. Everything that is not a valid frame passes through as is.
+//
+//   ./build/project3 | ./build/logdecode [core clock in Hz]
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#include "binlog_formats.h"
+
+// must match Project 3/binlog.h
+#define BINLOG_SYNC 0xA5
+#define BINLOG_MAX_ARGS 3
+
+namespace {
+
+struct Format {
+  int argc;
+  const char *text;
+};
+
+const Format FORMATS[] = {
+#define DECODE_FORMAT(id, argc, format) {argc, format},
+    BINLOG_FORMATS(DECODE_FORMAT)
+#undef DECODE_FORMAT
+};
+const int FORMAT_COUNT = sizeof(FORMATS) / sizeof(FORMATS[0]);
+
+uint32_t le32(const unsigned char *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Expand one format with its arguments.
+std::string expand(const Format &f, const int32_t *args) {
+  std::string out;
+  char buf[32];
+  int a = 0;
+  for (const char *p = f.text; *p; p++) {
+    if (*p != '%' || !p[1]) {
+      out += *p;
+      continue;
+    }
+    char conv = *++p;
+    int32_t v = a < f.argc ? args[a] : 0;
+    switch (conv) {
+    case 'd':
+      snprintf(buf, sizeof(buf), "%" PRId32, v);
+      break;
+    case 'u':
+      snprintf(buf, sizeof(buf), "%" PRIu32, (uint32_t)v);
+      break;
+    case 'x':
+      snprintf(buf, sizeof(buf), "%" PRIx32, (uint32_t)v);
+      break;
+    case 'c':
+      snprintf(buf, sizeof(buf), "%c", (char)v);
+      break;
+    case 't':
+      snprintf(buf, sizeof(buf), "%s%" PRId32 ".%" PRId32, v < 0 ? "-" : "",
+               (v < 0 ? -v : v) / 10, (v < 0 ? -v : v) % 10);
+      break;
+    case '%':
+      out += '%';
+      continue;
+    default:
+      snprintf(buf, sizeof(buf), "%%%c", conv);
+      break;
+    }
+    out += buf;
+    a++;
+  }
+  return out;
+}
+
+// Length of the frame at p, 0 if it is not one, -1 if more bytes are needed.
+int frame_length(const unsigned char *p, size_t avail) {
+  if (avail < 3)
+    return -1;
+  if (p[1] >= FORMAT_COUNT || p[2] != FORMATS[p[1]].argc ||
+      p[2] > BINLOG_MAX_ARGS)
+    return 0;
+  size_t len = 3 + 4 + 4 * p[2] + 1;
+  if (avail < len)
+    return -1;
+  unsigned char sum = 0;
+  for (size_t i = 1; i < len; i++)
+    sum += p[i];
+  return sum == 0 ? (int)len : 0;
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  double hz = argc > 1 ? atof(argv[1]) : 120e6;
+
+  std::string buf;
+  uint64_t high = 0; // cycle counter wraps, every 36 s at 120 MHz
+  uint32_t last = 0;
+  bool line_start = true;
+  int c;
+  bool eof = false;
+  while (!eof || !buf.empty()) {
+    if (!eof) {
+      c = getchar();
+      if (c == EOF)
+        eof = true;
+      else
+        buf += (char)c;
+    }
+    while (!buf.empty()) {
+      const unsigned char *p = (const unsigned char *)buf.data();
+      if (p[0] != BINLOG_SYNC) {
+        putchar(p[0]);
+        line_start = p[0] == '\n';
+        buf.erase(0, 1);
+        continue;
+      }
+      int len = frame_length(p, buf.size());
+      if (len < 0 && !eof)
+        break; // wait for the rest of the frame
+      if (len <= 0) {
+        putchar(p[0]);
+        line_start = false;
+        buf.erase(0, 1);
+        continue;
+      }
+
+      uint32_t cycles = le32(p + 3);
+      if (cycles < last)
+        high += 1ull << 32;
+      last = cycles;
+      int32_t args[BINLOG_MAX_ARGS] = {};
+      for (int i = 0; i < p[2]; i++)
+        args[i] = (int32_t)le32(p + 7 + 4 * i);
+
+      if (!line_start)
+        putchar('\n');
+      printf("[%12.6f] %s\n", (high + cycles) / hz,
+             expand(FORMATS[p[1]], args).c_str());
+      line_start = true;
+      buf.erase(0, len);
+    }
+  }
+  return 0;
+}
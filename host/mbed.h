@@ -0,0 +1,554 @@
+// Host stand-in for mbed.h
+//
+// Just enough of the mbed OS 6 API for the CSE321 firmware to compile and run
+// unmodified on Linux. Peripherals are simulated and time is virtual, see
+// sim.h and readme.md in this directory.
+
+#ifndef HOST_MBED_H
+#define HOST_MBED_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <functional>
+#include <sys/types.h>
+#include <type_traits>
+#include <utility>
+
+#include "sim.h"
+
+// ---- pins -------------------------------------------------------------------
+
+#define SIM_PORT_PINS(P, base)                                                 \
+  P##_0 = (base), P##_1, P##_2, P##_3, P##_4, P##_5, P##_6, P##_7, P##_8,     \
+  P##_9, P##_10, P##_11, P##_12, P##_13, P##_14, P##_15
+
+typedef enum {
+  SIM_PORT_PINS(PA, 0x00),
+  SIM_PORT_PINS(PB, 0x10),
+  SIM_PORT_PINS(PC, 0x20),
+  SIM_PORT_PINS(PD, 0x30),
+  SIM_PORT_PINS(PE, 0x40),
+  SIM_PORT_PINS(PF, 0x50),
+  SIM_PORT_PINS(PG, 0x60),
+
+  // NUCLEO-L4R5ZI aliases
+  BUTTON1 = PC_13,
+  LED1 = PC_7,
+  LED2 = PB_7,
+  LED3 = PA_9,
+  USBTX = PG_7,
+  USBRX = PG_8,
+
+  NC = -1
+} PinName;
+
+#define SIM_PIN_COUNT 0x70
+
+typedef enum {
+  PullNone = 0,
+  PullUp = 1,
+  PullDown = 2,
+  OpenDrain = 3,
+  PullDefault = PullNone
+} PinMode;
+
+// ---- registers --------------------------------------------------------------
+
+typedef struct {
+  volatile uint32_t MODER;
+  volatile uint32_t OTYPER;
+  volatile uint32_t OSPEEDR;
+  volatile uint32_t PUPDR;
+  volatile uint32_t IDR;
+  volatile uint32_t ODR;
+  volatile uint32_t BSRR;
+  volatile uint32_t LCKR;
+  volatile uint32_t AFR[2];
+  volatile uint32_t BRR;
+} GPIO_TypeDef;
+
+typedef struct {
+  volatile uint32_t CR;
+  volatile uint32_t ICSCR;
+  volatile uint32_t CFGR;
+  volatile uint32_t PLLCFGR;
+  volatile uint32_t AHB1ENR;
+  volatile uint32_t AHB2ENR;
+  volatile uint32_t AHB3ENR;
+  volatile uint32_t APB1ENR1;
+  volatile uint32_t APB1ENR2;
+  volatile uint32_t APB2ENR;
+} RCC_TypeDef;
+
+extern GPIO_TypeDef sim_gpio[7];
+extern RCC_TypeDef sim_rcc;
+
+#define GPIOA (&sim_gpio[0])
+#define GPIOB (&sim_gpio[1])
+#define GPIOC (&sim_gpio[2])
+#define GPIOD (&sim_gpio[3])
+#define GPIOE (&sim_gpio[4])
+#define GPIOF (&sim_gpio[5])
+#define GPIOG (&sim_gpio[6])
+#define RCC (&sim_rcc)
+
+// DWT cycle counter. CYCCNT follows the virtual clock at SystemCoreClock.
+struct SimCycleCounter {
+  operator uint32_t() const;
+  SimCycleCounter &operator=(uint32_t value);
+};
+
+typedef struct {
+  volatile uint32_t CTRL;
+  SimCycleCounter CYCCNT;
+} DWT_Type;
+
+typedef struct {
+  volatile uint32_t DHCSR;
+  volatile uint32_t DCRSR;
+  volatile uint32_t DCRDR;
+  volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+extern uint32_t SystemCoreClock;
+
+#define DWT (&sim_dwt)
+#define CoreDebug (&sim_core_debug)
+#define DWT_CTRL_CYCCNTENA_Msk (1UL << 0)
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+
+// ---- platform ---------------------------------------------------------------
+
+#define MBED_CPU_STATS_ENABLED 1
+#define DEVICE_I2C_ASYNCH 1
+#define EVENTS_EVENT_SIZE (sizeof(void *) * 9)
+
+typedef enum {
+  osPriorityIdle = 1,
+  osPriorityLow = 8,
+  osPriorityBelowNormal = 16,
+  osPriorityNormal = 24,
+  osPriorityAboveNormal = 32,
+  osPriorityHigh = 40,
+  osPriorityRealtime = 48
+} osPriority;
+
+typedef int32_t osStatus;
+#define osOK 0
+#define OS_STACK_SIZE 4096
+
+typedef struct {
+  uint64_t uptime;
+  uint64_t idle_time;
+  uint64_t sleep_time;
+  uint64_t deep_sleep_time;
+} mbed_stats_cpu_t;
+
+void mbed_stats_cpu_get(mbed_stats_cpu_t *stats);
+
+void wait_us(int us);
+void wait_ns(unsigned int ns);
+void thread_sleep_for(uint32_t millisec);
+uint32_t us_ticker_read();
+
+void sleep_manager_lock_deep_sleep();
+void sleep_manager_unlock_deep_sleep();
+
+void core_util_critical_section_enter();
+void core_util_critical_section_exit();
+
+void set_time(time_t t);
+time_t sim_rtc_time(time_t *t);
+
+namespace mbed {
+
+// ---- Callback ---------------------------------------------------------------
+
+template <typename F> class Callback;
+
+template <typename R, typename... Args> class Callback<R(Args...)> {
+public:
+  Callback() {}
+  Callback(std::nullptr_t) {}
+
+  template <typename F,
+            typename = typename std::enable_if<!std::is_same<
+                typename std::decay<F>::type, Callback>::value>::type,
+            typename = decltype(std::declval<F &>()(std::declval<Args>()...))>
+  Callback(F f) : _f(std::move(f)) {}
+
+  template <typename T, typename U>
+  Callback(U *obj, R (T::*method)(Args...))
+      : _f([obj, method](Args... a) { return (obj->*method)(a...); }) {}
+
+  template <typename T, typename U>
+  Callback(const U *obj, R (T::*method)(Args...) const)
+      : _f([obj, method](Args... a) { return (obj->*method)(a...); }) {}
+
+  R operator()(Args... a) const { return _f(a...); }
+  R call(Args... a) const { return _f(a...); }
+  explicit operator bool() const { return static_cast<bool>(_f); }
+
+private:
+  std::function<R(Args...)> _f;
+};
+
+template <typename R, typename... Args>
+Callback<R(Args...)> callback(R (*f)(Args...)) {
+  return Callback<R(Args...)>(f);
+}
+
+template <typename T, typename U, typename R, typename... Args>
+Callback<R(Args...)> callback(U *obj, R (T::*method)(Args...)) {
+  return Callback<R(Args...)>(obj, method);
+}
+
+template <typename R, typename... Args>
+Callback<R(Args...)> callback(const Callback<R(Args...)> &cb) {
+  return cb;
+}
+
+// ---- GPIO -------------------------------------------------------------------
+
+class DigitalIn {
+public:
+  DigitalIn(PinName pin, PinMode mode = PullDefault);
+  int read();
+  void mode(PinMode pull);
+  operator int() { return read(); }
+
+private:
+  PinName _pin;
+  PinMode _mode;
+};
+
+class DigitalOut {
+public:
+  DigitalOut(PinName pin, int value = 0);
+  void write(int value);
+  int read() { return _value; }
+  DigitalOut &operator=(int value) {
+    write(value);
+    return *this;
+  }
+  operator int() { return read(); }
+
+private:
+  PinName _pin;
+  int _value;
+};
+
+class DigitalInOut {
+public:
+  DigitalInOut(PinName pin);
+  void output();
+  void input();
+  void mode(PinMode pull);
+  void write(int value);
+  int read();
+  DigitalInOut &operator=(int value) {
+    write(value);
+    return *this;
+  }
+  operator int() { return read(); }
+
+private:
+  void drive();
+
+  PinName _pin;
+  PinMode _mode;
+  int _output;
+  int _value;
+};
+
+class InterruptIn {
+public:
+  InterruptIn(PinName pin, PinMode mode = PullDefault);
+  ~InterruptIn();
+  void rise(Callback<void()> func);
+  void fall(Callback<void()> func);
+  void enable_irq();
+  void disable_irq();
+  void mode(PinMode pull);
+  int read();
+  operator int() { return read(); }
+
+private:
+  PinName _pin;
+  sim::Irq _irq;
+};
+
+// ---- I2C --------------------------------------------------------------------
+
+#define I2C_EVENT_ERROR (1 << 1)
+#define I2C_EVENT_ERROR_NO_SLAVE (1 << 2)
+#define I2C_EVENT_TRANSFER_COMPLETE (1 << 3)
+#define I2C_EVENT_TRANSFER_EARLY_NACK (1 << 4)
+#define I2C_EVENT_ALL                                                          \
+  (I2C_EVENT_ERROR | I2C_EVENT_TRANSFER_COMPLETE | I2C_EVENT_ERROR_NO_SLAVE |  \
+   I2C_EVENT_TRANSFER_EARLY_NACK)
+
+typedef Callback<void(int)> event_callback_t;
+
+class I2C {
+public:
+  I2C(PinName sda, PinName scl);
+  void frequency(int hz);
+  int write(int address, const char *data, int length, bool repeated = false);
+  int read(int address, char *data, int length, bool repeated = false);
+  int transfer(int address, const char *tx_buffer, int tx_length,
+               char *rx_buffer, int rx_length,
+               const event_callback_t &callback,
+               int event = I2C_EVENT_TRANSFER_COMPLETE, bool repeated = false);
+  void abort_transfer();
+
+private:
+  int _hz;
+  bool _busy;
+};
+
+// ---- serial -----------------------------------------------------------------
+
+class SerialBase {
+public:
+  enum IrqType { RxIrq = 0, TxIrq };
+};
+
+class UnbufferedSerial : public SerialBase {
+public:
+  UnbufferedSerial(PinName tx, PinName rx, int baud = 9600);
+  ~UnbufferedSerial();
+  ssize_t write(const void *buffer, size_t length);
+  ssize_t read(void *buffer, size_t length);
+  bool readable();
+  void baud(int baudrate) { _baud = baudrate; }
+  void attach(Callback<void()> func, IrqType type = RxIrq);
+
+private:
+  void schedule_tx(bool fired);
+
+  int _baud;
+  sim::Uart _uart;
+  uint64_t _tx_free;          // virtual time the transmitter finishes its last byte
+  Callback<void()> _tx_irq;   // transmit interrupt, null if not attached
+  int _tx_id;                 // its pending schedule_isr(), 0 if none
+};
+
+// ---- time -------------------------------------------------------------------
+
+class Timer {
+public:
+  Timer();
+  ~Timer();
+  void start();
+  void stop();
+  void reset();
+  std::chrono::microseconds elapsed_time() const;
+
+protected:
+  explicit Timer(bool lock_deep_sleep);
+
+private:
+  bool _lock_deep_sleep;
+  bool _running;
+  uint64_t _start;
+  uint64_t _total;
+};
+
+class LowPowerTimer : public Timer {
+public:
+  LowPowerTimer() : Timer(false) {}
+};
+
+class Ticker {
+public:
+  Ticker();
+  ~Ticker();
+  void attach(Callback<void()> func, std::chrono::microseconds t);
+  void detach();
+
+protected:
+  Ticker(bool lock_deep_sleep, bool periodic);
+
+private:
+  void fire();
+
+  bool _lock_deep_sleep;
+  bool _periodic;
+  int _id;
+  uint64_t _period;
+  uint64_t _next;
+  Callback<void()> _func;
+};
+
+class Timeout : public Ticker {
+public:
+  Timeout() : Ticker(true, false) {}
+};
+
+class LowPowerTicker : public Ticker {
+public:
+  LowPowerTicker() : Ticker(false, true) {}
+};
+
+class LowPowerTimeout : public Ticker {
+public:
+  LowPowerTimeout() : Ticker(false, false) {}
+};
+
+// ---- misc -------------------------------------------------------------------
+
+class Watchdog {
+public:
+  static Watchdog &get_instance();
+  bool start(uint32_t timeout);
+  bool stop();
+  void kick();
+  uint32_t get_timeout() const { return _timeout; }
+  bool is_running() const { return _running; }
+
+private:
+  Watchdog() : _timeout(0), _running(false) {}
+  uint32_t _timeout;
+  bool _running;
+};
+
+class CriticalSectionLock {
+public:
+  CriticalSectionLock() { core_util_critical_section_enter(); }
+  ~CriticalSectionLock() { core_util_critical_section_exit(); }
+};
+
+} // namespace mbed
+
+// ---- RTOS -------------------------------------------------------------------
+
+namespace rtos {
+
+namespace Kernel {
+struct Clock {
+  using rep = int64_t;
+  using period = std::milli;
+  using duration = std::chrono::duration<rep, period>;
+  using time_point = std::chrono::time_point<Clock>;
+  using duration_u32 = std::chrono::duration<uint32_t, std::milli>;
+  static constexpr bool is_steady = true;
+  static time_point now();
+};
+} // namespace Kernel
+
+namespace ThisThread {
+void sleep_for(Kernel::Clock::duration_u32 rel_time);
+void sleep_until(Kernel::Clock::time_point abs_time);
+void yield();
+} // namespace ThisThread
+
+class Thread {
+public:
+  Thread(osPriority priority = osPriorityNormal,
+         uint32_t stack_size = OS_STACK_SIZE, unsigned char *stack_mem = nullptr,
+         const char *name = nullptr);
+  osStatus start(mbed::Callback<void()> task);
+  uint32_t stack_size() const { return _stack_size; }
+
+private:
+  osPriority _priority;
+  uint32_t _stack_size;
+  sim::Task *_task;
+};
+
+class Semaphore {
+public:
+  Semaphore(int32_t count = 0, uint16_t max_count = 0xffff);
+  void acquire();
+  bool try_acquire();
+  bool try_acquire_for(Kernel::Clock::duration_u32 rel_time);
+  osStatus release();
+
+private:
+  int32_t _count;
+  uint16_t _max;
+  sim::WaitQueue _q;
+};
+
+class Mutex {
+public:
+  void lock();
+  void unlock();
+
+private:
+  bool _locked = false;
+  sim::WaitQueue _q;
+};
+
+} // namespace rtos
+
+// ---- events -----------------------------------------------------------------
+
+namespace events {
+
+namespace detail {
+template <typename F, typename... A> void invoke(F &f, A &...a) { f(a...); }
+
+template <typename T, typename R, typename U, typename... MA, typename... A>
+void invoke(T *obj, R (U::*method)(MA...), A &...a) {
+  (obj->*method)(a...);
+}
+} // namespace detail
+
+class EventQueue {
+public:
+  EventQueue(unsigned size = 32 * EVENTS_EVENT_SIZE,
+             unsigned char *buffer = nullptr);
+
+  template <typename F, typename... A> int call(F f, A... a) {
+    return post(0, 0, [=]() mutable { detail::invoke(f, a...); });
+  }
+
+  template <typename F, typename... A>
+  int call_in(std::chrono::milliseconds ms, F f, A... a) {
+    return post(ms.count() * 1000, 0, [=]() mutable { detail::invoke(f, a...); });
+  }
+
+  template <typename F, typename... A>
+  int call_every(std::chrono::milliseconds ms, F f, A... a) {
+    return post(ms.count() * 1000, ms.count() * 1000,
+                [=]() mutable { detail::invoke(f, a...); });
+  }
+
+  bool cancel(int id);
+  void dispatch_forever();
+  void dispatch_for(std::chrono::milliseconds ms);
+  void break_dispatch();
+
+  struct Event;
+
+private:
+  int post(uint64_t delay, uint64_t period, std::function<void()> fn);
+  void dispatch(uint64_t until);
+
+  unsigned _capacity;
+  int _next_id;
+  bool _break;
+  void *_events;
+  sim::WaitQueue _q;
+};
+
+} // namespace events
+
+using namespace mbed;
+using namespace rtos;
+using namespace events;
+using namespace std::chrono_literals;
+
+// time() follows the simulated RTC, not the host clock
+#define time(t) sim_rtc_time(t)
+
+#endif
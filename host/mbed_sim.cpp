@@ -0,0 +1,1364 @@
+// Host-side simulation of the Nucleo and its peripherals
+//
+// See sim.h for the threading model and readme.md for the SIM_* environment
+// variables that script the simulated hardware.
+
+#include "mbed.h"
+
+#undef time
+
+#include <algorithm>
+#include <climits>
+#include <condition_variable>
+#include <map>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+GPIO_TypeDef sim_gpio[7];
+RCC_TypeDef sim_rcc;
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+uint32_t SystemCoreClock = 120000000;
+
+namespace sim {
+
+struct Task {
+  std::condition_variable cv;
+  bool go = false;
+  bool busy = false;
+  bool notified = false;
+  int timed_id = 0;
+  WaitQueue *queue = nullptr;
+};
+
+namespace {
+
+const uint64_t FOREVER = UINT64_MAX;
+const int LCD_SIM_ADDRESS = 0x7c;
+const int RGB_SIM_ADDRESS = 0xc4;
+
+struct Timed {
+  Task *task = nullptr;
+  bool sample = false;
+  std::function<void()> isr;
+};
+
+struct Press {
+  int key;
+  uint64_t down;
+  uint64_t up;
+};
+
+struct State {
+  std::mutex m;
+  Task main_task;
+  Task *current = &main_task;
+  std::deque<Task *> ready;
+  std::map<std::pair<uint64_t, int>, Timed> timed;
+  std::map<int, uint64_t> timed_at;
+  int next_id = 1;
+  uint64_t now = 0;
+  uint64_t limit = 60000000;
+  int isr_depth = 0;
+
+  // MCU supply current per CPU state, STM32L4R5 datasheet typicals at
+  // 120 MHz (run, sleep) and Stop 2 with the RTC running (deep sleep)
+  double run_ma = 13.2;
+  double sleep_ma = 3.6;
+  double stop_ua = 3.4;
+  int busy_waiters = 0;
+  int deep_sleep_locks = 0;
+  CpuStats cpu = {};
+
+  // pins
+  struct Pin {
+    int is_output = 0;
+    int value = 0;
+    int pull = PullNone;
+  } pins[SIM_PIN_COUNT];
+  std::vector<Irq *> irqs;
+  uint32_t odr_seen[7] = {};
+  uint64_t odr_since[7][16] = {};
+  uint64_t odr_high[7][16] = {};
+  unsigned odr_toggles[7][16] = {};
+
+  // DHT sensor
+  int dht_pin = PC_8;
+  int dht_type = 11;
+  int dht_temp = INT_MIN; // tenths of a degree C, INT_MIN = profile
+  int dht_hum = INT_MIN;
+  int dht_noise = 0;
+  unsigned dht_fail_every = 0;
+  uint64_t dht_low_since = 0;
+  bool dht_host_low = false;
+  std::vector<std::pair<uint64_t, int>> dht_wave;
+  unsigned dht_frames = 0;
+  unsigned dht_dropped = 0;
+  uint32_t dht_rand = 12345;
+
+  // keypad and button
+  std::vector<Press> keys;
+  std::vector<Press> button;
+
+  // I2C devices
+  struct Bus {
+    unsigned transactions = 0;
+    unsigned bytes = 0;
+    unsigned naks = 0;
+    uint64_t bus_us = 0;
+  } i2c_lcd, i2c_rgb, i2c_other;
+  char ddram[0x80];
+  int ac = 0;
+  uint64_t lcd_busy_until = 0;
+  unsigned lcd_clears = 0;
+  unsigned lcd_dropped = 0;
+  char rgb[16] = {};
+
+  // console UART
+  std::vector<std::pair<uint64_t, char>> rx_script;
+  std::deque<char> rx;
+  Uart *uart = nullptr;
+  unsigned rx_overruns = 0;
+
+  // watchdog
+  bool wd_running = false;
+  uint32_t wd_timeout = 0;
+  uint64_t wd_kick = 0;
+  uint64_t wd_max_gap = 0;
+
+  // RTC
+  int64_t rtc_base = 0;
+
+  State();
+};
+
+int parse_pin(const char *s) {
+  if (!s || s[0] != 'P' || s[1] < 'A' || s[1] > 'G' || s[2] != '_')
+    return NC;
+  return (s[1] - 'A') * 16 + atoi(s + 3);
+}
+
+// "key@ms[:hold],..." or "ms[:hold],..."
+std::vector<Press> parse_presses(const char *s, bool keyed) {
+  std::vector<Press> out;
+  while (s && *s) {
+    Press p;
+    p.key = 0;
+    if (keyed) {
+      p.key = *s++;
+      if (*s == '@')
+        s++;
+    }
+    char *end;
+    p.down = strtoull(s, &end, 10) * 1000;
+    uint64_t hold = 100;
+    if (*end == ':')
+      hold = strtoull(end + 1, &end, 10);
+    p.up = p.down + hold * 1000;
+    out.push_back(p);
+    s = (*end == ',') ? end + 1 : end;
+    if (end == s && *s != '\0' && *s != ',')
+      break;
+  }
+  return out;
+}
+
+// "ms:text;ms:text..." with \r, \n and \\ escapes, one byte every 100 us
+std::vector<std::pair<uint64_t, char>> parse_rx(const char *s) {
+  std::vector<std::pair<uint64_t, char>> out;
+  while (s && *s) {
+    char *end;
+    uint64_t t = strtoull(s, &end, 10) * 1000;
+    if (*end != ':')
+      break;
+    s = end + 1;
+    for (; *s && *s != ';'; s++, t += 100) {
+      char c = *s;
+      if (c == '\\' && s[1]) {
+        c = *++s;
+        c = c == 'r' ? '\r' : c == 'n' ? '\n' : c;
+      }
+      out.push_back(std::make_pair(t, c));
+    }
+    if (*s == ';')
+      s++;
+  }
+  return out;
+}
+
+State::State() {
+  memset(ddram, ' ', sizeof(ddram));
+  if (const char *v = getenv("SIM_TIME_MS"))
+    limit = strtoull(v, nullptr, 10) * 1000;
+  if (const char *v = getenv("SIM_DHT_PIN"))
+    dht_pin = parse_pin(v);
+  if (const char *v = getenv("SIM_DHT_TYPE"))
+    dht_type = atoi(v);
+  if (const char *v = getenv("SIM_DHT_TEMP"))
+    dht_temp = (int)(atof(v) * 10);
+  if (const char *v = getenv("SIM_DHT_HUM"))
+    dht_hum = (int)(atof(v) * 10);
+  if (const char *v = getenv("SIM_DHT_NOISE"))
+    dht_noise = atoi(v);
+  if (const char *v = getenv("SIM_DHT_FAIL_EVERY"))
+    dht_fail_every = atoi(v);
+  keys = parse_presses(getenv("SIM_KEYS"), true);
+  button = parse_presses(getenv("SIM_BUTTON"), false);
+  rx_script = parse_rx(getenv("SIM_RX"));
+  if (const char *v = getenv("SIM_RUN_MA"))
+    run_ma = atof(v);
+  if (const char *v = getenv("SIM_SLEEP_MA"))
+    sleep_ma = atof(v);
+  if (const char *v = getenv("SIM_STOP_UA"))
+    stop_ua = atof(v);
+}
+
+State &S() {
+  static State s;
+  return s;
+}
+
+typedef std::unique_lock<std::mutex> Lock;
+
+void report(State &s);
+void sample_locked(State &s, Lock &lk);
+
+[[noreturn]] void finish_locked(State &s, int code) {
+  report(s);
+  fflush(stdout);
+  fflush(stderr);
+  _exit(code);
+}
+
+void advance_to(State &s, uint64_t t) {
+  if (t <= s.now)
+    return;
+  if (t > s.limit) {
+    t = s.limit;
+  }
+  uint64_t dt = t - s.now;
+  if (s.isr_depth > 0 || s.busy_waiters > 0)
+    s.cpu.busy += dt;
+  else if (s.deep_sleep_locks > 0)
+    s.cpu.sleep += dt;
+  else
+    s.cpu.deep_sleep += dt;
+  s.now = t;
+
+  if (s.wd_running && s.now - s.wd_kick > (uint64_t)s.wd_timeout * 1000) {
+    printf("[sim] watchdog reset at %.3f s\n", s.now / 1e6);
+    finish_locked(s, 3);
+  }
+  if (s.now >= s.limit)
+    finish_locked(s, 0);
+}
+
+int add_timed(State &s, uint64_t t, Timed ev) {
+  if (t < s.now)
+    t = s.now;
+  int id = s.next_id++;
+  s.timed[std::make_pair(t, id)] = std::move(ev);
+  s.timed_at[id] = t;
+  return id;
+}
+
+bool remove_timed(State &s, int id) {
+  auto at = s.timed_at.find(id);
+  if (at == s.timed_at.end())
+    return false;
+  s.timed.erase(std::make_pair(at->second, id));
+  s.timed_at.erase(at);
+  return true;
+}
+
+void wake_locked(State &s, Task *task, bool notified) {
+  if (task->queue) {
+    auto &w = task->queue->waiters;
+    w.erase(std::remove(w.begin(), w.end(), task), w.end());
+    task->queue = nullptr;
+  }
+  if (task->timed_id) {
+    remove_timed(s, task->timed_id);
+    task->timed_id = 0;
+  }
+  if (task->busy) {
+    task->busy = false;
+    s.busy_waiters--;
+  }
+  task->notified = notified;
+  s.ready.push_back(task);
+}
+
+void run_isr(State &s, Lock &lk, const std::function<void()> &fn) {
+  s.isr_depth++;
+  lk.unlock();
+  fn();
+  lk.lock();
+  s.isr_depth--;
+}
+
+// Hand the CPU to the next runnable task, advancing virtual time through
+// timed events until one becomes runnable. self == nullptr for exiting tasks.
+void reschedule(State &s, Lock &lk, Task *self) {
+  for (;;) {
+    if (!s.ready.empty()) {
+      Task *next = s.ready.front();
+      s.ready.pop_front();
+      s.current = next;
+      next->go = true;
+      if (next != self)
+        next->cv.notify_one();
+      break;
+    }
+    if (s.timed.empty()) {
+      // with a pin interrupt armed the firmware is asleep waiting for input
+      // the run has no more of, which is not a deadlock
+      for (Irq *irq : s.irqs)
+        if (irq->enabled && (irq->rise || irq->fall))
+          advance_to(s, s.limit);
+      printf("[sim] deadlock: every thread is blocked with nothing pending\n");
+      finish_locked(s, 1);
+    }
+    auto it = s.timed.begin();
+    uint64_t t = it->first.first;
+    int id = it->first.second;
+    Timed ev = std::move(it->second);
+    s.timed.erase(it);
+    s.timed_at.erase(id);
+    advance_to(s, t);
+    if (ev.task) {
+      ev.task->timed_id = 0;
+      wake_locked(s, ev.task, false);
+    } else if (ev.isr) {
+      run_isr(s, lk, ev.isr);
+    }
+    sample_locked(s, lk);
+  }
+  if (self) {
+    self->cv.wait(lk, [self] { return self->go; });
+    self->go = false;
+  }
+}
+
+void block_until(State &s, Lock &lk, uint64_t t, bool busy) {
+  Task *self = s.current;
+  if (busy) {
+    self->busy = true;
+    s.busy_waiters++;
+  }
+  Timed ev;
+  ev.task = self;
+  self->timed_id = add_timed(s, t, std::move(ev));
+  reschedule(s, lk, self);
+}
+
+// ---- pins -------------------------------------------------------------------
+
+int dht_level(State &s);
+int keypad_level(State &s, int pin, bool &driven);
+int button_level(State &s, int pin, bool &driven);
+
+int level_locked(State &s, int pin) {
+  if (pin < 0 || pin >= SIM_PIN_COUNT)
+    return 0;
+  int port = pin >> 4, bit = pin & 15;
+  if (((sim_gpio[port].MODER >> (bit * 2)) & 3) == 1)
+    return (sim_gpio[port].ODR >> bit) & 1;
+  if (s.pins[pin].is_output)
+    return s.pins[pin].value;
+  if (pin == s.dht_pin)
+    return dht_level(s);
+  bool driven = false;
+  int level = keypad_level(s, pin, driven);
+  if (driven)
+    return level;
+  level = button_level(s, pin, driven);
+  if (driven)
+    return level;
+  return s.pins[pin].pull == PullUp ? 1 : 0;
+}
+
+void watch_outputs(State &s) {
+  for (int port = 0; port < 7; port++) {
+    uint32_t odr = sim_gpio[port].ODR;
+    uint32_t changed = odr ^ s.odr_seen[port];
+    if (!changed)
+      continue;
+    for (int bit = 0; bit < 16; bit++) {
+      if (!(changed & (1u << bit)))
+        continue;
+      s.odr_toggles[port][bit]++;
+      if (odr & (1u << bit))
+        s.odr_since[port][bit] = s.now;
+      else
+        s.odr_high[port][bit] += s.now - s.odr_since[port][bit];
+    }
+    s.odr_seen[port] = odr;
+  }
+}
+
+void sample_locked(State &s, Lock &lk) {
+  if (s.isr_depth > 0)
+    return;
+  watch_outputs(s);
+  std::vector<std::function<void()>> fire;
+  for (Irq *irq : s.irqs) {
+    int level = level_locked(s, irq->pin);
+    if (level == irq->level)
+      continue;
+    irq->level = level;
+    if (!irq->enabled)
+      continue;
+    if (level && irq->rise)
+      fire.push_back(irq->rise);
+    if (!level && irq->fall)
+      fire.push_back(irq->fall);
+  }
+  for (auto &fn : fire)
+    run_isr(s, lk, fn);
+}
+
+void add_sample(State &s, uint64_t t) {
+  Timed ev;
+  ev.sample = true;
+  add_timed(s, t, std::move(ev));
+}
+
+// ---- DHT sensor ---------------------------------------------------------------
+
+int triangle(uint64_t t_us, int lo, int hi, uint64_t period_s) {
+  uint64_t phase = (t_us / 1000) % (period_s * 1000);
+  uint64_t half = period_s * 500;
+  uint64_t up = phase < half ? phase : period_s * 1000 - phase;
+  return lo + (int)((hi - lo) * up / half);
+}
+
+void dht_frame(State &s, uint64_t released) {
+  s.dht_frames++;
+  s.dht_wave.clear();
+  if (s.dht_fail_every && s.dht_frames % s.dht_fail_every == 0) {
+    s.dht_dropped++;
+    return;
+  }
+
+  int temp = s.dht_temp != INT_MIN ? s.dht_temp : triangle(s.now, 200, 260, 240);
+  int hum = s.dht_hum != INT_MIN ? s.dht_hum : triangle(s.now, 400, 660, 300);
+  if (s.dht_noise) {
+    s.dht_rand = s.dht_rand * 1103515245u + 12345u;
+    temp += (int)((s.dht_rand >> 16) % (2 * s.dht_noise + 1)) - s.dht_noise;
+  }
+
+  uint8_t b[5];
+  if (s.dht_type == 22) {
+    unsigned t = temp < 0 ? (0x8000 | -temp) : temp;
+    b[0] = hum >> 8;
+    b[1] = hum & 0xff;
+    b[2] = t >> 8;
+    b[3] = t & 0xff;
+  } else {
+    b[0] = hum / 10;
+    b[1] = 0;
+    b[2] = temp / 10;
+    b[3] = 0;
+  }
+  b[4] = b[0] + b[1] + b[2] + b[3];
+
+  uint64_t t = released + 30;
+  auto edge = [&](int level) {
+    s.dht_wave.push_back(std::make_pair(t, level));
+    add_sample(s, t);
+  };
+  edge(0);
+  t += 80;
+  edge(1);
+  t += 80;
+  for (int i = 0; i < 40; i++) {
+    edge(0);
+    t += 50;
+    edge(1);
+    t += (b[i / 8] & (0x80 >> (i % 8))) ? 70 : 26;
+  }
+  edge(0);
+  t += 50;
+  edge(1);
+}
+
+void dht_drive(State &s, int was_low, int is_low) {
+  if (!was_low && is_low) {
+    s.dht_low_since = s.now;
+    s.dht_wave.clear();
+  } else if (was_low && !is_low) {
+    if (s.now - s.dht_low_since >= 800)
+      dht_frame(s, s.now);
+  }
+}
+
+int dht_level(State &s) {
+  auto &w = s.dht_wave;
+  if (w.empty() || s.now < w.front().first)
+    return 1;
+  auto it = std::upper_bound(
+      w.begin(), w.end(), std::make_pair(s.now, INT_MAX));
+  return (it - 1)->second;
+}
+
+// ---- keypad and button ------------------------------------------------------
+
+const int KEY_ROWS[4] = {PC_11, PC_10, PC_9, PC_8};
+const int KEY_COLS[4] = {PF_5, PF_3, PD_2, PC_12};
+const char KEY_MAP[4][5] = {"123A", "456B", "789C", "*0#D"};
+
+int keypad_level(State &s, int pin, bool &driven) {
+  if (s.keys.empty())
+    return 0;
+  int col = -1;
+  for (int c = 0; c < 4; c++)
+    if (KEY_COLS[c] == pin)
+      col = c;
+  if (col < 0)
+    return 0;
+  driven = true;
+  for (const Press &p : s.keys) {
+    if (s.now < p.down || s.now >= p.up)
+      continue;
+    for (int r = 0; r < 4; r++)
+      if (KEY_MAP[r][col] == p.key && level_locked(s, KEY_ROWS[r]))
+        return 1;
+  }
+  return 0;
+}
+
+int button_level(State &s, int pin, bool &driven) {
+  if (pin != BUTTON1 || s.button.empty())
+    return 0;
+  driven = true;
+  for (const Press &p : s.button)
+    if (s.now >= p.down && s.now < p.up)
+      return 1;
+  return 0;
+}
+
+// ---- report -------------------------------------------------------------------
+
+void report_bus(const char *name, const State::Bus &b) {
+  if (!b.transactions)
+    return;
+  printf("[sim] i2c %s: %u transactions, %u bytes, %.3f ms bus time, %u nak\n",
+         name, b.transactions, b.bytes, b.bus_us / 1e3, b.naks);
+}
+
+void report(State &s) {
+  watch_outputs(s);
+  uint64_t up = s.now ? s.now : 1;
+  printf("[sim] ---- stopped at %.3f s ----\n", s.now / 1e6);
+  printf("[sim] cpu: busy %.2f%%, sleep %.2f%%, deep sleep %.2f%%\n",
+         100.0 * s.cpu.busy / up, 100.0 * s.cpu.sleep / up,
+         100.0 * s.cpu.deep_sleep / up);
+  double ma = (s.cpu.busy * s.run_ma + s.cpu.sleep * s.sleep_ma +
+               s.cpu.deep_sleep * s.stop_ua / 1000) / up;
+  printf("[sim] mcu current: average %.3f mA (run %.1f mA, sleep %.1f mA, "
+         "deep sleep %.1f uA)\n",
+         ma, s.run_ma, s.sleep_ma, s.stop_ua);
+  report_bus("lcd", s.i2c_lcd);
+  report_bus("rgb", s.i2c_rgb);
+  report_bus("other", s.i2c_other);
+  if (s.i2c_lcd.transactions) {
+    printf("[sim] lcd: \"%.16s\"\n", s.ddram);
+    printf("[sim] lcd: \"%.16s\"\n", s.ddram + 0x40);
+    printf("[sim] lcd: %u clears, %u bytes dropped while busy\n", s.lcd_clears,
+           s.lcd_dropped);
+  }
+  if (s.dht_frames)
+    printf("[sim] dht: %u start pulses, %u unanswered\n", s.dht_frames,
+           s.dht_dropped);
+  for (int port = 0; port < 7; port++)
+    for (int bit = 0; bit < 16; bit++) {
+      if (!s.odr_toggles[port][bit])
+        continue;
+      uint64_t high = s.odr_high[port][bit];
+      if (s.odr_seen[port] & (1u << bit))
+        high += s.now - s.odr_since[port][bit];
+      printf("[sim] P%c%d: %u toggles, high %.1f%%\n", 'A' + port, bit,
+             s.odr_toggles[port][bit], 100.0 * high / up);
+    }
+  if (!s.rx_script.empty())
+    printf("[sim] uart: %zu bytes received, %u overruns\n", s.rx_script.size(),
+           s.rx_overruns);
+  if (s.wd_running)
+    printf("[sim] watchdog: longest gap between kicks %.1f ms of %u ms\n",
+           s.wd_max_gap / 1e3, s.wd_timeout);
+}
+
+} // namespace
+
+// ---- public API ---------------------------------------------------------------
+
+uint64_t now_us() { return S().now; }
+
+bool in_isr() { return S().isr_depth > 0; }
+
+void busy_us(uint64_t us) {
+  State &s = S();
+  Lock lk(s.m);
+  if (s.isr_depth > 0) {
+    // interrupts of equal priority are masked, nothing else can run
+    advance_to(s, s.now + us);
+    return;
+  }
+  sample_locked(s, lk);
+  block_until(s, lk, s.now + us, true);
+}
+
+void sleep_until_us(uint64_t t) {
+  State &s = S();
+  Lock lk(s.m);
+  if (s.isr_depth > 0) {
+    advance_to(s, t);
+    return;
+  }
+  sample_locked(s, lk);
+  block_until(s, lk, t, false);
+}
+
+bool wait(WaitQueue &q, uint64_t deadline) {
+  State &s = S();
+  Lock lk(s.m);
+  if (s.isr_depth > 0)
+    return false;
+  sample_locked(s, lk);
+  Task *self = s.current;
+  q.waiters.push_back(self);
+  self->queue = &q;
+  self->notified = false;
+  if (deadline != FOREVER) {
+    Timed ev;
+    ev.task = self;
+    self->timed_id = add_timed(s, deadline, std::move(ev));
+  }
+  reschedule(s, lk, self);
+  return self->notified;
+}
+
+void notify_one(WaitQueue &q) {
+  State &s = S();
+  Lock lk(s.m);
+  if (!q.waiters.empty())
+    wake_locked(s, q.waiters.front(), true);
+}
+
+void notify_all(WaitQueue &q) {
+  State &s = S();
+  Lock lk(s.m);
+  while (!q.waiters.empty())
+    wake_locked(s, q.waiters.front(), true);
+}
+
+int schedule_isr(uint64_t t, std::function<void()> fn) {
+  State &s = S();
+  Lock lk(s.m);
+  Timed ev;
+  ev.isr = std::move(fn);
+  return add_timed(s, t, std::move(ev));
+}
+
+bool cancel_isr(int id) {
+  State &s = S();
+  Lock lk(s.m);
+  return remove_timed(s, id);
+}
+
+Task *spawn(std::function<void()> fn) {
+  State &s = S();
+  Lock lk(s.m);
+  Task *task = new Task;
+  s.ready.push_back(task);
+  std::thread([task, fn] {
+    State &s = S();
+    {
+      Lock lk(s.m);
+      task->cv.wait(lk, [task] { return task->go; });
+      task->go = false;
+    }
+    fn();
+    Lock lk(s.m);
+    reschedule(s, lk, nullptr);
+  }).detach();
+  return task;
+}
+
+void lock_deep_sleep() {
+  State &s = S();
+  Lock lk(s.m);
+  s.deep_sleep_locks++;
+}
+
+void unlock_deep_sleep() {
+  State &s = S();
+  Lock lk(s.m);
+  s.deep_sleep_locks--;
+}
+
+CpuStats cpu_stats() {
+  State &s = S();
+  Lock lk(s.m);
+  CpuStats c = s.cpu;
+  c.uptime = s.now;
+  return c;
+}
+
+int pin_read(int pin) {
+  State &s = S();
+  Lock lk(s.m);
+  return level_locked(s, pin);
+}
+
+void pin_drive(int pin, int is_output, int value, int pull) {
+  State &s = S();
+  Lock lk(s.m);
+  if (pin < 0 || pin >= SIM_PIN_COUNT)
+    return;
+  State::Pin &p = s.pins[pin];
+  int was_low = p.is_output && !p.value;
+  p.is_output = is_output;
+  p.value = value;
+  p.pull = pull;
+  if (pin == s.dht_pin)
+    dht_drive(s, was_low, is_output && !value);
+  sample_locked(s, lk);
+}
+
+void sample_inputs() {
+  State &s = S();
+  Lock lk(s.m);
+  sample_locked(s, lk);
+}
+
+void irq_register(Irq *irq) {
+  State &s = S();
+  Lock lk(s.m);
+  irq->level = level_locked(s, irq->pin);
+  s.irqs.push_back(irq);
+}
+
+void irq_unregister(Irq *irq) {
+  State &s = S();
+  Lock lk(s.m);
+  s.irqs.erase(std::remove(s.irqs.begin(), s.irqs.end(), irq), s.irqs.end());
+}
+
+uint64_t i2c_bus_time_us(int length, int hz) {
+  // address + data bytes at 9 clocks each, plus START and STOP
+  return ((uint64_t)(length + 1) * 9 + 2) * 1000000 / hz;
+}
+
+int i2c_deliver(int address, const char *data, int length) {
+  State &s = S();
+  Lock lk(s.m);
+  State::Bus &bus = address == LCD_SIM_ADDRESS   ? s.i2c_lcd
+                    : address == RGB_SIM_ADDRESS ? s.i2c_rgb
+                                                 : s.i2c_other;
+  bus.transactions++;
+  bus.bytes += length;
+  bus.bus_us += i2c_bus_time_us(length, 100000);
+  if (address == RGB_SIM_ADDRESS) {
+    if (length >= 1) {
+      int reg = data[0] & 0x0f;
+      for (int i = 1; i < length; i++)
+        s.rgb[(reg + (data[0] & 0x80 ? i - 1 : 0)) & 0x0f] = data[i];
+    }
+    return 0;
+  }
+  if (address != LCD_SIM_ADDRESS) {
+    bus.naks++;
+    return 2;
+  }
+
+  // Control byte: bit 7 (Co) set means one byte follows before the next
+  // control byte, bit 6 (RS) selects data RAM instead of the command register.
+  int i = 0;
+  while (i < length) {
+    int ctrl = data[i++];
+    int run = (ctrl & 0x80) ? 1 : length - i;
+    for (int n = 0; n < run && i < length; n++) {
+      unsigned char b = data[i++];
+      if (s.now < s.lcd_busy_until) {
+        s.lcd_dropped++;
+        continue;
+      }
+      if (ctrl & 0x40) {
+        s.ddram[s.ac & 0x7f] = b;
+        s.ac = s.ac == 0x27 ? 0x40 : s.ac == 0x67 ? 0x00 : s.ac + 1;
+      } else if (b & 0x80) {
+        s.ac = b & 0x7f;
+      } else if (b == 0x01) {
+        memset(s.ddram, ' ', sizeof(s.ddram));
+        s.ac = 0;
+        s.lcd_clears++;
+        s.lcd_busy_until = s.now + 1530;
+      } else if ((b & 0xfe) == 0x02) {
+        s.ac = 0;
+      }
+    }
+  }
+  return 0;
+}
+
+void uart_register(Uart *uart) {
+  State &s = S();
+  Lock lk(s.m);
+  s.uart = uart;
+}
+
+void uart_unregister(Uart *uart) {
+  State &s = S();
+  Lock lk(s.m);
+  if (s.uart == uart)
+    s.uart = nullptr;
+}
+
+int uart_getc() {
+  State &s = S();
+  Lock lk(s.m);
+  if (s.rx.empty())
+    return -1;
+  char c = s.rx.front();
+  s.rx.pop_front();
+  return (unsigned char)c;
+}
+
+bool uart_readable() {
+  State &s = S();
+  Lock lk(s.m);
+  return !s.rx.empty();
+}
+
+// One received byte. The holding register keeps a single byte, so an
+// unread byte is lost when the next one arrives, as on the real UART.
+void uart_receive(char c) {
+  State &s = S();
+  std::function<void()> irq;
+  {
+    Lock lk(s.m);
+    if (!s.rx.empty()) {
+      s.rx.clear();
+      s.rx_overruns++;
+    }
+    s.rx.push_back(c);
+    if (s.uart)
+      irq = s.uart->rx_irq;
+  }
+  if (irq)
+    irq();
+}
+
+void watchdog_start(uint32_t timeout_ms) {
+  State &s = S();
+  Lock lk(s.m);
+  s.wd_running = true;
+  s.wd_timeout = timeout_ms;
+  s.wd_kick = s.now;
+}
+
+void watchdog_kick() {
+  State &s = S();
+  Lock lk(s.m);
+  s.wd_max_gap = std::max(s.wd_max_gap, s.now - s.wd_kick);
+  s.wd_kick = s.now;
+}
+
+void finish(int code) {
+  State &s = S();
+  Lock lk(s.m);
+  finish_locked(s, code);
+}
+
+void rtc_set(time_t t) {
+  State &s = S();
+  s.rtc_base = (int64_t)t - (int64_t)(s.now / 1000000);
+}
+
+time_t rtc_now() {
+  State &s = S();
+  return (time_t)(s.rtc_base + (int64_t)(s.now / 1000000));
+}
+
+// Scripted presses need an input sample at their edges even while every
+// thread sleeps; queue those once the first time the state is touched.
+struct PressSampler {
+  PressSampler() {
+    State &s = S();
+    Lock lk(s.m);
+    for (const Press &p : s.keys) {
+      add_sample(s, p.down);
+      add_sample(s, p.up);
+    }
+    for (const Press &p : s.button) {
+      add_sample(s, p.down);
+      add_sample(s, p.up);
+    }
+    for (const auto &rx : s.rx_script) {
+      Timed ev;
+      char c = rx.second;
+      ev.isr = [c] { uart_receive(c); };
+      add_timed(s, rx.first, std::move(ev));
+    }
+  }
+} press_sampler;
+
+} // namespace sim
+
+// ---- mbed API -------------------------------------------------------------------
+
+void mbed_stats_cpu_get(mbed_stats_cpu_t *stats) {
+  sim::CpuStats c = sim::cpu_stats();
+  stats->uptime = c.uptime;
+  stats->idle_time = c.sleep + c.deep_sleep;
+  stats->sleep_time = c.sleep;
+  stats->deep_sleep_time = c.deep_sleep;
+}
+
+// the counter only runs once enabled, and keeps counting from the value
+// last written
+static uint64_t cyccnt_base_us = 0;
+static uint32_t cyccnt_base = 0;
+SimCycleCounter::operator uint32_t() const {
+  if (!(sim_dwt.CTRL & DWT_CTRL_CYCCNTENA_Msk))
+    return cyccnt_base;
+  uint64_t us = sim::now_us() - cyccnt_base_us;
+  return cyccnt_base + (uint32_t)(us * (SystemCoreClock / 1000000));
+}
+SimCycleCounter &SimCycleCounter::operator=(uint32_t value) {
+  cyccnt_base = value;
+  cyccnt_base_us = sim::now_us();
+  return *this;
+}
+
+void wait_us(int us) { sim::busy_us(us); }
+void wait_ns(unsigned int ns) { sim::busy_us(ns / 1000); }
+void thread_sleep_for(uint32_t ms) {
+  sim::sleep_until_us(sim::now_us() + (uint64_t)ms * 1000);
+}
+uint32_t us_ticker_read() { return (uint32_t)sim::now_us(); }
+
+void sleep_manager_lock_deep_sleep() { sim::lock_deep_sleep(); }
+void sleep_manager_unlock_deep_sleep() { sim::unlock_deep_sleep(); }
+
+// The simulation is cooperative: an interrupt can only fire while the running
+// thread is inside a sim call, so critical sections have nothing to mask.
+void core_util_critical_section_enter() {}
+void core_util_critical_section_exit() {}
+
+void set_time(time_t t) { sim::rtc_set(t); }
+time_t sim_rtc_time(time_t *t) {
+  time_t now = sim::rtc_now();
+  if (t)
+    *t = now;
+  return now;
+}
+
+namespace mbed {
+
+DigitalIn::DigitalIn(PinName pin, PinMode mode) : _pin(pin), _mode(mode) {
+  sim::pin_drive(_pin, 0, 0, _mode);
+}
+int DigitalIn::read() {
+  sim::busy_us(1);
+  return sim::pin_read(_pin);
+}
+void DigitalIn::mode(PinMode pull) {
+  _mode = pull;
+  sim::pin_drive(_pin, 0, 0, _mode);
+}
+
+DigitalOut::DigitalOut(PinName pin, int value) : _pin(pin), _value(value) {
+  sim::pin_drive(_pin, 1, _value, PullNone);
+}
+void DigitalOut::write(int value) {
+  _value = value ? 1 : 0;
+  sim::pin_drive(_pin, 1, _value, PullNone);
+}
+
+DigitalInOut::DigitalInOut(PinName pin)
+    : _pin(pin), _mode(PullNone), _output(0), _value(0) {
+  drive();
+}
+void DigitalInOut::output() {
+  _output = 1;
+  drive();
+}
+void DigitalInOut::input() {
+  _output = 0;
+  drive();
+}
+void DigitalInOut::mode(PinMode pull) {
+  _mode = pull;
+  drive();
+}
+void DigitalInOut::write(int value) {
+  _value = value ? 1 : 0;
+  drive();
+}
+int DigitalInOut::read() {
+  // polling a pin costs bus cycles, and lets spin loops see time pass
+  sim::busy_us(1);
+  return sim::pin_read(_pin);
+}
+void DigitalInOut::drive() { sim::pin_drive(_pin, _output, _value, _mode); }
+
+InterruptIn::InterruptIn(PinName pin, PinMode mode) : _pin(pin) {
+  sim::pin_drive(_pin, 0, 0, mode);
+  _irq.pin = pin;
+  _irq.enabled = 1;
+  sim::irq_register(&_irq);
+}
+InterruptIn::~InterruptIn() { sim::irq_unregister(&_irq); }
+void InterruptIn::rise(Callback<void()> func) {
+  _irq.rise = func ? std::function<void()>(func) : std::function<void()>();
+}
+void InterruptIn::fall(Callback<void()> func) {
+  _irq.fall = func ? std::function<void()>(func) : std::function<void()>();
+}
+void InterruptIn::enable_irq() { _irq.enabled = 1; }
+void InterruptIn::disable_irq() { _irq.enabled = 0; }
+void InterruptIn::mode(PinMode pull) { sim::pin_drive(_pin, 0, 0, pull); }
+int InterruptIn::read() { return sim::pin_read(_pin); }
+
+I2C::I2C(PinName, PinName) : _hz(100000), _busy(false) {}
+void I2C::frequency(int hz) { _hz = hz; }
+int I2C::write(int address, const char *data, int length, bool) {
+  sim::busy_us(sim::i2c_bus_time_us(length, _hz));
+  return sim::i2c_deliver(address, data, length);
+}
+int I2C::read(int, char *data, int length, bool) {
+  sim::busy_us(sim::i2c_bus_time_us(length, _hz));
+  memset(data, 0, length);
+  return 0;
+}
+int I2C::transfer(int address, const char *tx_buffer, int tx_length, char *,
+                  int, const event_callback_t &callback, int event, bool) {
+  if (_busy)
+    return -1;
+  _busy = true;
+  sim::lock_deep_sleep();
+  event_callback_t cb = callback;
+  sim::schedule_isr(
+      sim::now_us() + sim::i2c_bus_time_us(tx_length, _hz),
+      [this, address, tx_buffer, tx_length, cb, event] {
+        int ack = sim::i2c_deliver(address, tx_buffer, tx_length);
+        _busy = false;
+        sim::unlock_deep_sleep();
+        int ev = ack == 0 ? I2C_EVENT_TRANSFER_COMPLETE
+                          : I2C_EVENT_ERROR_NO_SLAVE;
+        if (cb && (ev & event))
+          cb(ev);
+      });
+  return 0;
+}
+void I2C::abort_transfer() {}
+
+UnbufferedSerial::UnbufferedSerial(PinName, PinName, int baud)
+    : _baud(baud), _tx_free(0), _tx_id(0) {
+  sim::uart_register(&_uart);
+}
+UnbufferedSerial::~UnbufferedSerial() {
+  if (_tx_id)
+    sim::cancel_isr(_tx_id);
+  sim::uart_unregister(&_uart);
+}
+ssize_t UnbufferedSerial::write(const void *buffer, size_t length) {
+  if (!length)
+    return 0;
+  // 10 bits per byte. Blocking like the real unbuffered driver: each byte
+  // waits for the data register, which empties when the byte before it
+  // starts shifting out, so the call returns with its last byte on the line
+  uint64_t byte_us = 10000000 / _baud;
+  uint64_t now = sim::now_us();
+  uint64_t start = _tx_free > now ? _tx_free : now;
+  uint64_t wait = start - now + (length - 1) * byte_us;
+  if (wait)
+    sim::busy_us(wait);
+  _tx_free = sim::now_us() + byte_us;
+  fwrite(buffer, 1, length, stdout);
+  return length;
+}
+ssize_t UnbufferedSerial::read(void *buffer, size_t length) {
+  size_t n = 0;
+  int c;
+  while (n < length && (c = sim::uart_getc()) >= 0)
+    static_cast<char *>(buffer)[n++] = c;
+  return n;
+}
+bool UnbufferedSerial::readable() { return sim::uart_readable(); }
+// The transmit interrupt fires whenever the data register is empty, i.e.
+// from the moment the last byte written starts shifting out, and keeps
+// firing while it stays empty, until the handler detaches it.
+void UnbufferedSerial::schedule_tx(bool fired) {
+  uint64_t now = sim::now_us();
+  uint64_t t = _tx_free > now ? _tx_free : now;
+  // a handler that wrote nothing would fire again at once; give the
+  // simulation a byte time to move on
+  if (fired && t == now)
+    t += 10000000 / _baud;
+  _tx_id = sim::schedule_isr(t, [this] {
+    _tx_id = 0;
+    // the handler may detach itself, call a copy
+    Callback<void()> irq = _tx_irq;
+    irq();
+    if (_tx_irq && !_tx_id)
+      schedule_tx(true);
+  });
+}
+void UnbufferedSerial::attach(Callback<void()> func, IrqType type) {
+  if (type == TxIrq) {
+    // as for receive, an attached handler keeps the UART clocked
+    if (func && !_tx_irq)
+      sim::lock_deep_sleep();
+    else if (!func && _tx_irq)
+      sim::unlock_deep_sleep();
+    _tx_irq = func;
+    if (_tx_id)
+      sim::cancel_isr(_tx_id);
+    _tx_id = 0;
+    if (_tx_irq)
+      schedule_tx(false);
+    return;
+  }
+  // like mbed's SerialBase, a receive handler keeps the MCU out of deep
+  // sleep, the UART clock would stop
+  if (func && !_uart.rx_irq)
+    sim::lock_deep_sleep();
+  else if (!func && _uart.rx_irq)
+    sim::unlock_deep_sleep();
+  _uart.rx_irq = func ? std::function<void()>(func) : std::function<void()>();
+}
+
+Timer::Timer() : Timer(true) {}
+Timer::Timer(bool lock_deep_sleep)
+    : _lock_deep_sleep(lock_deep_sleep), _running(false), _start(0),
+      _total(0) {}
+Timer::~Timer() {
+  if (_running && _lock_deep_sleep)
+    sim::unlock_deep_sleep();
+}
+void Timer::start() {
+  if (_running)
+    return;
+  _running = true;
+  _start = sim::now_us();
+  if (_lock_deep_sleep)
+    sim::lock_deep_sleep();
+}
+void Timer::stop() {
+  if (!_running)
+    return;
+  _total += sim::now_us() - _start;
+  _running = false;
+  if (_lock_deep_sleep)
+    sim::unlock_deep_sleep();
+}
+void Timer::reset() {
+  _total = 0;
+  _start = sim::now_us();
+}
+std::chrono::microseconds Timer::elapsed_time() const {
+  // reading the counter costs a register access, like DigitalInOut::read
+  sim::busy_us(1);
+  uint64_t t = _total + (_running ? sim::now_us() - _start : 0);
+  return std::chrono::microseconds(t);
+}
+
+Ticker::Ticker() : Ticker(true, true) {}
+Ticker::Ticker(bool lock_deep_sleep, bool periodic)
+    : _lock_deep_sleep(lock_deep_sleep), _periodic(periodic), _id(0),
+      _period(0), _next(0) {}
+Ticker::~Ticker() { detach(); }
+void Ticker::attach(Callback<void()> func, std::chrono::microseconds t) {
+  detach();
+  _func = func;
+  _period = t.count();
+  _next = sim::now_us() + _period;
+  _id = sim::schedule_isr(_next, [this] { fire(); });
+  if (_lock_deep_sleep)
+    sim::lock_deep_sleep();
+}
+void Ticker::detach() {
+  if (!_id)
+    return;
+  sim::cancel_isr(_id);
+  _id = 0;
+  if (_lock_deep_sleep)
+    sim::unlock_deep_sleep();
+}
+void Ticker::fire() {
+  if (_periodic) {
+    _next += _period;
+    _id = sim::schedule_isr(_next, [this] { fire(); });
+  } else {
+    _id = 0;
+    if (_lock_deep_sleep)
+      sim::unlock_deep_sleep();
+  }
+  Callback<void()> func = _func;
+  if (func)
+    func();
+}
+
+Watchdog &Watchdog::get_instance() {
+  static Watchdog instance;
+  return instance;
+}
+bool Watchdog::start(uint32_t timeout) {
+  _timeout = timeout;
+  _running = true;
+  sim::watchdog_start(timeout);
+  return true;
+}
+bool Watchdog::stop() { return false; }
+void Watchdog::kick() { sim::watchdog_kick(); }
+
+} // namespace mbed
+
+namespace rtos {
+
+Kernel::Clock::time_point Kernel::Clock::now() {
+  return time_point(duration(sim::now_us() / 1000));
+}
+
+void ThisThread::sleep_for(Kernel::Clock::duration_u32 rel_time) {
+  sim::sleep_until_us(sim::now_us() + (uint64_t)rel_time.count() * 1000);
+}
+void ThisThread::sleep_until(Kernel::Clock::time_point abs_time) {
+  sim::sleep_until_us((uint64_t)abs_time.time_since_epoch().count() * 1000);
+}
+void ThisThread::yield() { sim::sleep_until_us(sim::now_us()); }
+
+Thread::Thread(osPriority priority, uint32_t stack_size, unsigned char *,
+               const char *)
+    : _priority(priority), _stack_size(stack_size), _task(nullptr) {}
+osStatus Thread::start(mbed::Callback<void()> task) {
+  _task = sim::spawn(task);
+  return osOK;
+}
+
+Semaphore::Semaphore(int32_t count, uint16_t max_count)
+    : _count(count), _max(max_count) {}
+void Semaphore::acquire() {
+  while (_count == 0)
+    sim::wait(_q, UINT64_MAX);
+  _count--;
+}
+bool Semaphore::try_acquire() {
+  if (_count == 0)
+    return false;
+  _count--;
+  return true;
+}
+bool Semaphore::try_acquire_for(Kernel::Clock::duration_u32 rel_time) {
+  uint64_t deadline = sim::now_us() + (uint64_t)rel_time.count() * 1000;
+  while (_count == 0)
+    if (!sim::wait(_q, deadline) && _count == 0)
+      return false;
+  _count--;
+  return true;
+}
+osStatus Semaphore::release() {
+  if (_count < _max)
+    _count++;
+  sim::notify_one(_q);
+  return osOK;
+}
+
+void Mutex::lock() {
+  while (_locked)
+    sim::wait(_q, UINT64_MAX);
+  _locked = true;
+}
+void Mutex::unlock() {
+  _locked = false;
+  sim::notify_one(_q);
+}
+
+} // namespace rtos
+
+namespace events {
+
+struct EventQueue::Event {
+  int id;
+  uint64_t due;
+  uint64_t period;
+  std::function<void()> fn;
+};
+
+typedef std::vector<EventQueue::Event> EventList;
+
+EventQueue::EventQueue(unsigned size, unsigned char *)
+    : _capacity(size / EVENTS_EVENT_SIZE), _next_id(1), _break(false),
+      _events(new EventList) {}
+
+int EventQueue::post(uint64_t delay, uint64_t period, std::function<void()> fn) {
+  EventList &events = *static_cast<EventList *>(_events);
+  if (events.size() >= _capacity)
+    return 0;
+  Event ev;
+  ev.id = _next_id++;
+  ev.due = sim::now_us() + delay;
+  ev.period = period;
+  ev.fn = std::move(fn);
+  events.push_back(std::move(ev));
+  sim::notify_one(_q);
+  return events.back().id;
+}
+
+bool EventQueue::cancel(int id) {
+  EventList &events = *static_cast<EventList *>(_events);
+  for (auto it = events.begin(); it != events.end(); ++it)
+    if (it->id == id) {
+      events.erase(it);
+      return true;
+    }
+  return false;
+}
+
+void EventQueue::dispatch(uint64_t until) {
+  EventList &events = *static_cast<EventList *>(_events);
+  for (;;) {
+    if (_break) {
+      _break = false;
+      return;
+    }
+    auto next = events.end();
+    for (auto it = events.begin(); it != events.end(); ++it)
+      if (next == events.end() || it->due < next->due)
+        next = it;
+    uint64_t now = sim::now_us();
+    if (next != events.end() && next->due <= now) {
+      std::function<void()> fn = next->fn;
+      if (next->period)
+        next->due += next->period;
+      else
+        events.erase(next);
+      fn();
+      continue;
+    }
+    if (now >= until)
+      return;
+    uint64_t deadline = until;
+    if (next != events.end())
+      deadline = std::min(deadline, next->due);
+    sim::wait(_q, deadline);
+  }
+}
+
+void EventQueue::dispatch_forever() { dispatch(UINT64_MAX); }
+void EventQueue::dispatch_for(std::chrono::milliseconds ms) {
+  dispatch(sim::now_us() + ms.count() * 1000);
+}
+void EventQueue::break_dispatch() {
+  _break = true;
+  sim::notify_one(_q);
+}
+
+} // namespace events
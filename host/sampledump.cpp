@@ -0,0 +1,124 @@
+// Reader for the CSE321 sample log
+//
+// Decodes an image of the flash kept by Project 3/samplelog.h, either the
+// SIM_FLASH file of a simulator run or a dump read off the board (the last
+// 128 KB, from 0x081E0000), and prints its records oldest first, followed by
+// how many bytes they took.
+//
+//   ./build/sampledump flash.bin
+
+#include <algorithm>
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+#include "crc32.h"
+#include "samplecodec.h"
+
+// must match Project 3/samplelog.h
+#define SAMPLELOG_SLOT_SIZE 256
+#define SAMPLELOG_MAGIC 0x474F4C53
+
+namespace {
+
+struct Header {
+  uint32_t magic;
+  uint32_t seq;
+  uint16_t boot;
+  uint8_t version;
+  uint8_t length;
+  uint32_t check;
+};
+
+const size_t SLOT_DATA = SAMPLELOG_SLOT_SIZE - sizeof(Header);
+
+struct Slot {
+  Header header;
+  uint8_t data[SLOT_DATA];
+};
+
+// Bytes of records in a slot, 0 if it is erased, torn or not a slot at all.
+size_t valid(const Slot &slot) {
+  const Header &h = slot.header;
+  if (h.magic != SAMPLELOG_MAGIC || (h.version != 1 && h.version != 2))
+    return 0;
+  size_t length = h.version == 1 ? h.length * sizeof(SampleRecord) : h.length;
+  if (length > SLOT_DATA)
+    return 0;
+  Header copy = h;
+  copy.check = 0;
+  uint32_t crc = crc32(&copy, sizeof(copy));
+  return crc32(slot.data, length, crc) == h.check ? length : 0;
+}
+
+void print(const SampleRecord &r) {
+  switch (r.type) {
+  case SAMPLELOG_BOOT:
+    printf("boot %" PRIu32 "\n", r.time);
+    break;
+  case SAMPLELOG_SAMPLE:
+    printf("%10" PRIu32 " s  %s%d.%d C  %u %%\n", r.time, r.b < 0 ? "-" : "",
+           (r.b < 0 ? -r.b : r.b) / 10, (r.b < 0 ? -r.b : r.b) % 10, r.a);
+    break;
+  case SAMPLELOG_ALARM:
+    printf("%10" PRIu32 " s  alarm %u %s\n", r.time, r.a, r.b ? "on" : "off");
+    break;
+  default:
+    printf("%10" PRIu32 " s  record type %u\n", r.time, r.type);
+    break;
+  }
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  if (argc != 2) {
+    fprintf(stderr, "usage: %s <flash image>\n", argv[0]);
+    return 2;
+  }
+  FILE *f = fopen(argv[1], "rb");
+  if (!f) {
+    perror(argv[1]);
+    return 1;
+  }
+  std::vector<Slot> slots;
+  Slot slot;
+  while (fread(&slot, sizeof(slot), 1, f) == 1) {
+    if (valid(slot))
+      slots.push_back(slot);
+  }
+  fclose(f);
+
+  // oldest first; sequence numbers wrap
+  std::sort(slots.begin(), slots.end(), [](const Slot &a, const Slot &b) {
+    return (int32_t)(a.header.seq - b.header.seq) < 0;
+  });
+
+  uint32_t records = 0, bytes = 0, errors = 0;
+  for (const Slot &s : slots) {
+    size_t length = valid(s);
+    bytes += length;
+    if (s.header.version == 1) {
+      const SampleRecord *r = (const SampleRecord *)s.data;
+      for (int i = 0; i < s.header.length; i++, records++)
+        print(r[i]);
+      continue;
+    }
+    SampleDecoder decoder;
+    decoder.feed(s.data, length, [&](const SampleRecord &r) {
+      print(r);
+      records++;
+    });
+    errors += decoder.errors();
+  }
+
+  printf("%zu slots, %" PRIu32 " records in %" PRIu32 " bytes", slots.size(),
+         records, bytes);
+  if (records)
+    printf(", %.2f bytes per record", (double)bytes / records);
+  if (errors)
+    printf(", %" PRIu32 " invalid tokens", errors);
+  printf("\n");
+  return errors ? 1 : 0;
+}
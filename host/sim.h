@@ -0,0 +1,127 @@
+// Host-side simulation core behind host/mbed.h
+//
+// Everything here runs on a virtual clock. Threads are real std::threads but
+// only one of them holds the "CPU" at a time, so the firmware sees the same
+// single-core, one-thing-at-a-time world it sees on the Nucleo. Virtual time
+// only moves when every thread is blocked (sleeping, busy-waiting, or waiting
+// on a queue), at which point the clock jumps to the next timed event.
+//
+// Interrupt handlers run on whichever thread advanced the clock, with all
+// other threads parked, so they cannot be preempted - the same guarantee an
+// ISR has on the target.
+
+#ifndef HOST_SIM_H
+#define HOST_SIM_H
+
+#include <cstdint>
+#include <deque>
+#include <functional>
+
+namespace sim {
+
+struct Task;
+
+/** List of tasks blocked on a queue, semaphore or similar object. */
+struct WaitQueue {
+  std::deque<Task *> waiters;
+};
+
+/** Current virtual time in microseconds since reset. */
+uint64_t now_us();
+
+/** True while an interrupt handler is running. */
+bool in_isr();
+
+/** Burn CPU time (wait_us, I2C clocking, register polling). */
+void busy_us(uint64_t us);
+
+/** Block the calling thread until the given virtual time. */
+void sleep_until_us(uint64_t t);
+
+/**
+ * Block on a wait queue until notified or until the deadline passes.
+ *
+ * @returns true if notified, false on timeout
+ */
+bool wait(WaitQueue &q, uint64_t deadline_us);
+
+/** Wake the oldest waiter, if any. Safe from interrupt handlers. */
+void notify_one(WaitQueue &q);
+void notify_all(WaitQueue &q);
+
+/**
+ * Run fn in interrupt context at virtual time t.
+ *
+ * @returns id usable with cancel()
+ */
+int schedule_isr(uint64_t t, std::function<void()> fn);
+bool cancel_isr(int id);
+
+/** Start a new simulated thread running fn. */
+Task *spawn(std::function<void()> fn);
+
+/** Deep sleep is only entered while no locks are held. */
+void lock_deep_sleep();
+void unlock_deep_sleep();
+
+/** CPU accounting, microseconds since reset. */
+struct CpuStats {
+  uint64_t uptime;
+  uint64_t busy;
+  uint64_t sleep;
+  uint64_t deep_sleep;
+};
+CpuStats cpu_stats();
+
+// ---- pins -------------------------------------------------------------------
+
+/** Pin level as seen by the MCU input buffer. */
+int pin_read(int pin);
+
+/** Called by the GPIO drivers when the MCU drives or releases a pin. */
+void pin_drive(int pin, int is_output, int value, int pull);
+
+/** Re-evaluate all InterruptIn pins and fire edge handlers. */
+void sample_inputs();
+
+struct Irq {
+  int pin;
+  int level;
+  int enabled;
+  std::function<void()> rise;
+  std::function<void()> fall;
+};
+void irq_register(Irq *irq);
+void irq_unregister(Irq *irq);
+
+// ---- peripherals --------------------------------------------------------------
+
+/**
+ * Deliver one I2C write transaction to the simulated bus.
+ *
+ * @returns 0 on ACK, non-zero if no device answered
+ */
+int i2c_deliver(int address, const char *data, int length);
+
+/** Bus time for a write of length bytes at the given clock. */
+uint64_t i2c_bus_time_us(int length, int hz);
+
+/** Console UART. Input is scripted by SIM_RX, output goes to stdout. */
+struct Uart {
+  std::function<void()> rx_irq;
+};
+void uart_register(Uart *uart);
+void uart_unregister(Uart *uart);
+/** Next received byte, -1 if none is waiting. */
+int uart_getc();
+bool uart_readable();
+
+void watchdog_start(uint32_t timeout_ms);
+void watchdog_kick();
+
+/** Stop the simulation, print the report and exit the process. */
+[[noreturn]] void finish(int code);
+
+} // namespace sim
+
+#endif
@@ -0,0 +1,161 @@
+// Reader for the CSE321 telemetry stream
+//
+// Reads the packets of Project 3's telemetry build (Project 3/telemetry.h)
+// from a serial port, a pty, a capture file or stdin, and writes one line
+// per record or metrics packet to stdout:
+//
+//   boot <count>
+//   sample <s> <temperature C> <humidity %>
+//   alarm <s> <rule> on|off
+//   metrics <name>=<value> ...
+//
+// Anything on the line that is not a valid packet is skipped. At the end of
+// the input a summary goes to stderr.
+//
+//   ./build/project3_telemetry | ./build/telemetry
+//   ./build/telemetry /dev/ttyACM0
+
+#include <cinttypes>
+#include <cstdio>
+#include <cstring>
+#include <fcntl.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "cobs.h"
+#include "crc32.h"
+#include "samplecodec.h"
+#include "telemetry_format.h"
+
+namespace {
+
+const char *const METRIC_NAMES[] = {
+#define METRIC_NAME(id, name) name,
+    TELEMETRY_METRIC_LIST(METRIC_NAME)
+#undef METRIC_NAME
+};
+
+// longest frame between delimiters that can still be a packet
+const size_t MAX_FRAME = cobsMaxLength(TELEMETRY_MAX_PACKET);
+
+struct Stats {
+  uint32_t packets;
+  uint32_t invalid; // frames that failed COBS, length, version or CRC
+  uint32_t lost;    // gaps in the sequence numbers
+  uint32_t records;
+  uint64_t bytes;
+};
+
+Stats stats;
+bool have_seq = false;
+uint16_t next_seq;
+
+void print_record(const SampleRecord &r) {
+  switch (r.type) {
+  case SAMPLELOG_BOOT:
+    printf("boot %" PRIu32 "\n", r.time);
+    break;
+  case SAMPLELOG_SAMPLE:
+    printf("sample %" PRIu32 " %s%d.%d %u\n", r.time, r.b < 0 ? "-" : "",
+           (r.b < 0 ? -r.b : r.b) / 10, (r.b < 0 ? -r.b : r.b) % 10, r.a);
+    break;
+  case SAMPLELOG_ALARM:
+    printf("alarm %" PRIu32 " %u %s\n", r.time, r.a, r.b ? "on" : "off");
+    break;
+  }
+  stats.records++;
+}
+
+uint32_t le32(const uint8_t *p) {
+  return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+// Check and print one frame, without its delimiters.
+void packet(const uint8_t *frame, size_t length) {
+  uint8_t p[TELEMETRY_MAX_PACKET];
+  int n = length <= MAX_FRAME ? cobsDecode(frame, length, p) : -1;
+  if (n < TELEMETRY_HEADER_SIZE + TELEMETRY_CHECK_SIZE ||
+      p[0] != TELEMETRY_VERSION ||
+      crc32(p, n - TELEMETRY_CHECK_SIZE) != le32(p + n - TELEMETRY_CHECK_SIZE)) {
+    stats.invalid++;
+    return;
+  }
+  uint16_t seq = p[2] | p[3] << 8;
+  if (have_seq)
+    stats.lost += (uint16_t)(seq - next_seq);
+  have_seq = true;
+  next_seq = seq + 1;
+  stats.packets++;
+
+  const uint8_t *payload = p + TELEMETRY_HEADER_SIZE;
+  size_t size = n - TELEMETRY_HEADER_SIZE - TELEMETRY_CHECK_SIZE;
+  if (p[1] == TELEMETRY_RECORDS) {
+    SampleDecoder decoder;
+    decoder.feed(payload, size, print_record);
+  } else if (p[1] == TELEMETRY_METRICS) {
+    printf("metrics");
+    for (size_t i = 0; i + 4 <= size; i += 4) {
+      if (i / 4 < TELEMETRY_METRIC_COUNT)
+        printf(" %s=%" PRIu32, METRIC_NAMES[i / 4], le32(payload + i));
+      else
+        printf(" metric%zu=%" PRIu32, i / 4, le32(payload + i));
+    }
+    printf("\n");
+  }
+}
+
+// A serial port or pty: raw bytes, at the firmware's speed.
+void make_raw(int fd) {
+  struct termios t;
+  if (tcgetattr(fd, &t) != 0)
+    return; // a file or a pipe
+  cfmakeraw(&t);
+  cfsetispeed(&t, B115200);
+  cfsetospeed(&t, B115200);
+  tcsetattr(fd, TCSANOW, &t);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  int fd = 0;
+  if (argc > 1 && strcmp(argv[1], "-") != 0) {
+    fd = open(argv[1], O_RDONLY | O_NOCTTY);
+    if (fd < 0) {
+      perror(argv[1]);
+      return 1;
+    }
+  }
+  make_raw(fd);
+
+  uint8_t frame[MAX_FRAME + 1];
+  size_t length = 0;
+  bool overlong = false; // the frame outgrew MAX_FRAME, skip to the next delimiter
+  uint8_t buf[4096];
+  ssize_t got;
+  while ((got = read(fd, buf, sizeof(buf))) > 0) {
+    stats.bytes += got;
+    for (ssize_t i = 0; i < got; i++) {
+      if (buf[i] == 0) {
+        if (overlong)
+          stats.invalid++;
+        else if (length)
+          packet(frame, length);
+        length = 0;
+        overlong = false;
+      } else if (length < sizeof(frame)) {
+        frame[length++] = buf[i];
+      } else {
+        overlong = true;
+      }
+    }
+    fflush(stdout);
+  }
+
+  fprintf(stderr,
+          "%" PRIu32 " packets, %" PRIu32 " records, %" PRIu32
+          " lost, %" PRIu32 " invalid frames, %" PRIu64 " bytes read\n",
+          stats.packets, stats.records, stats.lost, stats.invalid,
+          stats.bytes);
+  return 0;
+}
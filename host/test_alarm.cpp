@@ -0,0 +1,189 @@
+// Checks of the alarm rules (Project 3/alarm.h)
+//
+// Steps readings through a rule on each side of its threshold and compares
+// the rule's state after every one with a table: it must turn on only past
+// the on threshold, off only back at the off threshold, and stay in either
+// state for its minimum time. Then checks rates of rise worked out over the
+// history's 1 minute window, and which rules add() and setThresholds() take.
+
+#include <vector>
+
+#include "alarm.h"
+#include "check.h"
+
+namespace {
+
+struct Reading {
+  uint32_t time;
+  int value;
+  bool on; // the rule after the reading
+};
+
+struct Walk {
+  const char *name;
+  AlarmRule rule;
+  std::vector<Reading> readings;
+};
+
+const Walk WALKS[] = {
+    {"temperature above 22.2 C, off at 21.2 C, 10 s dwell",
+     {ALARM_TEMPERATURE, ALARM_ABOVE, 222, 212, 10, 10},
+     {
+         {0, 220, false},
+         {2, 222, false}, // at the threshold is not past it
+         {4, 223, true},  // the first change waits for no dwell
+         {6, 200, true},   // on for 2 s only, so it stays on
+         {12, 200, true},
+         {14, 213, true},  // held long enough, but still in the band
+         {16, 212, false}, // back at the off threshold
+         {18, 230, false}, // off for 2 s only
+         {25, 230, false},
+         {26, 230, true},  // off for 10 s
+         {28, 221, true},  // in the band
+         {60, 221, true},
+         {62, 150, false},
+     }},
+    {"humidity below 30 %, off at 35 %, no dwell",
+     {ALARM_HUMIDITY, ALARM_BELOW, 30, 35, 0, 0},
+     {
+         {0, 40, false},
+         {2, 30, false},
+         {4, 29, true},
+         {6, 34, true},
+         {8, 35, false},
+         {10, 29, true},
+         {10, 36, false}, // no dwell, so even within the same second
+     }},
+    {"on and off at the same threshold",
+     {ALARM_TEMPERATURE, ALARM_ABOVE, 250, 250, 0, 5},
+     {
+         {0, 251, true},
+         {1, 250, false},
+         {2, 251, false}, // off for 1 s of 5
+         {6, 251, true},
+         {7, 249, false},
+     }},
+};
+
+void check_walks() {
+  for (const Walk &w : WALKS) {
+    AlarmEngine engine;
+    // a second rule that never fires, so the engine's state is this rule's
+    CHECK(engine.add({ALARM_HUMIDITY, ALARM_ABOVE, 200, 200, 0, 0}) == 0);
+    CHECK(engine.add(w.rule) == 1);
+    CHECK(!engine.active(1) && !engine.active());
+
+    AlarmInput input = {0, {0, 0, 0, 0}};
+    for (const Reading &r : w.readings) {
+      input.time = r.time;
+      input.value[w.rule.quantity] = r.value;
+      bool any = engine.evaluate(input);
+      if (!CHECK(engine.active(1) == r.on && any == r.on &&
+                 engine.active() == r.on && !engine.active(0)))
+        printf("  %s: at %u s, %d turned it %s\n", w.name, r.time, r.value,
+               engine.active(1) ? "on" : "off");
+    }
+  }
+}
+
+// A rule on, then its thresholds changed under it: the state is kept until
+// the next reading says otherwise.
+void check_thresholds() {
+  AlarmEngine engine;
+  CHECK(engine.add({ALARM_TEMPERATURE, ALARM_ABOVE, 222, 212, 0, 0}) == 0);
+  AlarmInput input = {0, {230, 0, 0, 0}};
+  CHECK(engine.evaluate(input));
+
+  CHECK(engine.setThresholds(0, 300, 225));
+  CHECK(engine.active(0));
+  CHECK(engine.rule(0).on == 300 && engine.rule(0).off == 225);
+  input.time = 1;
+  CHECK(engine.evaluate(input)); // 23.0 C is in the new band
+  input.value[ALARM_TEMPERATURE] = 225;
+  CHECK(!engine.evaluate(input));
+
+  // refused: off above on for a rule above its threshold, out of range, or
+  // no such rule; the thresholds stay as they were
+  CHECK(!engine.setThresholds(0, 200, 201));
+  CHECK(!engine.setThresholds(0, 40000, 0));
+  CHECK(!engine.setThresholds(1, 300, 200));
+  CHECK(!engine.setThresholds(-1, 300, 200));
+  CHECK(engine.rule(0).on == 300 && engine.rule(0).off == 225);
+}
+
+struct Refused {
+  const char *name;
+  AlarmRule rule;
+};
+
+const Refused REFUSED[] = {
+    {"above, off over on", {ALARM_TEMPERATURE, ALARM_ABOVE, 200, 201, 0, 0}},
+    {"below, off under on", {ALARM_HUMIDITY, ALARM_BELOW, 30, 29, 0, 0}},
+    {"no such quantity", {ALARM_QUANTITIES, ALARM_ABOVE, 1, 0, 0, 0}},
+};
+
+void check_add() {
+  AlarmEngine engine;
+  for (const Refused &r : REFUSED)
+    if (!CHECK(engine.add(r.rule) == -1))
+      printf("  %s\n", r.name);
+  CHECK(engine.count() == 0);
+
+  for (int i = 0; i < ALARM_MAX_RULES; i++)
+    CHECK(engine.add({ALARM_HUMIDITY, ALARM_ABOVE, 60, 58, 0, 0}) == i);
+  CHECK(engine.add({ALARM_HUMIDITY, ALARM_ABOVE, 60, 58, 0, 0}) == -1);
+  CHECK(engine.count() == ALARM_MAX_RULES);
+}
+
+struct Rate {
+  uint32_t time;
+  bool temperature, humidity; // the rules after the sample at time
+};
+
+// Samples every 2 s. The temperature climbs from 20.0 C by a tenth a second
+// (6 C/min) until 23.0 C at 30 s and then holds; the humidity steps from 40 %
+// to 50 % at 30 s. Rates are taken over the 1 minute window once it spans
+// 30 s: at 76 s the window starts at 18 s, 1.2 C below, 12 tenths/min over
+// 58 s; at 78 s it starts at 20 s, exactly 1.0 C/min.
+const Rate RATES[] = {
+    {0, false, false},  {28, false, false}, // window too short for a rate
+    {30, true, true},   {58, true, true},   {76, true, true},
+    {78, false, true},  {86, false, true},  // the window still holds 40 %
+    {88, false, false},                     // and now no longer does
+};
+
+void check_rates() {
+  AlarmEngine engine;
+  // on above 3.0 C/min, off at 1.0 C/min; on above 10 %/min, off at 5 %/min
+  CHECK(engine.add({ALARM_TEMPERATURE_RATE, ALARM_ABOVE, 30, 10, 0, 0}) == 0);
+  CHECK(engine.add({ALARM_HUMIDITY_RATE, ALARM_ABOVE, 100, 50, 0, 0}) == 1);
+
+  SensorHistory<64> history;
+  CHECK(!engine.update(history)); // nothing to go on yet
+
+  const Rate *next = RATES;
+  for (uint32_t t = 0; t <= 100; t += 2) {
+    history.add(t, 200 + (t < 30 ? t : 30), t < 30 ? 40 : 50);
+    bool any = engine.update(history);
+    CHECK(any == (engine.active(0) || engine.active(1)));
+    if (next < RATES + sizeof(RATES) / sizeof(RATES[0]) && next->time == t) {
+      if (!CHECK(engine.active(0) == next->temperature &&
+                 engine.active(1) == next->humidity))
+        printf("  at %u s: temperature rate %s, humidity rate %s\n", t,
+               engine.active(0) ? "on" : "off",
+               engine.active(1) ? "on" : "off");
+      next++;
+    }
+  }
+  CHECK(next == RATES + sizeof(RATES) / sizeof(RATES[0]));
+}
+
+} // namespace
+
+int main() {
+  check_walks();
+  check_thresholds();
+  check_add();
+  check_rates();
+  return check_summary("alarm");
+}
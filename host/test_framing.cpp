@@ -0,0 +1,169 @@
+// Checks of the telemetry framing (Project 3/cobs.h, Project 3/crc32.h)
+//
+// COBS: exact encodings of zero runs and of blocks around the 254 byte
+// limit, round trips of every length up to a few blocks at several zero
+// densities, and the malformed frames the decoder must refuse. CRC-32: the
+// standard check values, and a CRC continued over pieces.
+
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+#include "check.h"
+#include "cobs.h"
+#include "crc32.h"
+
+namespace {
+
+typedef std::vector<uint8_t> Bytes;
+
+Bytes encode(const Bytes &in) {
+  Bytes out(cobsMaxLength(in.size()));
+  out.resize(cobsEncode(in.data(), in.size(), out.data()));
+  return out;
+}
+
+// n bytes counting up from first, skipping zero
+Bytes counting(size_t n, uint8_t first = 1) {
+  Bytes b;
+  for (uint8_t v = first; b.size() < n; v++)
+    if (v)
+      b.push_back(v);
+  return b;
+}
+
+Bytes join(const Bytes &x, const Bytes &y) {
+  Bytes b = x;
+  b.insert(b.end(), y.begin(), y.end());
+  return b;
+}
+
+struct Encoding {
+  const char *name;
+  Bytes in;
+  Bytes out;
+};
+
+const std::vector<Encoding> &encodings() {
+  static const std::vector<Encoding> table = {
+      {"empty", {}, {0x01}},
+      {"one zero", {0x00}, {0x01, 0x01}},
+      {"two zeros", {0x00, 0x00}, {0x01, 0x01, 0x01}},
+      {"zero run", Bytes(10, 0x00), Bytes(11, 0x01)},
+      {"zero inside", {0x11, 0x22, 0x00, 0x33}, {0x03, 0x11, 0x22, 0x02, 0x33}},
+      {"no zero", {0x11, 0x22, 0x33, 0x44}, {0x05, 0x11, 0x22, 0x33, 0x44}},
+      {"zeros at the end", {0x11, 0x00, 0x00, 0x00}, {0x02, 0x11, 0x01, 0x01, 0x01}},
+      {"253 bytes", counting(253), join({0xFE}, counting(253))},
+      // a full block needs no zero after it, the next block starts at once
+      {"254 bytes", counting(254), join(join({0xFF}, counting(254)), {0x01})},
+      {"255 bytes", counting(255),
+       join(join({0xFF}, counting(254)), {0x02, 0xFF})},
+      {"254 bytes and a zero", join(counting(254), {0x00}),
+       join(join({0xFF}, counting(254)), {0x01, 0x01})},
+      {"zero and 254 bytes", join({0x00}, counting(254)),
+       join(join({0x01, 0xFF}, counting(254)), {0x01})},
+  };
+  return table;
+}
+
+void check_encodings() {
+  for (const Encoding &e : encodings()) {
+    Bytes out = encode(e.in);
+    if (!CHECK(out == e.out))
+      printf("  %s: %zu bytes out, want %zu\n", e.name, out.size(),
+             e.out.size());
+
+    Bytes back(e.out.size());
+    int n = cobsDecode(e.out.data(), e.out.size(), back.data());
+    back.resize(n < 0 ? 0 : n);
+    if (!CHECK(n == (int)e.in.size() && back == e.in))
+      printf("  %s: decoded %d bytes\n", e.name, n);
+  }
+}
+
+// Every length up to three blocks, with no zeros, all zeros, and a zero
+// every 7th and every 254th byte.
+void check_round_trips() {
+  const int spacings[] = {0, 1, 7, 254};
+  for (int spacing : spacings) {
+    for (size_t length = 0; length <= 3 * 254 + 2; length++) {
+      Bytes in = counting(length, 0x80);
+      if (spacing)
+        for (size_t i = spacing - 1; i < length; i += spacing)
+          in[i] = 0;
+      Bytes out = encode(in);
+      bool ok = out.size() <= cobsMaxLength(length) &&
+                memchr(out.data(), 0, out.size()) == nullptr;
+
+      Bytes back(out.size());
+      int n = cobsDecode(out.data(), out.size(), back.data());
+      ok = ok && n == (int)length &&
+           std::equal(in.begin(), in.end(), back.begin());
+      if (!CHECK(ok))
+        printf("  length %zu, a zero every %d\n", length, spacing);
+    }
+  }
+}
+
+struct Malformed {
+  const char *name;
+  Bytes in;
+};
+
+const Malformed MALFORMED[] = {
+    {"a zero", {0x00}},
+    {"zero inside a block", {0x03, 0x11, 0x00}},
+    {"block past the end", {0x05, 0x11, 0x22}},
+    {"full block cut short", {0xFF, 0x11}},
+};
+
+void check_malformed() {
+  for (const Malformed &m : MALFORMED) {
+    uint8_t out[16];
+    if (!CHECK(cobsDecode(m.in.data(), m.in.size(), out) == -1))
+      printf("  %s\n", m.name);
+  }
+}
+
+struct Crc {
+  const char *text;
+  uint32_t crc;
+};
+
+// the check value of the CRC-32 catalogue, and the values zlib gives
+const Crc CRCS[] = {
+    {"", 0x00000000},
+    {"a", 0xE8B7BE43},
+    {"123456789", 0xCBF43926},
+    {"The quick brown fox jumps over the lazy dog", 0x414FA339},
+};
+
+void check_crc() {
+  for (const Crc &c : CRCS) {
+    size_t length = strlen(c.text);
+    if (!CHECK(crc32(c.text, length) == c.crc))
+      printf("  \"%s\": %08X\n", c.text, crc32(c.text, length));
+
+    // continued over two pieces, split anywhere
+    for (size_t i = 0; i <= length; i++)
+      CHECK(crc32(c.text + i, length - i, crc32(c.text, i)) == c.crc);
+  }
+
+  // a flipped bit anywhere in a packet changes it
+  uint8_t packet[] = "123456789";
+  for (size_t i = 0; i < 9 * 8; i++) {
+    packet[i / 8] ^= 1 << (i % 8);
+    CHECK(crc32(packet, 9) != 0xCBF43926);
+    packet[i / 8] ^= 1 << (i % 8);
+  }
+}
+
+} // namespace
+
+int main() {
+  check_encodings();
+  check_round_trips();
+  check_malformed();
+  check_crc();
+  return check_summary("framing");
+}
@@ -0,0 +1,142 @@
+// Checks of the sensor history (Project 3/history.h)
+//
+// Steps samples through a small SensorHistory and compares the ring, the
+// exact 1 minute window and the lifetime statistics with a table, then runs
+// a long irregular sequence, with gaps of more than an hour, and compares the
+// 10 minute and 1 hour windows after every sample with sums worked out from
+// scratch over the samples whose minute falls inside the window.
+
+#include <vector>
+
+#include "check.h"
+#include "history.h"
+
+namespace {
+
+struct Step {
+  uint32_t time;
+  int temperature;
+  int humidity;
+  // after the sample
+  unsigned size, recent;
+  int mean1min; // temperature, tenths of a degree
+  int minTemperature, maxTemperature;
+};
+
+// a ring of 4: the window and the ring both let samples go
+const Step STEPS[] = {
+    {10, 200, 40, 1, 1, 200, 200, 200},
+    {30, 210, 42, 2, 2, 205, 200, 210},
+    {60, 190, 44, 3, 3, 200, 190, 210},
+    {69, 230, 46, 4, 4, 207, 190, 230},
+    // 10 + 60: the first sample just left the window
+    {70, 250, 48, 4, 4, 220, 190, 250},
+    // the ring is full, the window holds what the ring does
+    {75, 150, 50, 4, 4, 205, 150, 250},
+    // a gap empties the window of all but the new sample
+    {200, 100, 30, 4, 1, 100, 100, 250},
+    {259, 300, 35, 4, 2, 200, 100, 300},
+    {260, 200, 35, 4, 2, 250, 100, 300},
+};
+
+void check_steps() {
+  SensorHistory<4> history;
+  CHECK(history.size() == 0 && history.capacity() == 4);
+  CHECK(history.mean(HISTORY_1MIN).count == 0);
+  CHECK(history.mean(HISTORY_1MIN).meanTemperature() == 0);
+
+  HistoryMean all = {0, 0, 0};
+  for (const Step &s : STEPS) {
+    history.add(s.time, s.temperature, s.humidity);
+    all.add(DHTSample{s.time, (int16_t)s.temperature, (uint8_t)s.humidity});
+
+    const HistoryStats &stats = history.stats();
+    bool ok = history.size() == s.size && history.recent() == s.recent &&
+              history.mean(HISTORY_1MIN).count == s.recent &&
+              history.mean(HISTORY_1MIN).meanTemperature() == s.mean1min &&
+              stats.minTemperature == s.minTemperature &&
+              stats.maxTemperature == s.maxTemperature;
+    if (!CHECK(ok))
+      printf("  at %u s: size %u, recent %u, mean %d, min %d, max %d\n",
+             s.time, history.size(), history.recent(),
+             history.mean(HISTORY_1MIN).meanTemperature(),
+             stats.minTemperature, stats.maxTemperature);
+
+    CHECK(history.at(0).time == s.time &&
+          history.at(0).temperature == s.temperature &&
+          history.at(0).humidity == s.humidity);
+    CHECK(stats.sum.count == all.count &&
+          stats.sum.temperature == all.temperature &&
+          stats.sum.humidity == all.humidity);
+  }
+
+  // the ring keeps the newest four, newest first
+  CHECK(history.at(1).time == 259 && history.at(2).time == 200 &&
+        history.at(3).time == 75);
+  CHECK(history.stats().minHumidity == 30 && history.stats().maxHumidity == 50);
+  // 35 % twice, the mean humidity in tenths of a percent
+  CHECK(history.mean(HISTORY_1MIN).meanHumidity() == 350);
+
+  history.reset();
+  CHECK(history.size() == 0 && history.recent() == 0);
+  CHECK(history.stats().sum.count == 0);
+  CHECK(history.mean(HISTORY_10MIN).count == 0 &&
+        history.mean(HISTORY_1H).count == 0);
+
+  // after a reset the first sample sets the extremes again
+  history.add(1000, -50, 90);
+  CHECK(history.stats().minTemperature == -50 &&
+        history.stats().maxTemperature == -50);
+  CHECK(history.mean(HISTORY_1H).meanTemperature() == -50);
+}
+
+// Sums over the samples whose minute is one of the last minutes, counting
+// the minute of the newest sample.
+HistoryMean window(const std::vector<DHTSample> &samples, uint32_t minutes) {
+  HistoryMean m = {0, 0, 0};
+  uint32_t now = samples.back().time / 60;
+  for (const DHTSample &s : samples)
+    if (s.time / 60 + minutes > now)
+      m.add(s);
+  return m;
+}
+
+bool same(const HistoryMean &x, const HistoryMean &y) {
+  return x.count == y.count && x.temperature == y.temperature &&
+         x.humidity == y.humidity;
+}
+
+// Gaps between samples, in seconds, used in turn: the firmware's 2 s, a few
+// odd ones, whole minutes, and the gaps of more than an hour that empty
+// every bucket.
+const uint32_t GAPS[] = {2, 2, 2, 3, 2, 7, 2, 59, 2, 61, 2, 2, 600, 2,
+                         2, 3599, 2, 3600, 2, 2, 3661, 2, 7200, 2, 119};
+
+void check_windows() {
+  SensorHistory<64> history;
+  std::vector<DHTSample> samples;
+  uint32_t time = 5;
+  for (int i = 0; i < 3000; i++) {
+    DHTSample s = {time, (int16_t)((i * 37) % 500 - 100), (uint8_t)(i % 101)};
+    history.add(s.time, s.temperature, s.humidity);
+    samples.push_back(s);
+
+    HistoryMean want10 = window(samples, 10), want60 = window(samples, 60);
+    if (!CHECK(same(history.mean(HISTORY_10MIN), want10) &&
+               same(history.mean(HISTORY_1H), want60)))
+      printf("  sample %d at %u s: 10 min %u samples, want %u; 1 h %u, "
+             "want %u\n",
+             i, time, history.mean(HISTORY_10MIN).count, want10.count,
+             history.mean(HISTORY_1H).count, want60.count);
+
+    time += GAPS[i % (sizeof(GAPS) / sizeof(GAPS[0]))];
+  }
+}
+
+} // namespace
+
+int main() {
+  check_steps();
+  check_windows();
+  return check_summary("history");
+}
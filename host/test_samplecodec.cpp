@@ -0,0 +1,284 @@
+// Checks of the sample log encoding (Project 3/samplecodec.h)
+//
+// Round trips tables of records through the encoder and the decoder, in one
+// buffer and spread over many small ones that each start with a keyframe,
+// checks the exact bytes of a few tokens, and feeds the decoder the garbage
+// and cut streams a reader has to get past.
+
+#include <cstring>
+#include <vector>
+
+#include "check.h"
+#include "samplecodec.h"
+
+namespace {
+
+typedef std::vector<SampleRecord> Records;
+
+SampleRecord sample(uint32_t time, int temp, int hum) {
+  return {time, SAMPLELOG_SAMPLE, (uint8_t)hum, (int16_t)temp};
+}
+
+SampleRecord alarm(uint32_t time, int rule, bool on) {
+  return {time, SAMPLELOG_ALARM, (uint8_t)rule, (int16_t)on};
+}
+
+SampleRecord boot(uint32_t count) {
+  return {count, SAMPLELOG_BOOT, 0, 0};
+}
+
+bool same(const SampleRecord &x, const SampleRecord &y) {
+  return x.time == y.time && x.type == y.type && x.a == y.a && x.b == y.b;
+}
+
+bool same(const Records &x, const Records &y) {
+  if (x.size() != y.size())
+    return false;
+  for (size_t i = 0; i < x.size(); i++)
+    if (!same(x[i], y[i])) {
+      printf("  record %zu: %u/%u/%u/%d, want %u/%u/%u/%d\n", i, x[i].time,
+             x[i].type, x[i].a, x[i].b, y[i].time, y[i].type, y[i].a, y[i].b);
+      return false;
+    }
+  return true;
+}
+
+Records decode(const uint8_t *data, size_t length, SampleDecoder &decoder) {
+  Records out;
+  decoder.feed(data, length,
+               [&](const SampleRecord &r) { out.push_back(r); });
+  return out;
+}
+
+// Steady samples long enough to fill several runs of 16.
+Records steady() {
+  Records r = {boot(3)};
+  for (uint32_t t = 2; t <= 80; t += 2)
+    r.push_back(sample(t, 224, 41));
+  return r;
+}
+
+// Every kind of change: gaps, both signs, multi-byte varints, alarms, a boot
+// in the middle that starts time and reading over.
+Records mixed() {
+  return {boot(1),
+          sample(2, 200, 40),
+          sample(4, 201, 40),
+          sample(6, 202, 40),
+          sample(8, 203, 41),
+          alarm(9, 0, true),
+          sample(10, 203, 41),
+          sample(300, -125, 99),
+          sample(301, 850, 0),
+          alarm(70000, 15, false),
+          sample(70000, 850, 0),
+          sample(4000000000u, -400, 255),
+          boot(2),
+          sample(2, 224, 41),
+          sample(4, 224, 41),
+          alarm(4, 2, true)};
+}
+
+struct RoundTrip {
+  const char *name;
+  Records (*records)();
+};
+
+const RoundTrip ROUND_TRIPS[] = {
+    {"steady", steady},
+    {"mixed", mixed},
+};
+
+// The whole table into one large buffer, decoded in one piece and a byte at
+// a time.
+void check_round_trip() {
+  for (const RoundTrip &t : ROUND_TRIPS) {
+    Records in = t.records();
+    uint8_t buffer[1024];
+    SampleEncoder encoder;
+    CHECK(encoder.begin(buffer, sizeof(buffer)));
+    for (const SampleRecord &r : in)
+      CHECK(encoder.add(r));
+    CHECK(encoder.records() == in.size());
+
+    SampleDecoder decoder;
+    if (!CHECK(same(decode(buffer, encoder.length(), decoder), in)))
+      printf("  %s in one piece\n", t.name);
+    CHECK(decoder.errors() == 0);
+
+    SampleDecoder bytewise;
+    Records out;
+    for (size_t i = 0; i < encoder.length(); i++)
+      bytewise.feed(buffer[i], [&](const SampleRecord &r) { out.push_back(r); });
+    if (!CHECK(same(out, in)))
+      printf("  %s a byte at a time\n", t.name);
+  }
+}
+
+// The table spread over buffers of size bytes, as the sample log and the
+// telemetry packets do: each must decode on its own from its keyframe.
+void check_keyframes(size_t size) {
+  for (const RoundTrip &t : ROUND_TRIPS) {
+    Records in = t.records();
+    Records out;
+    std::vector<uint8_t> buffer(size);
+    SampleEncoder encoder;
+    int buffers = 0;
+
+    auto close = [&]() {
+      CHECK(buffer[0] == SAMPLECODEC_KEYFRAME);
+      SampleDecoder decoder; // a fresh one, as a reader of this buffer alone
+      Records part = decode(buffer.data(), encoder.length(), decoder);
+      CHECK(part.size() == encoder.records());
+      CHECK(decoder.errors() == 0);
+      out.insert(out.end(), part.begin(), part.end());
+      buffers++;
+    };
+
+    CHECK(encoder.begin(buffer.data(), size));
+    for (const SampleRecord &r : in) {
+      size_t before = encoder.length();
+      if (!encoder.add(r)) {
+        // refused: the buffer is left as it was, and the record goes first
+        // into the next one
+        CHECK(encoder.length() == before);
+        close();
+        CHECK(encoder.begin(buffer.data(), size));
+        CHECK(encoder.add(r));
+      }
+    }
+    close();
+
+    if (!CHECK(same(out, in)))
+      printf("  %s in %zu byte buffers\n", t.name, size);
+
+    // and it did take more than one where one would not do
+    uint8_t whole[1024];
+    SampleEncoder one;
+    one.begin(whole, sizeof(whole));
+    for (const SampleRecord &r : in)
+      one.add(r);
+    CHECK(one.length() <= size || buffers > 1);
+  }
+}
+
+struct Bytes {
+  const char *name;
+  Records records;
+  std::vector<uint8_t> tokens; // expected after the opening keyframe
+};
+
+// Exact tokens: the format is stored in flash and sent over the wire, so a
+// change here must come with a new SAMPLELOG_VERSION and TELEMETRY_VERSION.
+const Bytes BYTES[] = {
+    {"gap and temperature", {sample(2, 1, 0)}, {0x03, 0x02, 0x02}},
+    {"no change, then again", {sample(0, 0, 0), sample(0, 0, 0)}, {0x00, 0x10}},
+    {"run grows",
+     {sample(2, 1, 0), sample(4, 2, 0), sample(6, 3, 0)},
+     {0x03, 0x02, 0x02, 0x11}},
+    {"run of 16 then a new one",
+     {sample(1, 0, 0), sample(2, 0, 0), sample(3, 0, 0), sample(4, 0, 0),
+      sample(5, 0, 0), sample(6, 0, 0), sample(7, 0, 0), sample(8, 0, 0),
+      sample(9, 0, 0), sample(10, 0, 0), sample(11, 0, 0), sample(12, 0, 0),
+      sample(13, 0, 0), sample(14, 0, 0), sample(15, 0, 0), sample(16, 0, 0),
+      sample(17, 0, 0), sample(18, 0, 0)},
+     {0x01, 0x01, 0x1F, 0x10}},
+    {"negative, two byte varint", {sample(0, -100, 0)}, {0x02, 0xC7, 0x01}},
+    {"alarm on", {alarm(300, 5, true)}, {0x35, 0xAC, 0x02}},
+    {"boot", {boot(2)}, {0x40, 0x02}},
+};
+
+void check_bytes() {
+  for (const Bytes &b : BYTES) {
+    uint8_t buffer[64];
+    SampleEncoder encoder;
+    encoder.begin(buffer, sizeof(buffer));
+    for (const SampleRecord &r : b.records)
+      encoder.add(r);
+    std::vector<uint8_t> tokens(buffer + SAMPLECODEC_KEYFRAME_SIZE,
+                                buffer + encoder.length());
+    if (!CHECK(tokens == b.tokens)) {
+      printf("  %s:", b.name);
+      for (uint8_t x : tokens)
+        printf(" %02X", x);
+      printf("\n");
+    }
+  }
+
+  // the keyframe carries the last record's time and reading
+  uint8_t buffer[64];
+  SampleEncoder encoder;
+  encoder.begin(buffer, sizeof(buffer));
+  encoder.add(sample(0x01020304, -2, 41));
+  encoder.begin(buffer, sizeof(buffer));
+  const uint8_t keyframe[] = {SAMPLECODEC_KEYFRAME, 0x04, 0x03, 0x02, 0x01,
+                              0xFE, 0xFF, 41};
+  CHECK(encoder.length() == sizeof(keyframe) &&
+        memcmp(buffer, keyframe, sizeof(keyframe)) == 0);
+
+  // a buffer too small for the keyframe takes nothing
+  CHECK(!encoder.begin(buffer, SAMPLECODEC_KEYFRAME_SIZE - 1));
+  CHECK(!encoder.add(sample(1, 0, 0)));
+}
+
+void check_resync() {
+  uint8_t buffer[64];
+  SampleEncoder encoder;
+  encoder.begin(buffer, sizeof(buffer));
+  Records in = {sample(2, 200, 40), sample(4, 201, 40), alarm(5, 1, true)};
+  for (const SampleRecord &r : in)
+    encoder.add(r);
+  size_t length = encoder.length();
+
+  // changes before any keyframe have nothing to apply to and are skipped
+  {
+    SampleDecoder decoder;
+    Records out = decode(buffer + SAMPLECODEC_KEYFRAME_SIZE,
+                         length - SAMPLECODEC_KEYFRAME_SIZE, decoder);
+    CHECK(out.empty());
+    CHECK(decoder.errors() == 0);
+  }
+
+  // an invalid token is counted and the decoder waits for the next keyframe
+  {
+    SampleDecoder decoder;
+    const uint8_t bad[] = {0x08};
+    CHECK(decode(bad, sizeof(bad), decoder).empty());
+    CHECK(decoder.errors() == 1);
+    CHECK(same(decode(buffer, length, decoder), in));
+    decode(bad, sizeof(bad), decoder);
+    CHECK(decoder.errors() == 2);
+    CHECK(decode(buffer + SAMPLECODEC_KEYFRAME_SIZE,
+                 length - SAMPLECODEC_KEYFRAME_SIZE, decoder)
+              .empty());
+  }
+
+  // a varint longer than 32 bits is invalid
+  {
+    SampleDecoder decoder;
+    const uint8_t overlong[] = {0x01, 0x80, 0x80, 0x80, 0x80, 0x80, 0x01};
+    decode(overlong, sizeof(overlong), decoder);
+    CHECK(decoder.errors() == 1);
+  }
+
+  // reset() forgets a token cut short, as at the end of a torn slot
+  {
+    SampleDecoder decoder;
+    decode(buffer, 3, decoder);
+    decoder.reset();
+    CHECK(same(decode(buffer, length, decoder), in));
+    CHECK(decoder.errors() == 0);
+  }
+}
+
+} // namespace
+
+int main() {
+  check_round_trip();
+  check_keyframes(SAMPLECODEC_KEYFRAME_SIZE + SAMPLECODEC_MAX_TOKEN);
+  check_keyframes(32);
+  check_keyframes(64);
+  check_bytes();
+  check_resync();
+  return check_summary("samplecodec");
+}
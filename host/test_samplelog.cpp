@@ -0,0 +1,171 @@
+// Checks of the sample log's slot check (Project 3/samplelog.h)
+//
+// Runs SampleLog on the simulator over a small FileBlockDevice: fills a few
+// slots, then damages one committed slot at a time the way flash goes bad,
+// by clearing bits, in each field of the header and in the records. A log
+// started on the damaged device must drop exactly that slot, replay every
+// other record, and keep appending after the newest slot that is still
+// good.
+
+#include <cstddef>
+#include <cstdio>
+#include <vector>
+
+#include "FileBlockDevice.h"
+#include "check.h"
+#include "mbed.h"
+#include "samplelog.h"
+
+namespace {
+
+const bd_size_t SIZE = 16 * 1024;
+const bd_size_t UNIT = 8;
+
+// a temporary file, erased between the checks
+FileBlockDevice flash(nullptr, SIZE, UNIT, 4096);
+
+// A new SampleLog on the device, started the way the firmware does at boot.
+// Never deleted: its writer thread lives on, like the firmware's.
+SampleLog *boot_log() {
+  SampleLog *log = new SampleLog(&flash);
+  CHECK(log->start() == 0);
+  return log;
+}
+
+// Samples that change every time, so a slot holds a few dozen of them.
+void fill(SampleLog *log, uint32_t from, int count) {
+  for (int i = 0; i < count; i++) {
+    log->addSample(from + 2 * i, 200 + (i * 37) % 90 - 45, 40 + i % 7);
+    // let the writer commit a full slot before the next one fills
+    ThisThread::sleep_for(1ms);
+  }
+  log->sync();
+  ThisThread::sleep_for(10ms);
+}
+
+uint32_t replayed(SampleLog *log) {
+  return log->replay([](const SampleRecord &) {});
+}
+
+// Records in every slot as the raw device holds them, -1 for a slot that is
+// not a committed one.
+std::vector<int> slot_records() {
+  std::vector<int> records(SIZE / SAMPLELOG_SLOT_SIZE, -1);
+  for (size_t i = 0; i < records.size(); i++) {
+    uint8_t slot[SAMPLELOG_SLOT_SIZE];
+    flash.read(slot, i * SAMPLELOG_SLOT_SIZE, sizeof(slot));
+    const SampleLogHeader *h = (const SampleLogHeader *)slot;
+    if (h->magic != SAMPLELOG_MAGIC)
+      continue;
+    SampleDecoder decoder;
+    records[i] = 0;
+    decoder.feed(slot + sizeof(SampleLogHeader), h->length,
+                 [&](const SampleRecord &) { records[i]++; });
+  }
+  return records;
+}
+
+// Clear the lowest set bit of the byte at offset in slot, or of the first
+// non-zero byte after it, as a worn or disturbed flash cell would.
+bool damage(int slot, size_t offset) {
+  uint8_t unit[UNIT];
+  for (; offset < SAMPLELOG_SLOT_SIZE; offset++) {
+    bd_addr_t addr = slot * SAMPLELOG_SLOT_SIZE + offset / UNIT * UNIT;
+    flash.read(unit, addr, UNIT);
+    uint8_t &byte = unit[offset % UNIT];
+    if (byte) {
+      byte &= byte - 1;
+      return flash.program(unit, addr, UNIT) == 0;
+    }
+  }
+  return false;
+}
+
+struct Damage {
+  const char *name;
+  size_t offset; // in the slot; past the header counts from its records
+  bool records;
+};
+
+const Damage DAMAGES[] = {
+    {"magic", offsetof(SampleLogHeader, magic), false},
+    {"sequence number", offsetof(SampleLogHeader, seq), false},
+    {"boot count", offsetof(SampleLogHeader, boot), false},
+    {"version", offsetof(SampleLogHeader, version), false},
+    {"length", offsetof(SampleLogHeader, length), false},
+    {"check", offsetof(SampleLogHeader, check), false},
+    {"keyframe", 0, true},
+    {"middle of the records", 60, true},
+    {"last record byte", 0xFFFF, true},
+};
+
+// Offset of d in slot, given the slot's record bytes.
+size_t place(const Damage &d, int slot) {
+  if (!d.records)
+    return d.offset;
+  SampleLogHeader h;
+  flash.read(&h, slot * SAMPLELOG_SLOT_SIZE, sizeof(h));
+  size_t last = h.length - 1;
+  return sizeof(SampleLogHeader) + (d.offset < last ? d.offset : last);
+}
+
+int total(const std::vector<int> &records) {
+  int n = 0;
+  for (int r : records)
+    n += r > 0 ? r : 0;
+  return n;
+}
+
+void check_damage() {
+  for (const Damage &d : DAMAGES) {
+    flash.init();
+    flash.erase(0, SIZE);
+    fill(boot_log(), 0, 200);
+
+    std::vector<int> before = slot_records();
+    CHECK(before[0] > 0 && before[1] > 0 && before[2] > 0);
+    CHECK((int)replayed(boot_log()) == total(before));
+
+    // a slot in the middle of the log
+    const int slot = 1;
+    if (!CHECK(damage(slot, place(d, slot))))
+      printf("  %s: nothing to clear\n", d.name);
+    SampleLog *log = boot_log();
+    int want = total(before) - before[slot];
+    int got = replayed(log);
+    if (!CHECK(got == want))
+      printf("  %s: %d records replayed, want %d\n", d.name, got, want);
+  }
+}
+
+// Damage to the newest slot: the log goes on after the slot before it, and
+// passes over the damaged one instead of programming over it.
+void check_newest() {
+  flash.init();
+  flash.erase(0, SIZE);
+  fill(boot_log(), 0, 200);
+
+  std::vector<int> before = slot_records();
+  int newest = 0;
+  while (before[newest + 1] > 0)
+    newest++;
+  CHECK(damage(newest, place(DAMAGES[7], newest)));
+
+  SampleLog *log = boot_log();
+  CHECK(log->boots() == 2);
+  fill(log, 1000, 10);
+  CHECK(log->stats().skipped == 1);
+  CHECK(log->stats().commits == 1);
+  std::vector<int> after = slot_records();
+  // boot record and ten samples in the slot after the damaged one
+  CHECK(after[newest + 1] == 11);
+  CHECK((int)replayed(log) == total(before) - before[newest] + 11);
+}
+
+} // namespace
+
+int main() {
+  check_damage();
+  check_newest();
+  return check_summary("samplelog");
+}
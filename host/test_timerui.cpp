@@ -0,0 +1,184 @@
+// Checks of the Project 2 timer keypad logic (Project 2/timerui.h)
+//
+// Walks every key of the keypad, and the countdown running out, through
+// every state of the timer and compares the action, the next state and the
+// lines to redraw with the table below, which spells out the intended
+// behaviour independently of TIMER_TABLE. Then checks the digit entry and
+// the display text.
+
+#include <cstring>
+
+#include "check.h"
+#include "timerui.h"
+
+namespace {
+
+// every key on the 4x4 keypad, then 'X' for TimerUI::expire()
+const char INPUTS[] = "0123456789ABCD*#X";
+
+struct Expect {
+  TimerAction action;
+  TimerState next;
+};
+
+// what each input does in each state; digits behave alike, and so do C, *
+// and #, so one column stands for each group
+struct Row {
+  TimerState state;
+  Expect digit, a, b, d, other, expired;
+};
+
+const Row ROWS[] = {
+    {TIMER_IDLE,
+     {TIMER_NONE, TIMER_IDLE}, {TIMER_NONE, TIMER_IDLE}, {TIMER_NONE, TIMER_IDLE},
+     {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_IDLE}, {TIMER_NONE, TIMER_IDLE}},
+    {TIMER_SET,
+     {TIMER_DIGIT, TIMER_SET}, {TIMER_START, TIMER_RUNNING}, {TIMER_NONE, TIMER_SET},
+     {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_SET}, {TIMER_NONE, TIMER_SET}},
+    {TIMER_RUNNING,
+     {TIMER_NONE, TIMER_RUNNING}, {TIMER_NONE, TIMER_RUNNING}, {TIMER_PAUSE, TIMER_PAUSED},
+     {TIMER_NONE, TIMER_RUNNING}, {TIMER_NONE, TIMER_RUNNING}, {TIMER_END, TIMER_DONE}},
+    {TIMER_PAUSED,
+     {TIMER_NONE, TIMER_PAUSED}, {TIMER_RESUME, TIMER_RUNNING}, {TIMER_NONE, TIMER_PAUSED},
+     {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_PAUSED}, {TIMER_NONE, TIMER_PAUSED}},
+    {TIMER_DONE,
+     {TIMER_NONE, TIMER_DONE}, {TIMER_NONE, TIMER_DONE}, {TIMER_NONE, TIMER_DONE},
+     {TIMER_NEW, TIMER_SET}, {TIMER_NONE, TIMER_DONE}, {TIMER_NONE, TIMER_DONE}},
+};
+
+Expect expected(const Row &row, char input) {
+  if (input >= '0' && input <= '9')
+    return row.digit;
+  switch (input) {
+  case 'A':
+    return row.a;
+  case 'B':
+    return row.b;
+  case 'D':
+    return row.d;
+  case 'X':
+    return row.expired;
+  default:
+    return row.other;
+  }
+}
+
+TimerUI::Step press(TimerUI &ui, char input) {
+  return input == 'X' ? ui.expire() : ui.input(input);
+}
+
+// A timer brought into state the way a user would get it there.
+TimerUI reach(TimerState state) {
+  TimerUI ui;
+  if (state == TIMER_IDLE)
+    return ui;
+  ui.input('D');
+  if (state == TIMER_SET)
+    return ui;
+  ui.input('1');
+  ui.input('3');
+  ui.input('0');
+  ui.input('A');
+  if (state == TIMER_PAUSED)
+    ui.input('B');
+  if (state == TIMER_DONE)
+    ui.expire();
+  return ui;
+}
+
+void check_transitions() {
+  for (const Row &row : ROWS) {
+    CHECK(reach(row.state).state() == row.state);
+    for (const char *p = INPUTS; *p; p++) {
+      TimerUI ui = reach(row.state);
+      Expect want = expected(row, *p);
+      TimerUI::Step step = press(ui, *p);
+      if (!CHECK(step.action == want.action && ui.state() == want.next))
+        printf("  state %d, input %c: action %d, state %d\n", row.state, *p,
+               step.action, ui.state());
+
+      // a new state or a new timer redraws everything, a digit the bottom
+      // line, anything else nothing
+      uint8_t render = want.next != row.state || want.action == TIMER_NEW
+                           ? TIMER_RENDER_ALL
+                       : want.action == TIMER_DIGIT ? TIMER_RENDER_BOTTOM
+                                                    : 0;
+      if (!CHECK(step.render == render))
+        printf("  state %d, input %c: render %d\n", row.state, *p, step.render);
+    }
+  }
+}
+
+struct Entry {
+  const char *keys; // pressed after D
+  uint32_t ms;      // timeMs() after them
+  const char *bottom;
+};
+
+const Entry ENTRIES[] = {
+    {"", 0, "m:ss"},
+    {"1", 60000, "1:ss"},
+    {"13", 90000, "1:3s"},
+    {"130", 90000, "1:30"},
+    {"195", 115000, "1:55"}, // tens of seconds stop at 5
+    {"9597", 599000, "9:59"}, // a fourth digit is ignored
+};
+
+void check_entry() {
+  for (const Entry &e : ENTRIES) {
+    TimerUI ui;
+    ui.input('D');
+    for (const char *p = e.keys; *p; p++) {
+      TimerUI::Step step = ui.input(*p);
+      CHECK(step.render == (p - e.keys < 3 ? TIMER_RENDER_BOTTOM : 0));
+    }
+    CHECK(ui.timeMs() == e.ms);
+
+    TextLine<16> top, bottom;
+    ui.render(top, bottom, 0);
+    CHECK(strncmp(top.c_str(), "Set timer:", 10) == 0);
+    if (!CHECK(strncmp(bottom.c_str(), e.bottom, strlen(e.bottom)) == 0))
+      printf("  keys %s: \"%s\"\n", e.keys, bottom.c_str());
+  }
+
+  // D starts the entry over
+  TimerUI ui;
+  ui.input('D');
+  ui.input('5');
+  ui.input('D');
+  CHECK(ui.timeMs() == 0);
+}
+
+struct Screen {
+  TimerState state;
+  unsigned seconds;
+  const char *top;
+  const char *bottom;
+};
+
+const Screen SCREENS[] = {
+    {TIMER_IDLE, 0, "Timer", "initialized."},
+    {TIMER_RUNNING, 90, "Time Remaining:", "1:30"},
+    {TIMER_PAUSED, 9, "Time Remaining:", "0:09"},
+    {TIMER_DONE, 42, "Times Up:", "0:00"},
+};
+
+void check_render() {
+  for (const Screen &s : SCREENS) {
+    TextLine<16> top, bottom;
+    reach(s.state).render(top, bottom, s.seconds);
+    if (!CHECK(strncmp(top.c_str(), s.top, strlen(s.top)) == 0 &&
+               strncmp(bottom.c_str(), s.bottom, strlen(s.bottom)) == 0))
+      printf("  state %d: \"%s\" \"%s\"\n", s.state, top.c_str(),
+             bottom.c_str());
+  }
+}
+
+} // namespace
+
+int main() {
+  check_transitions();
+  check_entry();
+  check_render();
+  return check_summary("timerui");
+}
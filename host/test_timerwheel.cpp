@@ -0,0 +1,226 @@
+// Checks of the countdown timer wheel (Project 2/timerwheel.h)
+//
+// Runs a TimerWheel on the simulator's virtual clock: countdowns from one
+// tick to more than two turns of the wheel, so their slots wrap, advanced a
+// tick at a time, at odd steps and in steps longer than a turn, must each be
+// called once, on the first advance at or after their time. Then stop and
+// restart, remaining() as the clock moves, and callbacks that start and stop
+// timers from inside advance().
+
+#include <cstdio>
+
+#include "check.h"
+#include "mbed.h"
+#include "timerwheel.h"
+
+namespace {
+
+uint32_t now_ms() {
+  return (uint32_t)Kernel::Clock::now().time_since_epoch().count();
+}
+
+void sleep_ms(uint32_t ms) {
+  ThisThread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+// Sleep to the start of a tick, so the times below are exact.
+uint32_t align() {
+  sleep_ms((TIMERWHEEL_TICK_MS - now_ms() % TIMERWHEEL_TICK_MS) %
+           TIMERWHEEL_TICK_MS);
+  return now_ms();
+}
+
+struct Expiry {
+  uint32_t ms;  // asked for
+  uint32_t due; // after the start, rounded up to a tick
+};
+
+const uint32_t TURN = TIMERWHEEL_TICK_MS * TIMERWHEEL_SLOTS;
+
+const Expiry EXPIRIES[] = {
+    {0, 10}, // never the tick already handled
+    {1, 10},
+    {10, 10},
+    {11, 20},
+    {TURN - 10, TURN - 10}, // the slot before the start's
+    {TURN, TURN},           // the start's own slot, a turn later
+    {TURN + 10, TURN + 10},
+    {2 * TURN + 895, 2 * TURN + 900},
+};
+
+const int EXPIRY_COUNT = sizeof(EXPIRIES) / sizeof(EXPIRIES[0]);
+
+// Every countdown at once, advanced every step ms: each is called once, on
+// the first advance at or after its time.
+void check_expiry(uint32_t step) {
+  // past a turn of the clock first, so the slot index has wrapped
+  sleep_ms(TURN + 30);
+  TimerWheel wheel;
+  WheelTimer timers[EXPIRY_COUNT];
+  uint32_t called[EXPIRY_COUNT] = {};
+  int calls[EXPIRY_COUNT] = {};
+
+  uint32_t start = align();
+  for (int i = 0; i < EXPIRY_COUNT; i++)
+    wheel.start(timers[i], EXPIRIES[i].ms, [&, i]() {
+      CHECK(!timers[i].active());
+      called[i] = now_ms() - start;
+      calls[i]++;
+    });
+  CHECK(wheel.count() == EXPIRY_COUNT);
+
+  uint32_t last = EXPIRIES[EXPIRY_COUNT - 1].due;
+  for (uint32_t t = step; t < last + step; t += step) {
+    sleep_ms(step);
+    wheel.advance();
+  }
+  CHECK(wheel.count() == 0);
+
+  for (int i = 0; i < EXPIRY_COUNT; i++) {
+    uint32_t want = (EXPIRIES[i].due + step - 1) / step * step;
+    if (!CHECK(calls[i] == 1 && called[i] == want))
+      printf("  %u ms in steps of %u ms: called %d times, at %u ms, want "
+             "%u ms\n",
+             EXPIRIES[i].ms, step, calls[i], called[i], want);
+  }
+}
+
+void check_stop() {
+  TimerWheel wheel;
+  WheelTimer a, b, c;
+  int fired_a = 0, fired_b = 0, fired_c = 0;
+  uint32_t start = align();
+  uint32_t at_c = 0;
+
+  wheel.start(a, 100, [&]() { fired_a++; });
+  wheel.start(b, 100, [&]() { fired_b++; });
+  wheel.start(c, 200, [&]() {
+    fired_c++;
+    at_c = now_ms() - start;
+  });
+  wheel.stop(b);
+  wheel.stop(b); // stopping an idle timer does nothing
+  CHECK(!b.active() && wheel.count() == 2);
+  CHECK(wheel.remaining(b) == 0);
+
+  for (int i = 0; i < 10; i++) {
+    sleep_ms(10);
+    wheel.advance();
+  }
+  CHECK(fired_a == 1 && fired_b == 0 && fired_c == 0);
+  wheel.stop(a); // already called
+  CHECK(wheel.count() == 1);
+
+  // restarted at 100 ms for 50 ms more: called at 150 ms, not at 200 ms
+  wheel.start(c, 50, [&]() {
+    fired_c++;
+    at_c = now_ms() - start;
+  });
+  CHECK(wheel.count() == 1);
+  for (int i = 0; i < 20; i++) {
+    sleep_ms(10);
+    wheel.advance();
+  }
+  if (!CHECK(fired_c == 1 && at_c == 150))
+    printf("  restarted timer called %d times, last at %u ms\n", fired_c,
+           at_c);
+  CHECK(wheel.count() == 0);
+}
+
+struct Remaining {
+  uint32_t at; // after the start
+  uint32_t remaining;
+};
+
+// A 1 s countdown, with advance() only at the end: remaining() counts down
+// whole ticks and stays 0 once the time is up until the timer is called.
+const Remaining REMAINING[] = {
+    {0, 1000}, {5, 1000}, {10, 990}, {500, 500},
+    {995, 10}, {1000, 0}, {1500, 0},
+};
+
+void check_remaining() {
+  TimerWheel wheel;
+  WheelTimer t;
+  int fired = 0;
+  CHECK(wheel.remaining(t) == 0);
+
+  uint32_t start = align();
+  wheel.start(t, 1000, [&]() { fired++; });
+  for (const Remaining &r : REMAINING) {
+    sleep_ms(start + r.at - now_ms());
+    if (!CHECK(wheel.remaining(t) == r.remaining && t.active()))
+      printf("  at %u ms: %u ms remaining, want %u ms\n", r.at,
+             wheel.remaining(t), r.remaining);
+  }
+  CHECK(fired == 0);
+  wheel.advance();
+  CHECK(fired == 1 && !t.active() && wheel.remaining(t) == 0);
+
+  // a stopped timer has nothing left
+  wheel.start(t, 1000, [&]() { fired++; });
+  wheel.stop(t);
+  CHECK(wheel.remaining(t) == 0);
+}
+
+// Advanced every tick for half a second, with callbacks that start and stop
+// timers, their own included.
+void check_callbacks() {
+  TimerWheel wheel;
+  uint32_t start = align();
+
+  // a timer that restarts itself every 100 ms
+  WheelTimer periodic;
+  int ticks = 0;
+  Callback<void()> again = [&]() {
+    ticks++;
+    if (!CHECK(now_ms() - start == ticks * 100u))
+      printf("  periodic call %d at %u ms\n", ticks, now_ms() - start);
+    wheel.start(periodic, 100, again);
+  };
+  wheel.start(periodic, 100, again);
+
+  // two timers due on the same tick, each stopping the other: only the one
+  // called first runs
+  WheelTimer x, y;
+  int fired_xy = 0;
+  wheel.start(x, 250, [&]() {
+    fired_xy++;
+    wheel.stop(y);
+  });
+  wheel.start(y, 250, [&]() {
+    fired_xy++;
+    wheel.stop(x);
+  });
+
+  // a timer started from a callback with no time left waits for the next
+  // tick, not for the rest of this advance
+  WheelTimer first, second;
+  uint32_t at_second = 0;
+  wheel.start(first, 120, [&]() {
+    wheel.start(second, 0, [&]() { at_second = now_ms() - start; });
+    CHECK(second.active());
+  });
+
+  for (int i = 0; i < 50; i++) {
+    sleep_ms(10);
+    wheel.advance();
+    wheel.advance(); // no tick passed, nothing to do
+  }
+  CHECK(fired_xy == 1 && !x.active() && !y.active());
+  if (!CHECK(at_second == 130))
+    printf("  timer started from a callback called at %u ms\n", at_second);
+  CHECK(ticks == 5 && periodic.active() && wheel.count() == 1);
+}
+
+} // namespace
+
+int main() {
+  check_expiry(TIMERWHEEL_TICK_MS);
+  check_expiry(7);
+  check_expiry(TURN + 440); // a step longer than a turn
+  check_stop();
+  check_remaining();
+  check_callbacks();
+  return check_summary("timerwheel");
+}